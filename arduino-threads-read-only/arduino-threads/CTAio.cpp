@@ -0,0 +1,767 @@
+/*****************************************************************
+ CTAio -- asynchronous I/O through an io_uring or worker threads,
+ and the parts of CTScheduler that submit requests and deliver
+ their results.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_AIO
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#if ( CT_AIO_ENTRIES & ( CT_AIO_ENTRIES - 1 ) ) != 0
+#error "CT_AIO_ENTRIES must be a power of two"
+#endif
+
+#define CT_AIO_BLOCK ( sizeof( Ct_aio_req ) + CT_AIO_BUF_LEN )
+
+CTAio::CTAio() {
+    started = 0;
+    done_fd = -1;
+#if defined CT_ARENA
+    ctMemory.arenaInit( &req_arena, CT_AIO_BLOCK);
+    ctMemory.arenaInit( &bare_arena, sizeof(Ct_aio_req));
+#endif
+    free_reqs = NULL;
+    free_bare = NULL;
+    queue_head = queue_tail = NULL;
+    queued = 0;
+    in_flight = 0;
+
+    ring_fd = -1;
+    sq_ptr = cq_ptr = sqes = NULL;
+    sq_size = cq_size = sqes_size = 0;
+    unsubmitted = 0;
+
+    worker_count = 0;
+    work_head = work_tail = NULL;
+    done_head = done_tail = NULL;
+    stopping = 0;
+}
+
+CTAio::~CTAio() {
+    ct_shutdown();
+}
+
+/* ---------------- requests: ------------------------------------- */
+
+Ct_aio_req * CTAio::ct_alloc_req(int with_buff) {
+    Ct_aio_req ** ppFree = with_buff ? &free_reqs : &free_bare;
+    Ct_aio_req * pReq;
+
+    if ( *ppFree != NULL) {
+        pReq = *ppFree;
+        *ppFree = pReq->pNext;
+    }
+    else {
+#if defined CT_ARENA
+        pReq = (Ct_aio_req *) ctMemory.arenaAlloc(
+                with_buff ? &req_arena : &bare_arena);
+#else
+        pReq = (Ct_aio_req *) ctMemory.allocMemory(
+                with_buff ? CT_AIO_BLOCK : sizeof(Ct_aio_req));
+#endif
+        if (NULL == pReq)
+            return NULL;
+    }
+
+    memset(pReq, 0, sizeof(Ct_aio_req));
+    pReq->fd = -1;
+    pReq->offset = -1;
+    pReq->has_buff = with_buff ? 1 : 0;
+#ifndef NDEBUG
+    pReq->magic = AIO_MAGIC;
+#endif
+    return pReq;
+}
+
+void CTAio::ct_free_req(Ct_aio_req * pReq) {
+    if (NULL == pReq)
+        return;
+
+    ASSERT( AIO_MAGIC == pReq->magic );
+#ifndef NDEBUG
+    pReq->magic = 0;
+#endif
+
+    if (pReq->has_buff) {
+        pReq->pNext = free_reqs;
+        free_reqs = pReq;
+    }
+    else {
+        pReq->pNext = free_bare;
+        free_bare = pReq;
+    }
+}
+
+void CTAio::free_list(Ct_aio_req ** ppList) {
+#if defined CT_ARENA
+
+    /* The arenas give them back wholesale */
+
+    *ppList = NULL;
+#else
+    Ct_aio_req * pTemp;
+
+    while ( *ppList != NULL) {
+        pTemp = ( *ppList)->pNext;
+        ctMemory.freeMemory( *ppList);
+        *ppList = pTemp;
+    }
+#endif
+}
+
+/* ---------------- queueing and submitting: ---------------------- */
+
+int CTAio::ct_queue(Ct_aio_req * pReq) {
+    ASSERT( AIO_MAGIC == pReq->magic );
+
+    if ( !started && start() != CT_OKAY)
+        return CT_ERROR;
+
+    pReq->pNext = NULL;
+    if (NULL == queue_tail)
+        queue_head = pReq;
+    else
+        queue_tail->pNext = pReq;
+    queue_tail = pReq;
+    ++queued;
+
+    return CT_OKAY;
+}
+
+void CTAio::ct_submit(void) {
+    if (0 == queued && 0 == unsubmitted)
+        return;
+
+    if (ring_fd >= 0)
+        submit_uring();
+    else
+        submit_workers();
+}
+
+Ct_aio_req * CTAio::ct_reap(int wait) {
+    if (0 == in_flight)
+        return NULL;
+
+    if (ring_fd >= 0)
+        return reap_uring(wait);
+    else
+        return reap_workers(wait);
+}
+
+/*****************************************************************
+ Prefer an io_uring; fall back to worker threads.  (See CTAio.h
+ for why the io_uring, even for regular files.)
+ ****************************************************************/
+
+int CTAio::start(void) {
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (done_fd < 0) {
+        CTOut::ct_report_error("ct_aio: unable to create an eventfd");
+        return CT_ERROR;
+    }
+
+    if (start_uring() != CT_OKAY && start_workers() != CT_OKAY) {
+        CTOut::ct_report_error("ct_aio: unable to start io_uring or worker threads");
+        close(done_fd);
+        done_fd = -1;
+        return CT_ERROR;
+    }
+
+    started = 1;
+    return CT_OKAY;
+}
+
+void CTAio::ct_clear_done(void) {
+    uint64_t count;
+
+    if (done_fd >= 0 && read(done_fd, &count, sizeof( count )) < 0)
+        return; /* EAGAIN: nothing to clear */
+}
+
+void CTAio::ct_wait_done(int timeout_ms) {
+    struct pollfd pfd;
+
+    if (done_fd < 0)
+        return;
+
+    pfd.fd = done_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll( &pfd, 1, timeout_ms) > 0)
+        ct_clear_done();
+}
+
+void CTAio::signal_done(void) {
+    uint64_t one = 1;
+
+    if (write(done_fd, &one, sizeof( one )) < 0)
+        return; /* only if the count would overflow: still readable */
+}
+
+void CTAio::ct_shutdown(void) {
+    Ct_aio_req * pReq;
+
+    if (started) {
+        /* The kernel or a worker may still be using the buffers */
+
+        while (in_flight > 0) {
+            pReq = ct_reap(CT_TRUE);
+            while (pReq != NULL) {
+                Ct_aio_req * pNext = pReq->pNext;
+                ct_free_req(pReq);
+                pReq = pNext;
+            }
+        }
+
+        if (ring_fd >= 0)
+            stop_uring();
+        else
+            stop_workers();
+
+        close(done_fd);
+        done_fd = -1;
+        started = 0;
+    }
+
+    while (queue_head != NULL) {
+        pReq = queue_head->pNext;
+        ct_free_req(queue_head);
+        queue_head = pReq;
+    }
+    queue_tail = NULL;
+    queued = 0;
+
+    free_list( &free_reqs);
+    free_list( &free_bare);
+#if defined CT_ARENA
+    ctMemory.arenaRelease( &req_arena);
+    ctMemory.arenaRelease( &bare_arena);
+#endif
+}
+
+/* ---------------- io_uring: ------------------------------------- */
+
+/*****************************************************************
+ We drive the io_uring through the raw system calls, so as not to
+ depend on liburing.  The kernel shares three regions with us: the
+ submission ring (indices into the array of submission entries),
+ the array of submission entries itself, and the completion ring.
+ ****************************************************************/
+
+int CTAio::start_uring(void) {
+    struct io_uring_params p;
+    unsigned char * sq;
+    unsigned char * cq;
+
+    memset( &p, 0, sizeof( p ));
+    ring_fd = (int) syscall(__NR_io_uring_setup, CT_AIO_ENTRIES, &p);
+    if (ring_fd < 0)
+        return CT_ERROR;
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* Newer kernels map both rings in one region */
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size)
+            sq_size = cq_size;
+        cq_size = 0;
+    }
+
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq_ptr) {
+        sq_ptr = NULL;
+        stop_uring();
+        return CT_ERROR;
+    }
+
+    if (0 == cq_size)
+        cq_ptr = sq_ptr;
+    else {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == cq_ptr) {
+            cq_ptr = NULL;
+            stop_uring();
+            return CT_ERROR;
+        }
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == sqes) {
+        sqes = NULL;
+        stop_uring();
+        return CT_ERROR;
+    }
+
+    sq = (unsigned char *) sq_ptr;
+    sq_tail = (unsigned *) ( sq + p.sq_off.tail );
+    sq_mask = (unsigned *) ( sq + p.sq_off.ring_mask );
+    sq_array = (unsigned *) ( sq + p.sq_off.array );
+    sq_entries = p.sq_entries;
+
+    cq = (unsigned char *) cq_ptr;
+    cq_head = (unsigned *) ( cq + p.cq_off.head );
+    cq_tail = (unsigned *) ( cq + p.cq_off.tail );
+    cq_mask = (unsigned *) ( cq + p.cq_off.ring_mask );
+    cqes = cq + p.cq_off.cqes;
+    cq_entries = p.cq_entries;
+
+    /* Have the kernel signal completions on the eventfd */
+
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_EVENTFD,
+            &done_fd, 1) != 0) {
+        stop_uring();
+        return CT_ERROR;
+    }
+
+    unsubmitted = 0;
+    return CT_OKAY;
+}
+
+void CTAio::stop_uring(void) {
+    if (sqes != NULL)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != NULL && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != NULL)
+        munmap(sq_ptr, sq_size);
+    sqes = cq_ptr = sq_ptr = NULL;
+
+    if (ring_fd >= 0)
+        close(ring_fd);
+    ring_fd = -1;
+}
+
+/*****************************************************************
+ Move queued requests into the submission ring, as many as it and
+ the completion ring have room for, and hand them all to the
+ kernel with one system call.
+ ****************************************************************/
+
+void CTAio::submit_uring(void) {
+    struct io_uring_sqe * pSqe;
+    Ct_aio_req * pReq;
+    unsigned tail;
+    unsigned idx;
+    int rc;
+
+    tail = *sq_tail; /* we are the only writer */
+
+    while (queue_head != NULL && unsubmitted < sq_entries
+            && in_flight < cq_entries) {
+        pReq = queue_head;
+        queue_head = pReq->pNext;
+        if (NULL == queue_head)
+            queue_tail = NULL;
+        --queued;
+
+        idx = tail & *sq_mask;
+        pSqe = (struct io_uring_sqe *) sqes + idx;
+        memset(pSqe, 0, sizeof( *pSqe ));
+        pSqe->fd = pReq->fd;
+        pSqe->user_data = (uint64_t) (uintptr_t) pReq;
+
+        if (CT_AIO_FSYNC == pReq->op)
+            pSqe->opcode = IORING_OP_FSYNC;
+        else {
+            pSqe->opcode = CT_AIO_READ == pReq->op ? IORING_OP_READV
+                    : IORING_OP_WRITEV;
+            pSqe->addr = (uint64_t) (uintptr_t) &pReq->iov;
+            pSqe->len = 1;
+            pSqe->off = (uint64_t) pReq->offset;
+        }
+
+        sq_array[ idx ] = idx;
+        ++tail;
+        ++unsubmitted;
+        ++in_flight;
+    }
+
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    if (unsubmitted > 0) {
+        rc = (int) syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 0, 0,
+                NULL, 0);
+
+        /* On failure (e.g. EAGAIN) the entries stay in */
+        /* the ring, to be submitted next time. */
+
+        if (rc > 0)
+            unsubmitted -= (unsigned) rc;
+    }
+}
+
+Ct_aio_req * CTAio::reap_uring(int wait) {
+    struct io_uring_cqe * pCqe;
+    Ct_aio_req * pFirst = NULL;
+    Ct_aio_req * pLast = NULL;
+    Ct_aio_req * pReq;
+    unsigned head;
+    unsigned tail;
+
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail && wait) {
+        int rc = (int) syscall(__NR_io_uring_enter, ring_fd, unsubmitted,
+                1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (rc > 0)
+            unsubmitted -= (unsigned) rc;
+        tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    while (head != tail) {
+        pCqe = (struct io_uring_cqe *) cqes + ( head & *cq_mask );
+        pReq = (Ct_aio_req *) (uintptr_t) pCqe->user_data;
+        ASSERT( AIO_MAGIC == pReq->magic );
+        pReq->result = pCqe->res;
+        pReq->pNext = NULL;
+
+        if (NULL == pLast)
+            pFirst = pReq;
+        else
+            pLast->pNext = pReq;
+        pLast = pReq;
+
+        ++head;
+        --in_flight;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return pFirst;
+}
+
+/* ---------------- worker threads: ------------------------------- */
+
+int CTAio::start_workers(void) {
+    int i;
+
+    if (pthread_mutex_init( &lock, NULL) != 0)
+        return CT_ERROR;
+    pthread_cond_init( &work_ready, NULL);
+    pthread_cond_init( &work_done, NULL);
+    stopping = 0;
+
+    for (i = 0; i < CT_AIO_WORKERS; ++i) {
+        if (pthread_create(workers + i, NULL, worker, this) != 0)
+            break;
+    }
+
+    worker_count = i;
+    if (0 == worker_count) {
+        pthread_cond_destroy( &work_done);
+        pthread_cond_destroy( &work_ready);
+        pthread_mutex_destroy( &lock);
+        return CT_ERROR;
+    }
+
+    return CT_OKAY;
+}
+
+void CTAio::stop_workers(void) {
+    int i;
+
+    pthread_mutex_lock( &lock);
+    stopping = 1;
+    pthread_cond_broadcast( &work_ready);
+    pthread_mutex_unlock( &lock);
+
+    for (i = 0; i < worker_count; ++i)
+        pthread_join(workers[ i ], NULL);
+    worker_count = 0;
+
+    pthread_cond_destroy( &work_done);
+    pthread_cond_destroy( &work_ready);
+    pthread_mutex_destroy( &lock);
+}
+
+/*****************************************************************
+ Take requests off the work list, one at a time, and perform them
+ with blocking calls, until told to stop.
+ ****************************************************************/
+
+void * CTAio::worker(void * pArg) {
+    CTAio * pAio = (CTAio *) pArg;
+    Ct_aio_req * pReq;
+
+    pthread_mutex_lock( &pAio->lock);
+
+    for (;;) {
+        while (NULL == pAio->work_head && !pAio->stopping)
+            pthread_cond_wait( &pAio->work_ready, &pAio->lock);
+
+        if (NULL == pAio->work_head)
+            break; /* stopping */
+
+        pReq = pAio->work_head;
+        pAio->work_head = pReq->pNext;
+        if (NULL == pAio->work_head)
+            pAio->work_tail = NULL;
+
+        pthread_mutex_unlock( &pAio->lock);
+        perform(pReq);
+        pthread_mutex_lock( &pAio->lock);
+
+        pReq->pNext = NULL;
+        if (NULL == pAio->done_tail)
+            pAio->done_head = pReq;
+        else
+            pAio->done_tail->pNext = pReq;
+        pAio->done_tail = pReq;
+        pthread_cond_signal( &pAio->work_done);
+        pAio->signal_done();
+    }
+
+    pthread_mutex_unlock( &pAio->lock);
+    return NULL;
+}
+
+void CTAio::perform(Ct_aio_req * pReq) {
+    ssize_t n;
+
+    switch (pReq->op) {
+        case CT_AIO_READ :
+            if (pReq->offset < 0)
+                n = read(pReq->fd, pReq->iov.iov_base, pReq->iov.iov_len);
+            else
+                n = pread(pReq->fd, pReq->iov.iov_base, pReq->iov.iov_len,
+                        (off_t) pReq->offset);
+            break;
+        case CT_AIO_WRITE :
+            if (pReq->offset < 0)
+                n = write(pReq->fd, pReq->iov.iov_base, pReq->iov.iov_len);
+            else
+                n = pwrite(pReq->fd, pReq->iov.iov_base, pReq->iov.iov_len,
+                        (off_t) pReq->offset);
+            break;
+        default :
+            n = fsync(pReq->fd);
+            break;
+    }
+
+    pReq->result = n < 0 ? -(long) errno : (long) n;
+}
+
+/*****************************************************************
+ Hand the whole queue to the workers at once.
+ ****************************************************************/
+
+void CTAio::submit_workers(void) {
+    if (NULL == queue_head)
+        return;
+
+    pthread_mutex_lock( &lock);
+
+    if (NULL == work_tail)
+        work_head = queue_head;
+    else
+        work_tail->pNext = queue_head;
+    work_tail = queue_tail;
+
+    pthread_cond_broadcast( &work_ready);
+    pthread_mutex_unlock( &lock);
+
+    in_flight += queued;
+    queue_head = queue_tail = NULL;
+    queued = 0;
+}
+
+Ct_aio_req * CTAio::reap_workers(int wait) {
+    Ct_aio_req * pFirst;
+    Ct_aio_req * pReq;
+
+    pthread_mutex_lock( &lock);
+
+    if (wait) {
+        while (NULL == done_head)
+            pthread_cond_wait( &work_done, &lock);
+    }
+
+    pFirst = done_head;
+    done_head = done_tail = NULL;
+    pthread_mutex_unlock( &lock);
+
+    for (pReq = pFirst; pReq != NULL; pReq = pReq->pNext)
+        --in_flight;
+
+    return pFirst;
+}
+
+/* ---------------- the scheduler's side: ------------------------- */
+
+/*****************************************************************
+ Return a buffer of CT_AIO_BUF_LEN bytes for ct_aio_read() or
+ ct_aio_write(), or NULL if out of memory.  The buffer belongs to
+ the caller until submitted, and again once the completion message
+ arrives, when the caller should give it back by ct_aio_release().
+ ****************************************************************/
+
+void * CTScheduler::ct_aio_buffer(void) {
+    Ct_aio_req * pReq = aio.ct_alloc_req(CT_TRUE);
+
+    if (NULL == pReq) {
+        CTOut::ct_report_error("ct_aio_buffer: out of memory");
+        return NULL;
+    }
+
+    return CTAio::ct_req_buff(pReq);
+}
+
+void CTScheduler::ct_aio_release(void * buff) {
+    if (buff != NULL)
+        aio.ct_free_req(CTAio::ct_buff_req(buff));
+}
+
+/*****************************************************************
+ Queue a read or write of len bytes between a file descriptor and
+ a buffer from ct_aio_buffer(), at the specified offset, or at the
+ current file position if the offset is negative (as it must be
+ for pipes and ttys).  The current thread will be sent the result.
+ ****************************************************************/
+
+int CTScheduler::queue_aio(Ct_aio_op op, int fd, void * buff,
+        unsigned long len, long long offset) {
+    Ct_aio_req * pReq;
+
+    if (NULL == pCurr_thread) {
+        CTOut::ct_report_error("ct_aio: no thread is active");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    ASSERT( CT_MAGIC == pCurr_thread->magic );
+
+    if (CT_AIO_FSYNC == op)
+        pReq = aio.ct_alloc_req(CT_FALSE);
+    else {
+        if (NULL == buff || len > CT_AIO_BUF_LEN) {
+            CTOut::ct_report_error("ct_aio: invalid buffer");
+            return CT_ERROR;
+        }
+        pReq = CTAio::ct_buff_req(buff);
+        ASSERT( AIO_MAGIC == pReq->magic );
+    }
+
+    if (NULL == pReq) {
+        CTOut::ct_report_error("ct_aio: out of memory");
+        return CT_ERROR;
+    }
+
+    pReq->op = op;
+    pReq->fd = fd;
+    pReq->offset = offset < 0 ? -1 : offset;
+    pReq->iov.iov_base = buff;
+    pReq->iov.iov_len = len;
+    pReq->result = 0;
+    pReq->owner.p = pCurr_thread;
+    pReq->owner.incarnation = pCurr_thread->incarnation;
+#if defined CT_THREADSAFE
+    pReq->owner.partition = partition_id;
+#endif
+
+    if (aio.ct_queue(pReq) != CT_OKAY) {
+        if (CT_AIO_FSYNC == op)
+            aio.ct_free_req(pReq);
+        return CT_ERROR;
+    }
+
+    return CT_OKAY;
+}
+
+int CTScheduler::ct_aio_read(int fd, void * buff, unsigned long len,
+        long long offset) {
+    return queue_aio(CT_AIO_READ, fd, buff, len, offset);
+}
+
+int CTScheduler::ct_aio_write(int fd, void * buff, unsigned long len,
+        long long offset) {
+    return queue_aio(CT_AIO_WRITE, fd, buff, len, offset);
+}
+
+int CTScheduler::ct_aio_fsync(int fd) {
+    return queue_aio(CT_AIO_FSYNC, fd, NULL, 0, -1);
+}
+
+/*****************************************************************
+ Submit whatever the threads have queued, collect whatever has
+ completed -- blocking for at least one completion, if told to --
+ and send each result to the thread that asked for it.  A result
+ whose thread has since finished is simply discarded, along with
+ its buffer.
+ ****************************************************************/
+
+void CTScheduler::poll_aio(int wait) {
+    Ct_aio_result result;
+    Ct_aio_req * pReq;
+    Ct_aio_req * pNext;
+    Ct_event * pE;
+
+    aio.ct_submit();
+
+    for (pReq = aio.ct_reap(wait); pReq != NULL; pReq = pNext) {
+        pNext = pReq->pNext;
+
+        if ( !ctDataStore.ct_valid_handle( &pReq->owner)) {
+            aio.ct_free_req(pReq);
+            continue;
+        }
+
+        pE = ctDataStore.ct_alloc_event();
+        if (NULL == pE) {
+            aio.ct_free_req(pReq);
+            ct_fatal_error();
+            continue;
+        }
+
+        result.buff = pReq->has_buff ? CTAio::ct_req_buff(pReq) : NULL;
+        result.result = pReq->result;
+
+        pE->pNext = NULL;
+        pE->type = CT_AIO_MSGTYPE;
+        pE->ev_type = CT_EV_MSG;
+        pE->priority = 0;
+#if defined CT_MAILBOX
+        pE->reserved = 0;
+#endif
+        pE->msg_len = sizeof( result );
+        pE->refcount = 0;
+        pE->pData = NULL;
+        memcpy(pE->buff, &result, sizeof( result ));
+        pE->dispatch_type = CT_DISPATCH_ADDRESSEE;
+        pE->addressee = pReq->owner;
+#ifndef NDEBUG
+        pE->magic = EVENT_MAGIC;
+#endif
+
+        /* An fsync has no buffer to give back, so we're done with it */
+
+        if ( !pReq->has_buff)
+            aio.ct_free_req(pReq);
+
+        if (ct_deliver_event(pE, (Ct_thread *) pE->addressee.p) != CT_OKAY) {
+            ct_fatal_error();
+            if ( 0 == pE->refcount)
+                ctDataStore.ct_destruct_event( &pE);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*****************************************************************
+ CTAio -- asynchronous reads, writes and fsyncs for a scheduler.
+
+ Threads queue requests during their steps; once per loop the
+ scheduler submits everything queued in a single batch and
+ collects whatever has completed, sending each result as a
+ message to the thread that asked.
+
+ Requests go to an io_uring if the kernel provides one (Linux
+ 5.2 or later, and not forbidden by a seccomp filter).  Otherwise
+ they go to a small pool of worker threads that perform them with
+ ordinary blocking calls.  Either way, only the scheduler's own OS
+ thread calls the functions of this class.
+
+ The io_uring is preferred for regular files too.  A read from the
+ page cache completes within the call that submits it, whereas a
+ worker costs a hand-off and a wake-up each way.
+
+ Either way, an eventfd is signalled whenever a request completes,
+ so that the scheduler can sleep on it -- or on an epoll instance
+ watching it -- along with whatever else it is waiting for.
+
+ Each request lives in a block of its own, followed by its data
+ buffer if it has one, so that the buffer handed to the thread
+ leads straight back to the request.  The blocks come from
+ CTMemory, or from arenas with CT_ARENA, and finished ones go on
+ a free list for reuse.
+
+ Compiled only if CT_AIO is defined.
+ ****************************************************************/
+
+#ifndef CTAIO_H_
+#define CTAIO_H_
+
+#if defined CT_AIO
+
+#include <pthread.h>
+#include <sys/uio.h>
+#include "ct.h"
+#include "ctpriv.h"
+#include "CTMemory.h"
+
+/* Capacity of the io_uring's submission queue (a power of two): */
+
+#ifndef CT_AIO_ENTRIES
+#define CT_AIO_ENTRIES 64
+#endif
+
+/* Number of worker threads when there is no io_uring: */
+
+#ifndef CT_AIO_WORKERS
+#define CT_AIO_WORKERS 2
+#endif
+
+#ifndef NDEBUG
+#define AIO_MAGIC 5683920L
+#endif
+
+typedef enum
+{
+    CT_AIO_READ,
+    CT_AIO_WRITE,
+    CT_AIO_FSYNC
+} Ct_aio_op;
+
+typedef struct Ct_aio_req Ct_aio_req;
+
+struct Ct_aio_req {
+        Ct_aio_req * pNext;
+        Ct_handle owner; /* thread to be told of completion */
+        Ct_aio_op op;
+        int fd;
+        long long offset; /* or -1 for the current file position */
+        struct iovec iov; /* the buffer and length to transfer */
+        long result;
+        int has_buff; /* boolean: a CT_AIO_BUF_LEN buffer follows */
+#ifndef NDEBUG
+        long magic;
+#endif
+};
+
+class CTAio {
+
+    public:
+
+        CTAio();
+        virtual ~CTAio();
+
+        /*****************************************************************
+         Allocate a request, with or without a buffer.  Return NULL if
+         out of memory.
+         ****************************************************************/
+
+        Ct_aio_req * ct_alloc_req(int with_buff);
+        void ct_free_req(Ct_aio_req * pReq);
+
+        static void * ct_req_buff(Ct_aio_req * pReq) {
+            return pReq + 1;
+        }
+
+        static Ct_aio_req * ct_buff_req(void * buff) {
+            return (Ct_aio_req *) buff - 1;
+        }
+
+        /*****************************************************************
+         Queue a request, to be submitted with the next batch.  Return
+         CT_ERROR if neither an io_uring nor worker threads could be
+         started.
+         ****************************************************************/
+
+        int ct_queue(Ct_aio_req * pReq);
+
+        /*****************************************************************
+         Submit the queued requests in one batch, as far as there is
+         room for them.
+         ****************************************************************/
+
+        void ct_submit(void);
+
+        /*****************************************************************
+         Return a list of completed requests, oldest first, or NULL if
+         none.  If wait is CT_TRUE, block until there is at least one.
+         ****************************************************************/
+
+        Ct_aio_req * ct_reap(int wait);
+
+        /*****************************************************************
+         Return the number of requests queued or in flight.
+         ****************************************************************/
+
+        unsigned long ct_outstanding(void) const {
+            return queued + in_flight;
+        }
+
+        int ct_using_uring(void) const {
+            return ring_fd >= 0;
+        }
+
+        /*****************************************************************
+         Return the eventfd that is readable once a request completes,
+         or -1 if not started.  ct_clear_done() resets it, and
+         ct_wait_done() sleeps on it for up to timeout_ms milliseconds
+         (-1 for ever) and then resets it.  Neither reaps anything.
+         ****************************************************************/
+
+        int ct_done_fd(void) const {
+            return done_fd;
+        }
+
+        void ct_clear_done(void);
+        void ct_wait_done(int timeout_ms);
+
+        /*****************************************************************
+         Wait for everything in flight, discard everything queued, stop
+         the io_uring or the workers, and free all requests.
+         ****************************************************************/
+
+        void ct_shutdown(void);
+
+    private:
+
+        int started; /* boolean: io_uring or workers are running */
+        int done_fd; /* eventfd signalled on completion */
+
+        CTMemory ctMemory;
+#if defined CT_ARENA
+        Ct_arena req_arena; /* blocks with buffers */
+        Ct_arena bare_arena; /* blocks without */
+#endif
+        Ct_aio_req * free_reqs; /* blocks with buffers */
+        Ct_aio_req * free_bare; /* blocks without */
+
+        Ct_aio_req * queue_head; /* queued, not yet submitted */
+        Ct_aio_req * queue_tail;
+        unsigned long queued;
+        unsigned long in_flight;
+
+        /* io_uring, if we have one: */
+
+        int ring_fd;
+        void * sq_ptr;
+        unsigned long sq_size;
+        void * cq_ptr;
+        unsigned long cq_size;
+        void * sqes; /* struct io_uring_sqe [] */
+        unsigned long sqes_size;
+        unsigned * sq_tail;
+        unsigned * sq_mask;
+        unsigned * sq_array;
+        unsigned sq_entries;
+        unsigned unsubmitted; /* in the ring, not yet taken by the kernel */
+        unsigned * cq_head;
+        unsigned * cq_tail;
+        unsigned * cq_mask;
+        void * cqes; /* struct io_uring_cqe [] */
+        unsigned cq_entries;
+
+        /* Worker threads otherwise.  The mutex guards the work */
+        /* and done lists and the stopping flag: */
+
+        pthread_t workers[ CT_AIO_WORKERS ];
+        int worker_count;
+        pthread_mutex_t lock;
+        pthread_cond_t work_ready;
+        pthread_cond_t work_done;
+        Ct_aio_req * work_head;
+        Ct_aio_req * work_tail;
+        Ct_aio_req * done_head;
+        Ct_aio_req * done_tail;
+        int stopping;
+
+        int start(void);
+        int start_uring(void);
+        void stop_uring(void);
+        int start_workers(void);
+        void stop_workers(void);
+        void submit_uring(void);
+        Ct_aio_req * reap_uring(int wait);
+        void submit_workers(void);
+        Ct_aio_req * reap_workers(int wait);
+        static void * worker(void * pArg);
+        static void perform(Ct_aio_req * pReq);
+        void signal_done(void);
+        void free_list(Ct_aio_req ** ppList);
+};
+
+#endif
+
+#endif /*CTAIO_H_*/
@@ -0,0 +1,265 @@
+/*****************************************************************
+ CTCoroutine -- frame pools for coroutine threads, and the parts
+ of CTScheduler that create and resume them.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_COROUTINES
+
+/* Each frame follows a header naming the pool it came from, */
+/* if any, and keeping the frame aligned as operator new must: */
+
+typedef union {
+        CTFramePool * pPool;
+        std::max_align_t align;
+} Ct_frame_header;
+
+/* Memory for the frames of coroutines that name no scheduler: */
+
+static CTMemory heapMemory;
+
+/*****************************************************************
+ Return the size class for a block of the specified size, or -1
+ if it is too big to pool.
+ ****************************************************************/
+
+static int frame_class(size_t size) {
+    size_t i = (size + CT_FRAME_GRAIN - 1) / CT_FRAME_GRAIN;
+
+    if (0 == i || i > CT_FRAME_CLASSES)
+        return -1;
+    else
+        return (int) i - 1;
+}
+
+CTFramePool::CTFramePool() {
+    int i;
+
+    for (i = 0; i < CT_FRAME_CLASSES; ++i)
+        free_frames[ i ] = NULL;
+}
+
+CTFramePool::~CTFramePool() {
+    ct_release();
+}
+
+/*****************************************************************
+ Allocate a block of at least the specified size; from the free
+ list for its size class if possible, or through CTMemory if
+ necessary.  A pooled block is rounded up to the full size of its
+ class, so that it may be reused by any block of that class.
+ ****************************************************************/
+
+void * CTFramePool::ct_alloc(size_t size) {
+    int i = frame_class(size);
+    void * pBlock;
+
+    if (i >= 0 && free_frames[ i ] != NULL) {
+        pBlock = free_frames[ i ];
+        free_frames[ i ] = free_frames[ i ]->pNext;
+        return pBlock;
+    }
+
+    if (i >= 0)
+        size = (size_t) (i + 1) * CT_FRAME_GRAIN;
+
+    return ctMemory.allocMemory(size);
+}
+
+/*****************************************************************
+ Put a block on the free list for its size class, or give it back
+ if it's too big to pool.
+ ****************************************************************/
+
+void CTFramePool::ct_free(void * pBlock, size_t size) {
+    int i = frame_class(size);
+    Ct_free_frame * pFree;
+
+    if (i < 0)
+        ctMemory.freeMemory(pBlock);
+    else {
+        pFree = (Ct_free_frame *) pBlock;
+        pFree->pNext = free_frames[ i ];
+        free_frames[ i ] = pFree;
+    }
+}
+
+/*****************************************************************
+ Give back all the free blocks.
+ ****************************************************************/
+
+void CTFramePool::ct_release(void) {
+    int i;
+    Ct_free_frame * pTemp;
+
+    for (i = 0; i < CT_FRAME_CLASSES; ++i) {
+        while (free_frames[ i ] != NULL) {
+            pTemp = free_frames[ i ]->pNext;
+            ctMemory.freeMemory(free_frames[ i ]);
+            free_frames[ i ] = pTemp;
+        }
+    }
+}
+
+/*****************************************************************
+ Allocate a coroutine frame; from the pool of the specified
+ scheduler, or if it is NULL, through CTMemory.  Return NULL if
+ out of memory.
+ ****************************************************************/
+
+void * ct_alloc_frame(CTScheduler * pScheduler, size_t size) {
+    CTFramePool * pPool = NULL;
+    Ct_frame_header * pHeader;
+
+    if (pScheduler != NULL) {
+        pPool = pScheduler->ct_frame_pool();
+        pHeader = (Ct_frame_header *) pPool->ct_alloc(sizeof *pHeader + size);
+    }
+    else
+        pHeader = (Ct_frame_header *) heapMemory.allocMemory(
+                sizeof *pHeader + size);
+
+    if (NULL == pHeader) {
+        CTOut::ct_report_error("ct_alloc_frame: out of memory");
+        return NULL;
+    }
+
+    pHeader->pPool = pPool;
+    return pHeader + 1;
+}
+
+/*****************************************************************
+ Deallocate a coroutine frame, giving it back to the pool or the
+ memory it came from.
+ ****************************************************************/
+
+void ct_free_frame(void * pFrame, size_t size) {
+    Ct_frame_header * pHeader;
+
+    if (NULL == pFrame)
+        return;
+
+    pHeader = (Ct_frame_header *) pFrame - 1;
+    if (pHeader->pPool != NULL)
+        pHeader->pPool->ct_free(pHeader, sizeof *pHeader + size);
+    else
+        heapMemory.freeMemory(pHeader);
+}
+
+/*****************************************************************
+ Return the pool for the frames of coroutines naming this
+ scheduler as their first parameter.
+ ****************************************************************/
+
+CTFramePool * CTScheduler::ct_frame_pool(void) {
+    return &frame_pool;
+}
+
+/*****************************************************************
+ Create a cheap thread that runs a coroutine, and add it to the
+ priority queue.  The thread takes over the coroutine's frame,
+ and destroys it when the thread is destructed.  Return a handle
+ if a pointer to one is supplied.
+ ****************************************************************/
+
+int CTScheduler::ct_create_coroutine(Ct_handle * pHandle, int priority,
+        CTCoroutine co) {
+    Ct_handle handle;
+    Ct_thread * pThread;
+    CTCoroutine::Handle h;
+
+    h = co.ct_release();
+    if ( !h)
+        return CT_ERROR; /* the frame could not be allocated */
+
+    if (ct_create_thread( &handle, priority, NULL, NULL, NULL) != CT_OKAY) {
+        h.destroy();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    h.promise().pThread = pThread;
+    pThread->coroutine = h.address();
+
+    if (pHandle != NULL)
+        *pHandle = handle;
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Resume the coroutine of a thread, in place of a step, and act on
+ whatever it suspended for.  Return its code if it finished, or
+ CT_OKAY otherwise.
+
+ Since a coroutine never returns to us by longjmp(), we need no
+ setjmp() for it, even if CT_RETURN is defined.
+ ****************************************************************/
+
+int CTScheduler::resume_coroutine(Ct_thread * pThread) {
+    CTCoroutine::Handle h =
+            CTCoroutine::Handle::from_address(pThread->coroutine);
+    CTCoroutine::promise_type & promise = h.promise();
+
+    /* Go back to sleep if the awaited message hasn't arrived; */
+    /* whatever else has arrived stays queued. */
+
+    if (coroutine_awaiting(pThread)) {
+        pThread->status = CT_STATUS_ASLEEP;
+        return CT_OKAY;
+    }
+
+    h.resume();
+
+    if (h.done()) {
+        pThread->status = CT_STATUS_DEFUNCT;
+        return promise.rc;
+    }
+
+    switch (promise.request) {
+        case CT_CO_WAIT:
+            pThread->status = CT_STATUS_ASLEEP;
+            break;
+
+#if defined CT_TIMEOUT
+        case CT_CO_TIMEOUT:
+            return ct_wait_on_timeout(promise.interval);
+#endif
+
+        case CT_CO_RECEIVE:
+            if (coroutine_awaiting(pThread))
+                pThread->status = CT_STATUS_ASLEEP;
+            break;
+
+        default:
+            break;
+    }
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Return CT_TRUE if a thread is a coroutine awaiting a message of a
+ type not yet in its queue.  If the message has arrived, it is
+ moved to the head of the queue.
+ ****************************************************************/
+
+int CTScheduler::coroutine_awaiting(Ct_thread * pThread) {
+    CTCoroutine::promise_type * pPromise;
+
+    if (NULL == pThread->coroutine)
+        return CT_FALSE;
+
+    pPromise = &CTCoroutine::Handle::from_address(pThread->coroutine)
+            .promise();
+
+    if (CT_CO_RECEIVE == pPromise->request && !pPromise->received())
+        return CT_TRUE;
+    else
+        return CT_FALSE;
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*********************************************************************
+ CTCoroutine -- cheap threads written as C++20 coroutines
+
+ A step function must keep its own place in pData from one step to
+ the next.  A coroutine thread keeps its place in its coroutine
+ frame instead, and the scheduler resumes the frame directly in
+ place of calling a step function.  Each resumption runs until the
+ coroutine suspends at one of these:
+
+     co_await ct_yield();              -- let other threads run
+     co_await ct_sleep();              -- as for ct_wait()
+     co_await ct_sleep_for( ticks );   -- as for ct_wait_on_timeout(),
+                                          if CT_TIMEOUT is defined
+     co_await ct_receive( type );      -- await a message of a type
+     co_return rc;                     -- as for ct_exit(), or a
+                                          non-zero step return code
+
+ While a thread awaits a message of one type, messages of other
+ types stay queued, and don't wake it.  When the awaited message
+ arrives, it is moved to the head of the queue for ct_dequeue_msg(),
+ ahead of any it overtook, and co_await yields its header.
+
+ A coroutine whose first parameter is a reference to the scheduler
+ that will run it, e.g.
+
+     CTCoroutine worker(CTScheduler & sched, int n) { ... }
+
+ gets its frame from that scheduler's free lists, kept by size
+ class like the other pools of the runtime, which go back to the
+ heap only when the scheduler finishes.  Any other coroutine gets
+ its frame straight from the heap, and gives it back when done.
+ Either way the memory comes through CTMemory.
+
+ Requires CT_COROUTINES, and a compiler supporting C++20.
+ ********************************************************************/
+
+#ifndef CTCOROUTINE_H_
+#define CTCOROUTINE_H_
+
+#if defined CT_COROUTINES
+
+#if __cplusplus < 202002L
+#error "CT_COROUTINES requires C++20"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include "ct.h"
+#include "ctpriv.h"
+#include "CTMemory.h"
+
+/* Frames are pooled in size classes of CT_FRAME_GRAIN bytes, */
+/* up to CT_FRAME_CLASSES of them.  Larger frames come from   */
+/* the heap and go straight back to it. */
+
+#ifndef CT_FRAME_GRAIN
+#define CT_FRAME_GRAIN 32
+#endif
+
+#ifndef CT_FRAME_CLASSES
+#define CT_FRAME_CLASSES 16
+#endif
+
+/* A free frame, linked into the list for its size class: */
+
+typedef struct Ct_free_frame {
+        struct Ct_free_frame * pNext;
+} Ct_free_frame;
+
+/* One scheduler's free frames: */
+
+class CTFramePool {
+
+    public:
+
+        CTFramePool();
+        virtual ~CTFramePool();
+
+        /*****************************************************************
+         Allocate a block of at least the specified size; from the free
+         list for its size class if possible, or through CTMemory if
+         necessary.  Return NULL if out of memory.
+         ****************************************************************/
+
+        void * ct_alloc(size_t size);
+
+        /*****************************************************************
+         Put a block allocated by ct_alloc() on the free list for its
+         size class, or give it back if it's too big to pool.
+         ****************************************************************/
+
+        void ct_free(void * pBlock, size_t size);
+
+        /*****************************************************************
+         Give back all the free blocks.
+         ****************************************************************/
+
+        void ct_release(void);
+
+    private:
+
+        CTMemory ctMemory;
+        Ct_free_frame * free_frames [CT_FRAME_CLASSES ];
+};
+
+class CTScheduler;
+
+void * ct_alloc_frame(CTScheduler * pScheduler, size_t size);
+void ct_free_frame(void * pFrame, size_t size);
+
+/* What a suspended coroutine is waiting for: */
+
+typedef enum
+{
+    CT_CO_YIELD,
+    CT_CO_WAIT,
+    CT_CO_TIMEOUT,
+    CT_CO_RECEIVE
+} Ct_co_request;
+
+/* Tags for co_await; see the promise's await_transform(): */
+
+struct Ct_co_yield { };
+struct Ct_co_wait { };
+#if defined CT_TIMEOUT
+struct Ct_co_timeout { unsigned long interval; };
+#endif
+struct Ct_co_receive { Ct_msgtype type; };
+
+inline Ct_co_yield ct_yield(void) { return Ct_co_yield(); }
+inline Ct_co_wait ct_sleep(void) { return Ct_co_wait(); }
+#if defined CT_TIMEOUT
+inline Ct_co_timeout ct_sleep_for(unsigned long interval) {
+    Ct_co_timeout t = { interval };
+    return t;
+}
+#endif
+inline Ct_co_receive ct_receive(Ct_msgtype type) {
+    Ct_co_receive r = { type };
+    return r;
+}
+
+class CTCoroutine {
+
+    public:
+
+        struct promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        struct promise_type {
+                Ct_thread * pThread; /* set when the thread is created */
+                Ct_co_request request;
+                unsigned long interval;
+                Ct_msgtype msgtype;
+                int rc;
+
+                promise_type() :
+                    pThread(NULL), request(CT_CO_YIELD), interval(0),
+                    msgtype(0), rc(CT_OKAY) {
+                }
+
+                /* std::size_t, since ct.h's size_t may not match */
+
+                template <typename... Args>
+                static void * operator new(std::size_t size,
+                        CTScheduler & sched, Args &...) noexcept {
+                    return ct_alloc_frame( &sched, size);
+                }
+
+                static void * operator new(std::size_t size) noexcept {
+                    return ct_alloc_frame(NULL, size);
+                }
+
+                static void operator delete(void * pFrame, std::size_t size) {
+                    ct_free_frame(pFrame, size);
+                }
+
+                CTCoroutine get_return_object() {
+                    return CTCoroutine(Handle::from_promise( *this));
+                }
+
+                /* If operator new returns NULL, the coroutine is */
+                /* empty, and ct_create_coroutine() refuses it.   */
+
+                static CTCoroutine get_return_object_on_allocation_failure() {
+                    return CTCoroutine(Handle());
+                }
+
+                /* Don't start until the scheduler first picks us */
+
+                std::suspend_always initial_suspend() noexcept {
+                    return std::suspend_always();
+                }
+
+                std::suspend_always final_suspend() noexcept {
+                    return std::suspend_always();
+                }
+
+                void return_value(int code) {
+                    rc = code;
+                }
+
+                void unhandled_exception() {
+                    rc = CT_ERROR;
+                }
+
+                /* The awaiter records the request in the promise; */
+                /* the scheduler acts on it after the coroutine    */
+                /* suspends. */
+
+                struct Awaiter {
+                        promise_type * pPromise;
+                        bool ready;
+
+                        bool await_ready() const noexcept {
+                            return ready;
+                        }
+                        void await_suspend(Handle) const noexcept {
+                        }
+                        Ct_msgheader await_resume() const noexcept;
+                };
+
+                Awaiter await_transform(Ct_co_yield) {
+                    request = CT_CO_YIELD;
+                    return Awaiter { this, false };
+                }
+
+                Awaiter await_transform(Ct_co_wait) {
+                    request = CT_CO_WAIT;
+                    return Awaiter { this, false };
+                }
+
+#if defined CT_TIMEOUT
+                Awaiter await_transform(Ct_co_timeout t) {
+                    request = CT_CO_TIMEOUT;
+                    interval = t.interval;
+                    return Awaiter { this, false };
+                }
+#endif
+
+                Awaiter await_transform(Ct_co_receive r) {
+                    request = CT_CO_RECEIVE;
+                    msgtype = r.type;
+
+                    /* Don't suspend if the message is already here */
+
+                    return Awaiter { this, received() != 0 };
+                }
+
+                int received();
+        };
+
+        CTCoroutine(CTCoroutine && other) :
+            handle(other.handle) {
+            other.handle = Handle();
+        }
+
+        ~CTCoroutine() {
+            if (handle)
+                handle.destroy();
+        }
+
+        /* Give up ownership of the frame to a thread: */
+
+        Handle ct_release(void) {
+            Handle h = handle;
+            handle = Handle();
+            return h;
+        }
+
+    private:
+
+        Handle handle;
+
+        explicit CTCoroutine(Handle h) :
+            handle(h) {
+        }
+
+        CTCoroutine(const CTCoroutine &);
+        CTCoroutine & operator=(const CTCoroutine &);
+};
+
+/* Return non-zero if a message of the awaited type has arrived, */
+/* having moved the oldest such message to the head of the queue */
+
+inline int CTCoroutine::promise_type::received() {
+    Ct_msgnode ** ppNode;
+    Ct_msgnode * pNode;
+
+    if (NULL == pThread)
+        return 0;
+
+    for (ppNode = &pThread->msg_q; *ppNode != NULL;
+            ppNode = &( *ppNode)->pNext) {
+        if (( *ppNode)->pE->type == msgtype) {
+            pNode = *ppNode;
+            if (pNode != pThread->msg_q) {
+                *ppNode = pNode->pNext;
+                pNode->pNext = pThread->msg_q;
+                pThread->msg_q = pNode;
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Return the header of the awaited message, if any */
+
+inline Ct_msgheader CTCoroutine::promise_type::Awaiter::await_resume() const
+        noexcept {
+    Ct_msgheader hdr;
+
+    if (CT_CO_RECEIVE == pPromise->request && pPromise->received()) {
+        hdr.type = pPromise->pThread->msg_q->pE->type;
+        hdr.length = pPromise->pThread->msg_q->pE->msg_len;
+    }
+    else {
+        hdr.type = 0;
+        hdr.length = 0;
+    }
+
+    pPromise->request = CT_CO_YIELD;
+    return hdr;
+}
+
+#endif
+
+#endif /*CTCOROUTINE_H_*/
@@ -33,6 +33,9 @@ CTDataStore::CTDataStore() {
 
     free_ct_list = NULL;
     free_ct_count = 0;
+    slabs = NULL;
+    slab_next = NULL;
+    slab_left = 0;
 
     free_msgnode_list= NULL;
     free_msgnode_count = 0;
@@ -40,6 +43,15 @@ CTDataStore::CTDataStore() {
     free_event_list= NULL;
     free_event_count = 0;
 
+#if defined CT_ARENA
+    ctMemory.arenaInit( &msgnode_arena, sizeof(Ct_msgnode));
+    ctMemory.arenaInit( &event_arena, sizeof(Ct_event));
+    msg_data_count = 0;
+#endif
+
+#if defined CT_TRACE
+    trace_ids = 0;
+#endif
 }
 
 CTDataStore::CTDataStore( CTScheduler& ctScheduler,
@@ -122,9 +134,94 @@ Ct_thread * CTDataStore::ct_construct(int priority, void * pData,
         pThread->priority = priority;
         pThread->pData = pData;
         pThread->msg_q = NULL;
+#if defined CT_MAILBOX
+        pThread->msg_capacity = CT_DEFAULT_CAPACITY;
+        pThread->overflow = CT_OVERFLOW_REJECT;
+        pThread->msg_blocked = 0;
+        pThread->blocked_on.p = NULL;
+        pThread->blocked_on.incarnation = 0;
+        pThread->mailbox_stats.count = 0;
+        pThread->mailbox_stats.high_water = 0;
+        pThread->mailbox_stats.dropped = 0;
+        pThread->mailbox_stats.refused = 0;
+#endif
         pThread->subscriptions = NULL;
         pThread->step = step;
         pThread->destruct = destruct;
+#if defined CT_COROUTINES
+        pThread->coroutine = NULL;
+#endif
+#if defined CT_FIBERS
+        pThread->fiber = NULL;
+#endif
+#if defined CT_EPOLL
+        pThread->wait_fd = -1;
+#endif
+#if CT_POLICY != CT_POLICY_MULTILEVEL
+        pThread->weight = CT_DEFAULT_WEIGHT;
+#endif
+#if defined CT_GROUPS
+        pThread->group = 0;
+#endif
+#if defined CT_WORKERS
+        pThread->claim_level = -1;
+#endif
+#if CT_POLICY == CT_POLICY_STRIDE
+        pThread->stride = CT_STRIDE1 / CT_DEFAULT_WEIGHT;
+        pThread->pass = 0;
+#elif CT_POLICY == CT_POLICY_LOTTERY
+        pThread->lottery_slot = 0;
+        pThread->lottery_level = 0;
+#endif
+#if defined CT_WAKEUPS
+        pThread->wake_pending = 0;
+        pThread->wake_priority = CT_PRIORITY_MAX;
+#endif
+#if defined CT_QUANTUM
+        pThread->quantum = 1;
+        pThread->quantum_stats.dispatches = 0;
+        pThread->quantum_stats.steps = 0;
+        pThread->quantum_stats.exhausted = 0;
+#endif
+#if defined CT_WATCHDOG
+        pThread->step_budget = 0;
+        pThread->watchdog_stats.overruns = 0;
+        pThread->watchdog_stats.worst_cycles = 0;
+#endif
+#if defined CT_STATS
+        pThread->stats.steps = 0;
+        pThread->stats.step_cycles = 0;
+        pThread->stats.max_step_cycles = 0;
+        pThread->stats.wait_cycles = 0;
+        pThread->stats.messages = 0;
+        pThread->ready_since = 0;
+#endif
+#if defined CT_TRACE
+
+        /* Number threads as they are constructed, skipping 0 */
+
+        if ( 0 == ++trace_ids)
+            ++trace_ids;
+        pThread->trace_id = trace_ids;
+#endif
+#if defined CT_REPLAY
+        pThread->replay_id = 0;
+#endif
+#if defined CT_TIMEOUT
+#if defined CT_QUANTUM
+        pThread->quantum_ticks = 0;
+#endif
+#if defined CT_PERIODIC
+        pThread->period = 0;
+        pThread->released = 0;
+        pThread->releasing = 0;
+#endif
+#if CT_POLICY == CT_POLICY_EDF
+        pThread->rt_period = 0;
+        pThread->rt_util = 0;
+        pThread->rt_misses = 0;
+#endif
+#endif
 #ifndef NDEBUG
         pThread->magic = CT_MAGIC;
 #endif
@@ -155,6 +252,20 @@ void CTDataStore::ct_destruct(Ct_thread ** ppThread) {
     if (pThread->msg_q != NULL)
         ct_destruct_msgnode_list( &pThread->msg_q);
 
+#if defined CT_COROUTINES
+    if (pThread->coroutine != NULL) {
+        CTCoroutine::Handle::from_address(pThread->coroutine).destroy();
+        pThread->coroutine = NULL;
+    }
+#endif
+
+#if defined CT_FIBERS
+    if (pThread->fiber != NULL) {
+        ct_free_fiber((Ct_fiber *) pThread->fiber);
+        pThread->fiber = NULL;
+    }
+#endif
+
     if (pThread->subscriptions != NULL)
         ct_destruct_sub_list( &pThread->subscriptions);
 
@@ -167,8 +278,8 @@ void CTDataStore::ct_destruct(Ct_thread ** ppThread) {
 }
 
 /*****************************************************************
- Allocate a Ct_thread; from the free list if possible, or from the
- heap if necessary.
+ Allocate a Ct_thread; from the free list if possible, or else from
+ the current slab, allocating a new slab from the heap if necessary.
 
  Either initialize or increment the incarnation member.  This
  sequence number distinguishes among different reuses of the
@@ -183,13 +294,15 @@ Ct_thread * CTDataStore::alloc_ct(void) {
     Ct_thread * pThread;
 
     if ( 0 == free_ct_count) {
-        pThread = (Ct_thread *) ctMemory.allocMemory(sizeof(Ct_thread));
-        if ( NULL == pThread) {
+        if ( 0 == slab_left && new_slab(CT_SLAB_THREADS) != CT_OKAY) {
             CTOut::ct_report_error("alloc_ct: out of memory");
             ctScheduler.ct_fatal_error();
+            return NULL;
         }
-        else
-            pThread->incarnation = 0;
+
+        pThread = slab_next++;
+        --slab_left;
+        pThread->incarnation = 0;
     }
     else {
         --free_ct_count;
@@ -249,17 +362,86 @@ void CTDataStore::free_ct(Ct_thread ** ppThread) {
  ********************************************************************/
 
 void CTDataStore::ct_free_all_threads(void) {
-    Ct_thread * pTemp;
+    Ct_slab * pTemp;
+#ifndef NDEBUG
+    Ct_thread * pThread;
 
-    while (free_ct_list != NULL) {
-        ASSERT( 123456L == free_ct_list->magic );
+    for (pThread = free_ct_list; pThread != NULL; pThread = pThread->pNext)
+        ASSERT( 123456L == pThread->magic );
+#endif
 
-        pTemp = free_ct_list->pNext;
-        ctMemory.freeMemory(free_ct_list);
-        free_ct_list = pTemp;
+    /* Every thread lives in a slab, so we free the slabs */
+    /* wholesale rather than the threads one by one. */
+
+    while (slabs != NULL) {
+        pTemp = slabs->pNext;
+        ctMemory.freeMemory(slabs);
+        slabs = pTemp;
     }
 
+    free_ct_list = NULL;
     free_ct_count = 0;
+    slab_next = NULL;
+    slab_left = 0;
+}
+
+/*********************************************************************
+ Make sure that the next n calls to alloc_ct() will not need to go
+ to the heap, allocating a single slab for whatever the free list
+ and the current slab can't supply.  Return CT_ERROR if out of
+ memory.
+ ********************************************************************/
+
+int CTDataStore::ct_reserve_threads(unsigned n) {
+    Ct_thread * pThread;
+
+    if (n <= (unsigned) free_ct_count + slab_left)
+        return CT_OKAY;
+
+    /* Move the rest of the current slab to the free */
+    /* list, so that it isn't stranded by a new one. */
+
+    while (slab_left > 0) {
+        pThread = slab_next++;
+        --slab_left;
+        pThread->incarnation = 0;
+        pThread->pNext = free_ct_list;
+        free_ct_list = pThread;
+        ++free_ct_count;
+#ifndef NDEBUG
+        pThread->magic = 123456L;
+#endif
+    }
+
+    if (new_slab(n - free_ct_count) != CT_OKAY) {
+        CTOut::ct_report_error("ct_reserve_threads: out of memory");
+        return CT_ERROR;
+    }
+
+    return CT_OKAY;
+}
+
+/*********************************************************************
+ Allocate a slab of n threads and make it the current slab, from
+ which alloc_ct() carves threads when the free list is empty.
+ ********************************************************************/
+
+int CTDataStore::new_slab(unsigned n) {
+    Ct_slab * pSlab;
+
+    ASSERT( n > 0 );
+
+    pSlab = (Ct_slab *) ctMemory.allocMemory(sizeof(Ct_slab)
+            + (n - 1) * sizeof(Ct_thread));
+    if ( NULL == pSlab)
+        return CT_ERROR;
+
+    pSlab->pNext = slabs;
+    slabs = pSlab;
+    slab_next = pSlab->threads;
+    slab_left = n;
+
+    return CT_OKAY;
 }
 
 /* ---------------- msgnode functions: ----------------------------- */
@@ -274,7 +456,11 @@ Ct_msgnode * CTDataStore::ct_alloc_msgnode(void) {
     Ct_msgnode * pM;
 
     if ( NULL == free_msgnode_list) {
+#if defined CT_ARENA
+        pM = (Ct_msgnode *) ctMemory.arenaAlloc( &msgnode_arena);
+#else
         pM = ctMemory.allocMemory(sizeof(Ct_msgnode));
+#endif
         if ( NULL == pM) {
             CTOut::ct_report_error("ct_alloc_msgnode: Out of memory");
             ctScheduler.ct_fatal_error();
@@ -338,6 +524,8 @@ void CTDataStore::ct_destruct_msgnode_list(Ct_msgnode ** ppM) {
     pTail->pNext = free_msgnode_list;
     free_msgnode_list = pM;
 
+#if ! defined CT_ARENA
+
     /* Physically free any excess message nodes, so that */
     /* we don't tie up too much memory with unused nodes */
 
@@ -350,6 +538,7 @@ void CTDataStore::ct_destruct_msgnode_list(Ct_msgnode ** ppM) {
         ctMemory.freeMemory(pM);
         --free_msgnode_count;
     }
+#endif
 }
 
 /*********************************************************************
@@ -359,6 +548,13 @@ void CTDataStore::ct_destruct_msgnode_list(Ct_msgnode ** ppM) {
  ********************************************************************/
 
 void CTDataStore::ct_free_all_msgnodes(void) {
+#if defined CT_ARENA
+
+    /* Free them wholesale, whether destructed or not */
+
+    ctMemory.arenaRelease( &msgnode_arena);
+    free_msgnode_list = NULL;
+#else
     Ct_msgnode * pTemp;
 
     while (free_msgnode_list != NULL) {
@@ -367,6 +563,7 @@ void CTDataStore::ct_free_all_msgnodes(void) {
         ctMemory.freeMemory(free_msgnode_list);
         free_msgnode_list = pTemp;
     }
+#endif
 
     free_msgnode_count = 0;
 }
@@ -383,7 +580,11 @@ Ct_event * CTDataStore::ct_alloc_event(void) {
     Ct_event * pE;
 
     if ( NULL == free_event_list) {
+#if defined CT_ARENA
+        pE = (Ct_event *) ctMemory.arenaAlloc( &event_arena);
+#else
         pE = (Ct_event *) ctMemory.allocMemory(sizeof(Ct_event));
+#endif
         if ( NULL == pE) {
             CTOut::ct_report_error("ct_alloc_event: Out of memory");
             ctScheduler.ct_fatal_error();
@@ -430,6 +631,9 @@ void CTDataStore::ct_destruct_event_list(Ct_event ** ppE) {
         if (pTail->pData != NULL) {
             ctMemory.freeMemory(pTail->pData);
             pTail->pData = NULL;/* not necessary, just good hygiene */
+#if defined CT_ARENA
+            --msg_data_count;
+#endif
         }
         if ( NULL == pTail->pNext)
             break;
@@ -442,6 +646,8 @@ void CTDataStore::ct_destruct_event_list(Ct_event ** ppE) {
     pTail->pNext = free_event_list;
     free_event_list = pE;
 
+#if ! defined CT_ARENA
+
     /* Physically free any excess events, so that we  */
     /* don't tie up too much memory with unused nodes */
 
@@ -453,6 +659,7 @@ void CTDataStore::ct_destruct_event_list(Ct_event ** ppE) {
         ctMemory.freeMemory(pE);
         --free_event_count;
     }
+#endif
 }
 
 /*********************************************************************
@@ -478,6 +685,9 @@ void CTDataStore::ct_destruct_event(Ct_event ** ppE) {
     if (pE->pData != NULL) {
         ctMemory.freeMemory(pE->pData);
         pE->pData = NULL;/* not necessary, just good hygiene */
+#if defined CT_ARENA
+        --msg_data_count;
+#endif
     }
 
     /* Prepend the dead event to the free event list */
@@ -487,6 +697,25 @@ void CTDataStore::ct_destruct_event(Ct_event ** ppE) {
     ++free_event_count;
 }
 
+/*********************************************************************
+ Allocate memory for the data of a long message, to be freed along
+ with its event by ct_destruct_event().
+ *********************************************************************/
+
+void * CTDataStore::ct_alloc_msg_data(size_t len) {
+    void * p;
+
+    p = ctMemory.allocMemory(len);
+    if ( NULL == p)
+        CTOut::ct_report_error("ct_alloc_msg_data: out of memory");
+#if defined CT_ARENA
+    else
+        ++msg_data_count;
+#endif
+
+    return p;
+}
+
 /*********************************************************************
  Free all events that are on the free list.  This routine should be
  called only when all threads and event nodes have been destructed
@@ -494,6 +723,20 @@ void CTDataStore::ct_destruct_event(Ct_event ** ppE) {
  ********************************************************************/
 
 void CTDataStore::ct_free_all_events(void) {
+#if defined CT_ARENA
+
+    /* Free them wholesale, whether destructed or not -- after */
+    /* freeing the data of any long messages still around.  A  */
+    /* destructed event has no data, so it doesn't matter that */
+    /* we look at every event ever allocated. */
+
+    if (msg_data_count > 0)
+        ctMemory.arenaVisit( &event_arena, free_msg_data, &ctMemory);
+    msg_data_count = 0;
+
+    ctMemory.arenaRelease( &event_arena);
+    free_event_list = NULL;
+#else
     Ct_event * pTemp;
 
     while (free_event_list != NULL) {
@@ -502,6 +745,50 @@ void CTDataStore::ct_free_all_events(void) {
         ctMemory.freeMemory(free_event_list);
         free_event_list = pTemp;
     }
+#endif
 
     free_event_count = 0;
-}
\ No newline at end of file
+}
+
+#if defined CT_ARENA
+
+void CTDataStore::free_msg_data(void * pObj, void * pMemory) {
+    Ct_event * pE = (Ct_event *) pObj;
+
+    if (pE->pData != NULL) {
+        ((CTMemory *) pMemory)->freeMemory(pE->pData);
+        pE->pData = NULL;
+    }
+}
+
+/*****************************************************************
+ Call a thread's destructor, and release whatever else it holds
+ outside the arenas, at shutdown.  Its messages and subscriptions
+ are left alone, since the arenas holding them are about to be
+ freed whole; so is the thread, whose slab goes likewise.
+ ****************************************************************/
+
+void CTDataStore::ct_release(Ct_thread * pThread) {
+    ASSERT( CT_MAGIC == pThread->magic );
+
+#if defined CT_COROUTINES
+    if (pThread->coroutine != NULL) {
+        CTCoroutine::Handle::from_address(pThread->coroutine).destroy();
+        pThread->coroutine = NULL;
+    }
+#endif
+
+#if defined CT_FIBERS
+    if (pThread->fiber != NULL) {
+        ct_free_fiber((Ct_fiber *) pThread->fiber);
+        pThread->fiber = NULL;
+    }
+#endif
+
+    if (pThread->destruct != NULL)
+        pThread->destruct(pThread->pData);
+
+    pThread->status = CT_STATUS_DEFUNCT;
+}
+
+#endif
@@ -61,6 +61,15 @@ class CTDataStore {
          ********************************************************************/
         
         void ct_free_all_threads(void);
+
+        /*********************************************************************
+         Make sure that the next n calls to alloc_ct() will not need to go
+         to the heap, allocating a single slab for whatever the free list
+         and the current slab can't supply.  Return CT_ERROR if out of
+         memory.
+         ********************************************************************/
+
+        int ct_reserve_threads(unsigned n);
         
         /*******************************************************************
          Deallocate a list of events by sticking them on the free list.
@@ -94,17 +103,52 @@ class CTDataStore {
          *********************************************************************/
         
         void ct_destruct_event(Ct_event ** ppE);
+
+        /*********************************************************************
+         Allocate memory for the data of a long message, to be freed along
+         with its event by ct_destruct_event().
+         *********************************************************************/
+
+        void * ct_alloc_msg_data(size_t len);
+
+#if defined CT_ARENA
+
+        /*****************************************************************
+         Call a thread's destructor, and release whatever else it holds
+         outside the arenas, at shutdown.  Its messages and subscriptions
+         are left alone, since the arenas holding them are about to be
+         freed whole; so is the thread, whose slab goes likewise.
+         ****************************************************************/
+
+        void ct_release(Ct_thread * pThread);
+#endif
     
     private:  
 
         Ct_thread *free_ct_list;
         int free_ct_count;
 
+        Ct_slab *slabs; /* every slab allocated, newest first */
+        Ct_thread *slab_next; /* next unused thread in the newest slab */
+        unsigned slab_left; /* unused threads left there */
+
+#if defined CT_TRACE
+        unsigned short trace_ids; /* last trace_id assigned */
+#endif
+
         Ct_msgnode *free_msgnode_list;
         int free_msgnode_count;
 
         Ct_event *free_event_list;
         int free_event_count;
+
+#if defined CT_ARENA
+        Ct_arena msgnode_arena;
+        Ct_arena event_arena;
+        unsigned long msg_data_count; /* long messages with data allocated */
+
+        static void free_msg_data(void * pObj, void * pMemory);
+#endif
         
         /*****************************************************************
          Return CT_TRUE if two handles refer to the same incarnation of
@@ -129,8 +173,8 @@ class CTDataStore {
         void ct_destruct(Ct_thread ** ppThread);
         
         /*****************************************************************
-         Allocate a Ct_thread; from the free list if possible, or from the
-         heap if necessary.
+         Allocate a Ct_thread; from the free list if possible, or else from
+         the current slab, allocating a new slab from the heap if necessary.
 
          Either initialize or increment the incarnation member.  This
          sequence number distinguishes among different reuses of the
@@ -159,6 +203,13 @@ class CTDataStore {
         
          void free_ct(Ct_thread ** ppThread);
 
+        /*********************************************************************
+         Allocate a slab of n threads and make it the current slab, from
+         which alloc_ct() carves threads when the free list is empty.
+         ********************************************************************/
+
+        int new_slab(unsigned n);
+
          
         /* ---------------- msgnode functions: ----------------------------- */
 
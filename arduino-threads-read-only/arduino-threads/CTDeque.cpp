@@ -0,0 +1,133 @@
+/*****************************************************************
+ CTDeque -- a bounded work-stealing deque of cheap threads, one per
+ worker under CT_WORKERS.
+ ****************************************************************/
+
+#include <stddef.h>
+#include "CTDeque.h"
+#include "CTAssert.h"
+
+#if defined CT_WORKERS
+
+CTDeque::CTDeque() {
+    int i;
+
+    for (i = 0; i < CT_DEQUE_SLOTS; ++i)
+        slots[ i ] = NULL;
+
+    top = 0;
+    bottom = 0;
+}
+
+CTDeque::~CTDeque() {
+}
+
+/*****************************************************************
+ Push a thread at the bottom.  Only the owner may call this
+ function.  Return CT_ERROR if the deque is full, CT_OKAY
+ otherwise.
+ ****************************************************************/
+
+int CTDeque::ct_push(Ct_thread * pThread) {
+    long b;
+    long t;
+
+    ASSERT( pThread != NULL );
+
+    b = __atomic_load_n( &bottom, __ATOMIC_RELAXED);
+    t = __atomic_load_n( &top, __ATOMIC_ACQUIRE);
+    if (b - t >= CT_DEQUE_SLOTS)
+        return CT_ERROR;
+
+    /* Fill the slot before a thief can see it */
+
+    __atomic_store_n( &slots[ b & (CT_DEQUE_SLOTS - 1) ], pThread,
+            __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n( &bottom, b + 1, __ATOMIC_RELAXED);
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Pop the thread most recently pushed, or return NULL if the
+ deque is empty.  Only the owner may call this function.
+ ****************************************************************/
+
+Ct_thread * CTDeque::ct_pop(void) {
+    long b;
+    long t;
+    Ct_thread * pThread;
+
+    /* Reserve the bottom entry, then see whether a thief */
+    /* got there first. */
+
+    b = __atomic_load_n( &bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n( &bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n( &top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        /* Empty */
+
+        __atomic_store_n( &bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    pThread = __atomic_load_n( &slots[ b & (CT_DEQUE_SLOTS - 1) ],
+            __ATOMIC_RELAXED);
+
+    if (t == b) {
+        /* The last entry: race the thieves for it */
+
+        if ( !__atomic_compare_exchange_n( &top, &t, t + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            pThread = NULL;
+        __atomic_store_n( &bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return pThread;
+}
+
+/*****************************************************************
+ Take the thread least recently pushed.  Any OS thread may call
+ this function.  Return NULL if the deque is empty, or if another
+ worker took that thread first.
+ ****************************************************************/
+
+Ct_thread * CTDeque::ct_steal(void) {
+    long b;
+    long t;
+    Ct_thread * pThread;
+
+    t = __atomic_load_n( &top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n( &bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b)
+        return NULL;
+
+    pThread = __atomic_load_n( &slots[ t & (CT_DEQUE_SLOTS - 1) ],
+            __ATOMIC_RELAXED);
+    if ( !__atomic_compare_exchange_n( &top, &t, t + 1, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL; /* lost the race */
+
+    return pThread;
+}
+
+/*****************************************************************
+ Return CT_TRUE if the deque is empty.  Only the owner may call
+ this function, and a thief may empty the deque at any moment.
+ ****************************************************************/
+
+int CTDeque::ct_empty(void) {
+    long b;
+    long t;
+
+    b = __atomic_load_n( &bottom, __ATOMIC_RELAXED);
+    t = __atomic_load_n( &top, __ATOMIC_ACQUIRE);
+    return b <= t ? CT_TRUE : CT_FALSE;
+}
+
+#endif
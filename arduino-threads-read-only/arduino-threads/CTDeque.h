@@ -0,0 +1,82 @@
+/*****************************************************************
+ CTDeque -- a bounded work-stealing deque of cheap threads, one per
+ worker under CT_WORKERS.
+
+ The worker that owns the deque pushes and pops threads at one
+ end, the bottom, without locking.  Other workers steal from the
+ other end, the top, competing with one another and with the owner
+ for the last entry through a compare-and-swap on the top index.
+
+ The algorithm is that of Chase and Lev, with the memory orderings
+ given by Le, Pop, Cohen and Zappa Nardelli.  Since a worker only
+ refills its deque when it is empty, and then with at most
+ CT_WORKER_BATCH threads, the deque need not grow: a push that
+ finds it full simply fails.
+
+ Compiled only if CT_WORKERS is defined.
+ ****************************************************************/
+
+#ifndef CTDEQUE_H_
+#define CTDEQUE_H_
+
+#include "ct.h"
+#include "ctpriv.h"
+
+#if defined CT_WORKERS
+
+#if ( CT_DEQUE_SLOTS & ( CT_DEQUE_SLOTS - 1 ) ) != 0
+#error "CT_DEQUE_SLOTS must be a power of two"
+#endif
+
+#if CT_DEQUE_SLOTS < CT_WORKER_BATCH
+#error "CT_DEQUE_SLOTS must be at least CT_WORKER_BATCH"
+#endif
+
+class CTDeque {
+
+    public:
+
+        CTDeque();
+        virtual ~CTDeque();
+
+        /*****************************************************************
+         Push a thread at the bottom.  Only the owner may call this
+         function.  Return CT_ERROR if the deque is full, CT_OKAY
+         otherwise.
+         ****************************************************************/
+
+        int ct_push(Ct_thread * pThread);
+
+        /*****************************************************************
+         Pop the thread most recently pushed, or return NULL if the
+         deque is empty.  Only the owner may call this function.
+         ****************************************************************/
+
+        Ct_thread * ct_pop(void);
+
+        /*****************************************************************
+         Take the thread least recently pushed.  Any OS thread may
+         call this function.  Return NULL if the deque is empty, or
+         if another worker took that thread first.
+         ****************************************************************/
+
+        Ct_thread * ct_steal(void);
+
+        /*****************************************************************
+         Return CT_TRUE if the deque is empty.  Only the owner may call
+         this function, and a thief may empty the deque at any moment.
+         ****************************************************************/
+
+        int ct_empty(void);
+
+    private:
+
+        Ct_thread * slots [CT_DEQUE_SLOTS ];
+
+        long top; /* next to steal; advanced by thieves and owner */
+        long bottom; /* next free slot; moved only by the owner */
+};
+
+#endif
+
+#endif /*CTDEQUE_H_*/
@@ -0,0 +1,330 @@
+/*****************************************************************
+ CTEpoll -- the parts of CTScheduler that let a thread sleep until
+ a file descriptor is ready, instead of polling it step by step.
+
+ ct_wait_on_fd() registers the descriptor, one-shot, with an epoll
+ instance belonging to the scheduler, and puts the thread to sleep
+ as ct_wait() does.  The scheduler checks for ready descriptors
+ now and then while other threads run, and blocks in epoll_wait()
+ when none do -- until the next timeout, if any are pending.  A
+ ready descriptor wakes its thread with a CT_FD_MSGTYPE message.
+
+ Any other message wakes the thread too, without cancelling the
+ wait; the readiness message then arrives whenever the descriptor
+ is ready.  Call ct_cancel_fd_wait() before closing a descriptor
+ that a thread may be waiting on.
+
+ A thread waits on one descriptor at a time: waiting on another
+ cancels the first wait, as does the thread's finishing.
+
+ Readiness comes from outside the program, so CT_REPLAY does not
+ record it.
+
+ With CT_AIO, the epoll instance also watches the eventfd that
+ CTAio signals on completion, so that a scheduler blocked on
+ descriptors wakes for finished I/O as well.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_EPOLL
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/* Ready descriptors taken from the kernel per epoll_wait(): */
+
+#define CT_EPOLL_EVENTS 16
+
+/*****************************************************************
+ Called by a thread: register a file descriptor for the specified
+ epoll events (EPOLLIN, EPOLLOUT, etc.), and go to sleep until it
+ is ready.  Only one thread at a time may wait on a descriptor;
+ a second call for the same descriptor replaces the first.  Any
+ wait of this thread on another descriptor is cancelled.
+ ****************************************************************/
+
+int CTScheduler::ct_wait_on_fd(int fd, unsigned events) {
+    struct epoll_event ev;
+    Ct_fd_wait * pW;
+    int op;
+
+    if (NULL == pCurr_thread) {
+        CTOut::ct_report_error("ct_wait_on_fd: no thread is active");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    ASSERT( CT_MAGIC == pCurr_thread->magic );
+
+    if (fd < 0) {
+        CTOut::ct_report_error("ct_wait_on_fd: invalid file descriptor");
+        return CT_ERROR;
+    }
+
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            CTOut::ct_report_error("ct_wait_on_fd: unable to create epoll instance");
+            return CT_ERROR;
+        }
+    }
+
+    /* Grow the table of waits to cover this descriptor */
+
+    if (fd >= fd_waits_max) {
+        int new_max = fd_waits_max ? fd_waits_max : 16;
+        Ct_fd_wait * p;
+
+        while (new_max <= fd)
+            new_max *= 2;
+
+        p = (Ct_fd_wait *) realloc(fd_waits, new_max * sizeof(Ct_fd_wait));
+        if (NULL == p) {
+            CTOut::ct_report_error("ct_wait_on_fd: out of memory");
+            return CT_ERROR;
+        }
+
+        memset(p + fd_waits_max, 0,
+                (new_max - fd_waits_max) * sizeof(Ct_fd_wait));
+        fd_waits = p;
+        fd_waits_max = new_max;
+    }
+
+    if (pCurr_thread->wait_fd >= 0 && pCurr_thread->wait_fd != fd)
+        drop_fd_wait(pCurr_thread);
+
+    pW = fd_waits + fd;
+
+    /* A one-shot registration stays in the epoll instance, */
+    /* disabled, after it fires; so we need only re-arm it. */
+
+    memset( &ev, 0, sizeof( ev ));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.fd = fd;
+
+    op = pW->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd, op, fd, &ev) != 0) {
+
+        /* Perhaps the descriptor was closed and reused */
+
+        if (EPOLL_CTL_MOD == op && ENOENT == errno)
+            op = EPOLL_CTL_ADD;
+        else
+            if (EPOLL_CTL_ADD == op && EEXIST == errno)
+                op = EPOLL_CTL_MOD;
+            else
+                op = -1;
+
+        if (op < 0 || epoll_ctl(epoll_fd, op, fd, &ev) != 0) {
+            CTOut::ct_report_error("ct_wait_on_fd: unable to register file descriptor");
+            return CT_ERROR;
+        }
+    }
+
+    pW->registered = 1;
+    if ( !pW->armed) {
+        pW->armed = 1;
+        ++fd_wait_count;
+    }
+
+    pW->thread.p = pCurr_thread;
+    pW->thread.incarnation = pCurr_thread->incarnation;
+#if defined CT_THREADSAFE
+    pW->thread.partition = partition_id;
+#endif
+    pCurr_thread->wait_fd = fd;
+
+    pCurr_thread->status = CT_STATUS_ASLEEP;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Forget any wait on the specified file descriptor, and remove it
+ from the epoll instance.  The waiting thread, if any, stays
+ asleep until something else wakes it.
+ ****************************************************************/
+
+int CTScheduler::ct_cancel_fd_wait(int fd) {
+    Ct_fd_wait * pW;
+
+    if (fd < 0 || fd >= fd_waits_max) {
+        CTOut::ct_report_error("ct_cancel_fd_wait: invalid file descriptor");
+        return CT_ERROR;
+    }
+
+    pW = fd_waits + fd;
+    if (pW->armed && ctDataStore.ct_valid_handle( &pW->thread))
+        ((Ct_thread *) pW->thread.p)->wait_fd = -1;
+
+    if (pW->registered) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        pW->registered = 0;
+    }
+
+    if (pW->armed) {
+        pW->armed = 0;
+        --fd_wait_count;
+    }
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Wait up to the specified number of milliseconds (-1 for ever, 0
+ not at all) for descriptors to become ready, and send each
+ waiting thread a message saying which and how.  With CT_AIO, stop
+ waiting if some I/O completes.
+ ****************************************************************/
+
+void CTScheduler::poll_fds(int timeout_ms) {
+    struct epoll_event ready[ CT_EPOLL_EVENTS ];
+    Ct_fd_ready data;
+    Ct_fd_wait * pW;
+    Ct_thread * pThread;
+    Ct_event * pE;
+    int n;
+    int i;
+
+    ASSERT( epoll_fd >= 0 );
+
+#if defined CT_AIO
+    if (timeout_ms != 0 && aio.ct_outstanding() > 0
+            && watch_aio() != CT_OKAY)
+        timeout_ms = 0; /* poll rather than miss the I/O */
+#endif
+
+    n = epoll_wait(epoll_fd, ready, CT_EPOLL_EVENTS, timeout_ms);
+
+    for (i = 0; i < n; ++i) {
+#if defined CT_AIO
+        if (ready[ i ].data.fd == aio_watch_fd) {
+            /* The scheduler's loop reaps the I/O */
+
+            aio.ct_clear_done();
+            continue;
+        }
+#endif
+        data.fd = ready[ i ].data.fd;
+        data.events = ready[ i ].events;
+
+        ASSERT( data.fd >= 0 && data.fd < fd_waits_max );
+        pW = fd_waits + data.fd;
+        if ( !pW->armed)
+            continue;
+
+        pW->armed = 0;
+        --fd_wait_count;
+
+        /* The thread may have finished in the meantime */
+
+        if ( !ctDataStore.ct_valid_handle( &pW->thread))
+            continue;
+
+        pThread = (Ct_thread *) pW->thread.p;
+        pThread->wait_fd = -1;
+
+        pE = ctDataStore.ct_alloc_event();
+        if (NULL == pE) {
+            ct_fatal_error();
+            return;
+        }
+
+        pE->pNext = NULL;
+        pE->type = CT_FD_MSGTYPE;
+        pE->ev_type = CT_EV_MSG;
+        pE->priority = 0;
+#if defined CT_MAILBOX
+        pE->reserved = 0;
+#endif
+        pE->msg_len = sizeof( data );
+        pE->refcount = 0;
+        pE->pData = NULL;
+        memcpy(pE->buff, &data, sizeof( data ));
+        pE->dispatch_type = CT_DISPATCH_ADDRESSEE;
+        pE->addressee = pW->thread;
+#ifndef NDEBUG
+        pE->magic = EVENT_MAGIC;
+#endif
+
+        if (ct_deliver_event(pE, pThread) != CT_OKAY) {
+            ct_fatal_error();
+            if ( 0 == pE->refcount)
+                ctDataStore.ct_destruct_event( &pE);
+            return;
+        }
+    }
+}
+
+/*****************************************************************
+ Cancel the wait of a thread on the descriptor it last waited on,
+ if that wait is still armed and still the thread's own -- another
+ thread may have taken over the descriptor since.  Called when the
+ thread finishes, or waits on another descriptor.
+ ****************************************************************/
+
+void CTScheduler::drop_fd_wait(Ct_thread * pThread) {
+    Ct_fd_wait * pW;
+    int fd = pThread->wait_fd;
+
+    pThread->wait_fd = -1;
+    if (fd < 0 || fd >= fd_waits_max)
+        return;
+
+    pW = fd_waits + fd;
+    if (pW->armed && pW->thread.p == pThread
+            && pW->thread.incarnation == pThread->incarnation)
+        ct_cancel_fd_wait(fd);
+}
+
+#if defined CT_AIO
+
+/*****************************************************************
+ Have the epoll instance watch the eventfd of CTAio, if it isn't
+ already.  Return CT_ERROR if it can't.
+ ****************************************************************/
+
+int CTScheduler::watch_aio(void) {
+    struct epoll_event ev;
+    int fd = aio.ct_done_fd();
+
+    if (fd < 0)
+        return CT_ERROR;
+    if (fd == aio_watch_fd)
+        return CT_OKAY;
+
+    memset( &ev, 0, sizeof( ev ));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        return CT_ERROR;
+
+    aio_watch_fd = fd;
+    return CT_OKAY;
+}
+#endif
+
+/*****************************************************************
+ Close the epoll instance and forget all waits.
+ ****************************************************************/
+
+void CTScheduler::close_epoll(void) {
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+
+    free(fd_waits);
+    fd_waits = NULL;
+    fd_waits_max = 0;
+    fd_wait_count = 0;
+    epoll_countdown = CT_EPOLL_LOOPS;
+#if defined CT_AIO
+    aio_watch_fd = -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,377 @@
+/*****************************************************************
+ CTFiber -- stacks and context switching for fiber threads, and
+ the parts of CTScheduler that create and resume them.
+
+ Each stack is a single block: a Ct_fiber at the low end, whose
+ last member is the canary, and the stack proper above it,
+ growing down towards the canary.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_FIBERS
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CT_FIBER_CANARY 0xC7A5C7A5UL
+
+#define CT_FIBER_BLOCK ( sizeof( Ct_fiber ) + CT_FIBER_STACK )
+
+extern "C" void ct_fiber_start(void);
+extern "C" __attribute__((visibility("hidden"), used))
+void ct_fiber_main(Ct_fiber * pFiber);
+
+/*****************************************************************
+ ct_switch_context(pSave_sp, load_sp) saves the callee-saved
+ registers, and on x86-64 the floating-point control settings, on
+ the current stack, stores the stack pointer through
+ pSave_sp, switches to the stack at load_sp, and restores the
+ registers saved there.  It returns on the new stack.
+
+ A new fiber's stack is made to look as though ct_switch_context()
+ had saved it, with ct_fiber_start() as the return address and
+ the fiber's address in a saved register.  ct_fiber_start() hands
+ that register to ct_fiber_main().
+ ****************************************************************/
+
+#if defined __x86_64__
+
+/* The callee-saved registers are rbx, rbp, and r12 through r15;  */
+/* the control bits of MXCSR and the x87 control word are also    */
+/* preserved across calls, so they share an 8-byte slot below the */
+/* registers: MXCSR at the bottom, the control word above it.     */
+/* The fiber's address goes in r12. */
+
+asm(
+    "    .text\n"
+    "    .globl ct_switch_context\n"
+    "    .type ct_switch_context, @function\n"
+    "ct_switch_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    "    .size ct_switch_context, .-ct_switch_context\n"
+    "    .globl ct_fiber_start\n"
+    "    .hidden ct_fiber_start\n"
+    "    .type ct_fiber_start, @function\n"
+    "ct_fiber_start:\n"
+    "    movq %r12, %rdi\n"
+    "    call ct_fiber_main\n"
+    "    ud2\n"
+    "    .size ct_fiber_start, .-ct_fiber_start\n"
+);
+
+#elif defined __AVR__
+
+/* The callee-saved registers are r2 through r17, r28 and r29.   */
+/* The fiber's address goes in r17:r16.  We disable interrupts  */
+/* only between writing the two halves of the stack pointer.    */
+
+#if defined __AVR_HAVE_JMP_CALL__
+#define CT_AVR_JMP "jmp"
+#else
+#define CT_AVR_JMP "rjmp"
+#endif
+
+asm(
+    "    .text\n"
+    "    .global ct_switch_context\n"
+    "    .type ct_switch_context, @function\n"
+    "ct_switch_context:\n"
+    "    push r2\n"
+    "    push r3\n"
+    "    push r4\n"
+    "    push r5\n"
+    "    push r6\n"
+    "    push r7\n"
+    "    push r8\n"
+    "    push r9\n"
+    "    push r10\n"
+    "    push r11\n"
+    "    push r12\n"
+    "    push r13\n"
+    "    push r14\n"
+    "    push r15\n"
+    "    push r16\n"
+    "    push r17\n"
+    "    push r28\n"
+    "    push r29\n"
+    "    in r18, __SP_L__\n"
+    "    in r19, __SP_H__\n"
+    "    movw r30, r24\n"
+    "    st Z, r18\n"
+    "    std Z+1, r19\n"
+    "    in r0, __SREG__\n"
+    "    cli\n"
+    "    out __SP_H__, r23\n"
+    "    out __SREG__, r0\n"
+    "    out __SP_L__, r22\n"
+    "    pop r29\n"
+    "    pop r28\n"
+    "    pop r17\n"
+    "    pop r16\n"
+    "    pop r15\n"
+    "    pop r14\n"
+    "    pop r13\n"
+    "    pop r12\n"
+    "    pop r11\n"
+    "    pop r10\n"
+    "    pop r9\n"
+    "    pop r8\n"
+    "    pop r7\n"
+    "    pop r6\n"
+    "    pop r5\n"
+    "    pop r4\n"
+    "    pop r3\n"
+    "    pop r2\n"
+    "    ret\n"
+    "    .size ct_switch_context, .-ct_switch_context\n"
+    "    .global ct_fiber_start\n"
+    "    .type ct_fiber_start, @function\n"
+    "ct_fiber_start:\n"
+    "    clr r1\n"
+    "    movw r24, r16\n"
+    "    " CT_AVR_JMP " ct_fiber_main\n"
+    "    .size ct_fiber_start, .-ct_fiber_start\n"
+);
+
+#endif
+
+/*****************************************************************
+ Run the body of a fiber; then switch back to the scheduler for
+ the last time.
+ ****************************************************************/
+
+void ct_fiber_main(Ct_fiber * pFiber) {
+    pFiber->rc = pFiber->body(pFiber->pData);
+    pFiber->done = 1;
+    ct_switch_context( &pFiber->sp, *pFiber->ppReturn_sp);
+}
+
+/*****************************************************************
+ Lay out a new fiber's stack as ct_switch_context() would have
+ left it.
+ ****************************************************************/
+
+static void init_stack(Ct_fiber * pFiber) {
+#if defined __x86_64__
+    uintptr_t top = ((uintptr_t) pFiber + CT_FIBER_BLOCK) & ~(uintptr_t) 15;
+    void ** sp = (void **) top;
+    unsigned int mxcsr;
+    unsigned short fpucw;
+
+    /* The fiber starts with our floating-point control settings */
+
+    asm volatile("stmxcsr %0" : "=m" (mxcsr));
+    asm volatile("fnstcw %0" : "=m" (fpucw));
+
+    /* Return to ct_fiber_start() with the stack 16-byte aligned */
+
+    *--sp = (void *) ct_fiber_start;
+    *--sp = NULL; /* rbp */
+    *--sp = NULL; /* rbx */
+    *--sp = pFiber; /* r12 */
+    *--sp = NULL; /* r13 */
+    *--sp = NULL; /* r14 */
+    *--sp = NULL; /* r15 */
+    *--sp = (void *) ((uintptr_t) mxcsr | (uintptr_t) fpucw << 32);
+    pFiber->sp = sp;
+#elif defined __AVR__
+    unsigned char * p = (unsigned char *) pFiber + CT_FIBER_BLOCK - 1;
+    uint16_t pc = (uint16_t) ct_fiber_start; /* a word address */
+    uint16_t fiber = (uint16_t) pFiber;
+    int reg;
+
+    /* The stack pointer addresses the next free byte; */
+    /* a return address is stored high byte first.     */
+
+    *p-- = pc & 0xFF;
+    *p-- = pc >> 8;
+#if defined __AVR_3_BYTE_PC__
+    *p-- = 0;
+#endif
+
+    for (reg = 2; reg <= 17; ++reg) {
+        if (16 == reg)
+            *p-- = fiber & 0xFF;
+        else
+            if (17 == reg)
+                *p-- = fiber >> 8;
+            else
+                *p-- = 0;
+    }
+
+    *p-- = 0; /* r28 */
+    *p-- = 0; /* r29 */
+    pFiber->sp = p;
+#endif
+}
+
+/*****************************************************************
+ Allocate a fiber and its stack, from the specified free list if
+ possible, or from the heap if necessary, and make it ready to run
+ the specified function from the beginning.  The fiber goes back
+ to the same free list when freed.
+ ****************************************************************/
+
+Ct_fiber * ct_alloc_fiber(Ct_fiber ** ppFree_list, Ct_fiber_function body,
+        void * pData, void ** ppReturn_sp) {
+    Ct_fiber * pFiber;
+
+    if ( *ppFree_list != NULL) {
+        pFiber = *ppFree_list;
+        *ppFree_list = pFiber->pNext;
+    }
+    else {
+        pFiber = (Ct_fiber *) malloc(CT_FIBER_BLOCK);
+        if (NULL == pFiber) {
+            CTOut::ct_report_error("ct_alloc_fiber: out of memory");
+            return NULL;
+        }
+    }
+
+    pFiber->ppReturn_sp = ppReturn_sp;
+    pFiber->body = body;
+    pFiber->pData = pData;
+    pFiber->rc = CT_OKAY;
+    pFiber->done = 0;
+    pFiber->pNext = NULL;
+    pFiber->ppFree_list = ppFree_list;
+    pFiber->canary = CT_FIBER_CANARY;
+    init_stack(pFiber);
+
+    return pFiber;
+}
+
+/*****************************************************************
+ Put a fiber and its stack on the free list it came from.
+ ****************************************************************/
+
+void ct_free_fiber(Ct_fiber * pFiber) {
+    if (NULL == pFiber)
+        return;
+
+    pFiber->pNext = *pFiber->ppFree_list;
+    *pFiber->ppFree_list = pFiber;
+}
+
+/*****************************************************************
+ Return all the stacks on a free list to the heap.  Call only when
+ no fiber from that list exists.
+ ****************************************************************/
+
+void ct_free_all_stacks(Ct_fiber ** ppFree_list) {
+    Ct_fiber * pTemp;
+
+    while ( *ppFree_list != NULL) {
+        pTemp = ( *ppFree_list)->pNext;
+        free( *ppFree_list);
+        *ppFree_list = pTemp;
+    }
+}
+
+/*****************************************************************
+ Return CT_TRUE if a fiber's canary is intact, i.e. its stack
+ has apparently not overflowed.
+ ****************************************************************/
+
+int ct_fiber_intact(const Ct_fiber * pFiber) {
+    return CT_FIBER_CANARY == pFiber->canary ? CT_TRUE : CT_FALSE;
+}
+
+/*****************************************************************
+ Create a cheap thread that runs the specified function on a stack
+ of its own, and add it to the priority queue.  The pData and
+ destruct parameters serve as for ct_create_thread().  Return a
+ handle if a pointer to one is supplied.
+ ****************************************************************/
+
+int CTScheduler::ct_create_fiber(Ct_handle * pHandle, int priority,
+        Ct_fiber_function body, void * pData, Ct_destructor destruct) {
+    Ct_handle handle;
+    Ct_thread * pThread;
+    Ct_fiber * pFiber;
+
+    pFiber = ct_alloc_fiber( &free_fibers, body, pData, &fiber_return_sp);
+    if (NULL == pFiber)
+        return CT_ERROR;
+
+    if (ct_create_thread( &handle, priority, pData, NULL, destruct)
+            != CT_OKAY) {
+        ct_free_fiber(pFiber);
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+    pThread->fiber = pFiber;
+
+    if (pHandle != NULL)
+        *pHandle = handle;
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Switch to a fiber thread, in place of a step, until it yields or
+ finishes.  Return its return code if it finished, or CT_OKAY
+ otherwise.
+ ****************************************************************/
+
+int CTScheduler::resume_fiber(Ct_thread * pThread) {
+    Ct_fiber * pFiber = (Ct_fiber *) pThread->fiber;
+
+    ct_switch_context( &fiber_return_sp, pFiber->sp);
+
+    if ( !ct_fiber_intact(pFiber)) {
+        CTOut::ct_report_error("resume_fiber: fiber stack overflow");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    if (pFiber->done) {
+        pThread->status = CT_STATUS_DEFUNCT;
+        return pFiber->rc;
+    }
+
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Called by a fiber thread: give up the processor until the
+ scheduler next picks this thread.
+ ****************************************************************/
+
+void CTScheduler::ct_fiber_yield(void) {
+    Ct_fiber * pFiber;
+
+    if (NULL == pCurr_thread || NULL == pCurr_thread->fiber) {
+        CTOut::ct_report_error("ct_fiber_yield: current thread is not a fiber");
+        ct_fatal_error();
+        return;
+    }
+
+    pFiber = (Ct_fiber *) pCurr_thread->fiber;
+    ct_switch_context( &pFiber->sp, fiber_return_sp);
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*********************************************************************
+ CTFiber -- cheap threads with stacks of their own
+
+ A fiber thread runs an ordinary function on a private stack, and
+ may give up the processor from any depth of nested calls by
+ calling ct_fiber_yield().  Before yielding it may call ct_wait(),
+ ct_wait_on_timeout(), etc., just as a step function would before
+ returning.  When the function returns, the thread is finished,
+ as if by ct_exit(); a non-zero return code counts as an error,
+ as from a step function.
+
+ Don't call ct_return() from a fiber.  If a fiber is destructed
+ before its function returns, its stack is simply reclaimed;
+ nothing on it is unwound.
+
+ Every stack has CT_FIBER_STACK bytes, and comes from the free list
+ of the scheduler that created the fiber, going back to the heap
+ only when that scheduler finishes.
+ A canary at the far end of each stack is checked every time the
+ fiber yields, so that an overflow is reported as a fatal error
+ (if it hasn't crashed anything first).
+
+ The context switch is written in assembly language, for x86-64
+ (System V ABI) and for AVR.  On x86-64 each fiber keeps its own
+ floating-point control settings (MXCSR and the x87 control word),
+ starting with those of the OS thread that created it.  Requires
+ CT_FIBERS.
+ ********************************************************************/
+
+#ifndef CTFIBER_H_
+#define CTFIBER_H_
+
+#if defined CT_FIBERS
+
+#include "ct.h"
+
+#if ! defined __x86_64__ && ! defined __AVR__
+#error "CT_FIBERS supports only x86-64 and AVR"
+#endif
+
+/* Size of each fiber's stack, in bytes: */
+
+#ifndef CT_FIBER_STACK
+#if defined __AVR__
+#define CT_FIBER_STACK 256
+#else
+#define CT_FIBER_STACK 16384
+#endif
+#endif
+
+typedef struct Ct_fiber {
+        void * sp; /* saved stack pointer while switched out */
+        void ** ppReturn_sp; /* where the scheduler saved its own */
+        Ct_fiber_function body;
+        void * pData;
+        int rc; /* return code of body, once done */
+        int done; /* boolean: body has returned */
+        struct Ct_fiber * pNext; /* in the free list */
+        struct Ct_fiber ** ppFree_list; /* where it goes when done */
+        unsigned long canary;
+} Ct_fiber;
+
+Ct_fiber * ct_alloc_fiber(Ct_fiber ** ppFree_list, Ct_fiber_function body,
+        void * pData, void ** ppReturn_sp);
+void ct_free_fiber(Ct_fiber * pFiber);
+void ct_free_all_stacks(Ct_fiber ** ppFree_list);
+int ct_fiber_intact(const Ct_fiber * pFiber);
+
+extern "C" void ct_switch_context(void ** pSave_sp, void * load_sp);
+
+#endif
+
+#endif /*CTFIBER_H_*/
@@ -0,0 +1,326 @@
+/*****************************************************************
+ CTGroup -- the parts of CTScheduler that share the CPU among
+ groups of threads.
+
+ Each group has a virtual time, its pass, which advances as its
+ threads run: by CT_GROUP_SCALE / weight per cycle.  Rather than
+ give each group a priority queue of its own, we leave all threads
+ on the one queue and hold back the threads of any group that has
+ got ahead.  When pick_thread() picks a thread whose group's pass
+ is more than a window's worth beyond group_base_pass, or whose
+ group has used up its cap for the window, the thread goes aside
+ onto its group's parked list and the pick is repeated.
+
+ When every runnable thread is parked, the group furthest behind
+ sets a new group_base_pass, and every group within reach of it
+ gets its threads back.  A capped group gets them back when the
+ window ends; until then, if nothing else is runnable, the loop of
+ ct_schedule() waits, napping in the idle function if there is one
+ (wait_window()).  Hence the groups take turns in proportion to
+ their weights, while within a group the threads run by the
+ scheduling policy as usual.
+
+ Compiled only if CT_GROUPS is defined.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_GROUPS
+
+/*****************************************************************
+ Create a group with the specified weight and cap (a percentage,
+ or 0 for none), and return its number through pGroup.
+ ****************************************************************/
+
+int CTScheduler::ct_create_group(unsigned * pGroup, unsigned weight,
+        unsigned cap) {
+    Ct_group * pG;
+    unsigned i;
+
+    if (NULL == pGroup || 0 == weight || cap > 100) {
+        CTOut::ct_report_error("ct_create_group: invalid argument");
+        return CT_ERROR;
+    }
+
+    for (i = 1; i < CT_GROUPS_MAX; ++i)
+        if ( !groups[ i ].in_use)
+            break;
+
+    if (i >= CT_GROUPS_MAX) {
+        CTOut::ct_report_error("ct_create_group: too many groups");
+        return CT_ERROR;
+    }
+
+    if (weight > CT_GROUP_SCALE)
+        weight = CT_GROUP_SCALE;
+
+    pG = groups + i;
+    pG->in_use = 1;
+    pG->weight = weight;
+    pG->cap = cap;
+    pG->stride = CT_GROUP_SCALE / weight;
+    pG->pass = group_base_pass;
+    pG->window_used = 0;
+
+    *pGroup = i;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Set the length of the window over which caps apply, in units of
+ CT_CYCLES().  Return CT_ERROR if 0.
+ ****************************************************************/
+
+int CTScheduler::ct_set_group_window(Ct_cycles window) {
+    if ( 0 == window) {
+        CTOut::ct_report_error("ct_set_group_window: invalid window");
+        return CT_ERROR;
+    }
+
+    group_window = window;
+    return CT_OKAY;
+}
+
+int CTScheduler::ct_group_stats(unsigned group, Ct_group_stats * pStats) {
+    if (NULL == pStats || !valid_group(group)) {
+        CTOut::ct_report_error("ct_group_stats: invalid argument");
+        return CT_ERROR;
+    }
+
+    *pStats = groups[ group ].stats;
+    return CT_OKAY;
+}
+
+int CTScheduler::valid_group(unsigned group) {
+    return group < CT_GROUPS_MAX && groups[ group ].in_use;
+}
+
+/*****************************************************************
+ Forget all groups but the default, which starts afresh.  Any
+ parked threads must already be gone.
+ ****************************************************************/
+
+void CTScheduler::clear_groups(void) {
+    Ct_group * pG;
+    unsigned i;
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i) {
+        pG = groups + i;
+        pG->in_use = 0 == i;
+        pG->weight = CT_DEFAULT_WEIGHT;
+        pG->cap = 0;
+        pG->stride = CT_GROUP_SCALE / CT_DEFAULT_WEIGHT;
+        pG->pass = 0;
+        pG->window_used = 0;
+        pG->stats.steps = 0;
+        pG->stats.cycles = 0;
+        pG->stats.throttled = 0;
+
+        pG->parked.pNext = pG->parked.pPrev = &pG->parked;
+        pG->parked.status = CT_STATUS_DUMMY;
+        pG->parked.priority = 9999;
+        pG->parked.incarnation = 0;
+        pG->parked.pData = NULL;
+        pG->parked.msg_q = NULL;
+        pG->parked.step = NULL;
+        pG->parked.destruct = NULL;
+#ifndef NDEBUG
+        pG->parked.magic = CT_MAGIC;
+#endif
+    }
+
+    group_base_pass = 0;
+    group_window = CT_GROUP_WINDOW;
+    window_start = CT_CYCLES();
+}
+
+/*****************************************************************
+ Return CT_TRUE if a group's threads should be held back, either
+ because it has used up its cap or because it has got too far
+ ahead.  A group that has fallen behind, e.g. by having nothing
+ to do, gets no credit for it; its pass is brought up to date.
+ ****************************************************************/
+
+int CTScheduler::group_held(Ct_group * pG) {
+    long ahead;
+
+    if (pG->cap > 0 && pG->window_used >= group_window / 100 * pG->cap)
+        return CT_TRUE;
+
+    ahead = (long) (pG->pass - group_base_pass);
+    if (ahead < 0) {
+        pG->pass = group_base_pass;
+        return CT_FALSE;
+    }
+
+    return (unsigned long) ahead
+            > group_window * ( CT_GROUP_SCALE / CT_DEFAULT_WEIGHT );
+}
+
+/*****************************************************************
+ Move a thread from the priority queue to its group's parked list.
+ ****************************************************************/
+
+void CTScheduler::park_thread(Ct_thread * pThread) {
+    Ct_thread * pAnchor = &groups[ pThread->group ].parked;
+
+    unlink_thread(pThread);
+
+    pThread->pPrev = pAnchor->pPrev;
+    pThread->pNext = pAnchor;
+    pAnchor->pPrev->pNext = pThread;
+    pAnchor->pPrev = pThread;
+
+    ++groups[ pThread->group ].stats.throttled;
+}
+
+/*****************************************************************
+ Return the parked threads of every group no longer held back to
+ the priority queue, in the order they were parked.
+ ****************************************************************/
+
+void CTScheduler::unpark_groups(void) {
+    Ct_group * pG;
+    Ct_thread * pThread;
+    unsigned i;
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i) {
+        pG = groups + i;
+        if (pG->parked.pNext == &pG->parked || group_held(pG))
+            continue;
+
+        while (pG->parked.pNext != &pG->parked) {
+            pThread = pG->parked.pNext;
+            unlink_thread(pThread);
+            insert_thread(pThread);
+        }
+    }
+}
+
+/*****************************************************************
+ Called when no thread is runnable: release whatever parked
+ threads we can.  Return CT_FALSE if nothing is parked, or if every
+ parked group has used up its cap and the window has yet to end.
+ ****************************************************************/
+
+int CTScheduler::release_groups(void) {
+    Ct_group * pG;
+    Ct_group * pBehind = NULL;
+    int parked = 0;
+    unsigned i;
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i) {
+        pG = groups + i;
+        if (pG->parked.pNext == &pG->parked)
+            continue;
+
+        parked = 1;
+        if (pG->cap > 0 && pG->window_used >= group_window / 100 * pG->cap)
+            continue;
+
+        if (NULL == pBehind || (long) (pG->pass - pBehind->pass) < 0)
+            pBehind = pG;
+    }
+
+    if ( !parked)
+        return CT_FALSE;
+
+    if (NULL == pBehind) {
+        /* The CPU is not ours to use till the window ends */
+
+        if (CT_CYCLES() - window_start < group_window)
+            return CT_FALSE;
+
+        new_window();
+    }
+    else {
+        group_base_pass = pBehind->pass;
+        unpark_groups();
+    }
+
+    return CT_TRUE;
+}
+
+/*****************************************************************
+ Return CT_TRUE if any thread is parked.
+ ****************************************************************/
+
+int CTScheduler::groups_parked(void) {
+    unsigned i;
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i)
+        if (groups[ i ].parked.pNext != &groups[ i ].parked)
+            return CT_TRUE;
+
+    return CT_FALSE;
+}
+
+/*****************************************************************
+ Called when only capped groups have work, and the window has yet
+ to end.  Check for ready descriptors, then nap in the idle
+ function, if there is one, for a tick of the installed clock --
+ the nearest we can come to the end of the window, which is
+ measured in CT_CYCLES() instead.  Without an idle function we
+ simply return, and the scheduler loop keeps polling, as it does
+ for timeouts.
+ ****************************************************************/
+
+void CTScheduler::wait_window(void) {
+#if defined CT_TIMEOUT
+    Ct_time wake;
+#endif
+
+#if defined CT_EPOLL
+    if (fd_wait_count > 0)
+        poll_fds( 0);
+#endif
+#if defined CT_TIMEOUT
+    if (NULL == idle_function)
+        return;
+#if defined CT_REPLAY
+    if (replay.ct_replaying())
+        return;
+#endif
+
+    wake = read_clock();
+    if (ULONG_MAX == wake.tick)
+        ++wake.era;
+    ++wake.tick;
+
+    idle_function( &wake);
+#endif
+}
+
+/*****************************************************************
+ Charge a step, which began at the specified time, to the group
+ of the thread that took it.
+ ****************************************************************/
+
+void CTScheduler::charge_group(Ct_thread * pThread, Ct_cycles started,
+        Ct_cycles elapsed) {
+    Ct_group * pG = groups + pThread->group;
+
+    ++pG->stats.steps;
+    pG->stats.cycles += elapsed;
+    pG->window_used += elapsed;
+    pG->pass += elapsed * pG->stride;
+
+    if (started + elapsed - window_start >= group_window)
+        new_window();
+}
+
+/*****************************************************************
+ Start a new window, lifting the caps.
+ ****************************************************************/
+
+void CTScheduler::new_window(void) {
+    unsigned i;
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i)
+        groups[ i ].window_used = 0;
+
+    window_start = CT_CYCLES();
+    unpark_groups();
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*****************************************************************
+ CTInbox -- a bounded, lock-free queue through which other OS
+ threads may post events to a scheduler.
+ ****************************************************************/
+
+#include <string.h>
+#include "CTInbox.h"
+#include "CTAssert.h"
+
+#if defined CT_THREADSAFE
+
+CTInbox::CTInbox() {
+    unsigned long i;
+
+    /* Slot i is first available to the producer */
+    /* that claims position i. */
+
+    for (i = 0; i < CT_INBOX_SLOTS; ++i)
+        slots[ i ].sequence = i;
+
+    post_pos = 0;
+    take_pos = 0;
+}
+
+CTInbox::~CTInbox() {
+}
+
+/*****************************************************************
+ Copy an event into the inbox.  Safe to call from any OS thread.
+ Return CT_ERROR if the inbox is full or the message is too long
+ to carry by value, CT_OKAY otherwise.
+ ****************************************************************/
+
+int CTInbox::ct_post(Ct_event_type ev_type, Ct_msgtype type,
+        const void * pData, size_t len,
+        Ct_dispatch_type dispatch_type, Ct_handle addressee) {
+    Ct_inbox_slot * pSlot;
+    unsigned long pos;
+    unsigned long seq;
+    long diff;
+
+    if (len > CT_MSG_BUF_LEN || (NULL == pData && len > 0))
+        return CT_ERROR;
+
+    /* Claim a position.  A slot whose sequence number equals */
+    /* the position is free; one that lags behind it is still */
+    /* waiting for the consumer, meaning the inbox is full.   */
+
+    pos = __atomic_load_n( &post_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        pSlot = slots + (pos & (CT_INBOX_SLOTS - 1));
+        seq = __atomic_load_n( &pSlot->sequence, __ATOMIC_ACQUIRE);
+        diff = (long) (seq - pos);
+
+        if ( 0 == diff) {
+            if (__atomic_compare_exchange_n( &post_pos, &pos, pos + 1, 0,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+
+            /* Another producer got there first; pos now */
+            /* holds the latest value, so try again.     */
+        }
+        else
+            if (diff < 0)
+                return CT_ERROR; /* full */
+            else
+                pos = __atomic_load_n( &post_pos, __ATOMIC_RELAXED);
+    }
+
+    /* The slot is ours.  Fill it, then publish it to the consumer. */
+
+    pSlot->ev.ev_type = ev_type;
+    pSlot->ev.type = type;
+    pSlot->ev.msg_len = len;
+    pSlot->ev.dispatch_type = dispatch_type;
+    pSlot->ev.addressee = addressee;
+    if (len > 0)
+        memcpy(pSlot->ev.buff, pData, len);
+
+    __atomic_store_n( &pSlot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Copy the oldest entry, if any, into *pEv.  Return CT_TRUE if
+ there was one, CT_FALSE if the inbox was empty.  Only the OS
+ thread running the scheduler may call this function.
+ ****************************************************************/
+
+int CTInbox::ct_take(Ct_posted_event * pEv) {
+    Ct_inbox_slot * pSrc;
+    unsigned long seq;
+
+    ASSERT( pEv != NULL );
+
+    pSrc = slots + (take_pos & (CT_INBOX_SLOTS - 1));
+    seq = __atomic_load_n( &pSrc->sequence, __ATOMIC_ACQUIRE);
+    if (seq != take_pos + 1)
+        return CT_FALSE; /* empty, or not yet published */
+
+    pEv->ev_type = pSrc->ev.ev_type;
+    pEv->type = pSrc->ev.type;
+    pEv->msg_len = pSrc->ev.msg_len;
+    pEv->dispatch_type = pSrc->ev.dispatch_type;
+    pEv->addressee = pSrc->ev.addressee;
+    if (pSrc->ev.msg_len > 0)
+        memcpy(pEv->buff, pSrc->ev.buff, pSrc->ev.msg_len);
+
+    /* Hand the slot back to the producers for its next use */
+
+    __atomic_store_n( &pSrc->sequence, take_pos + CT_INBOX_SLOTS,
+            __ATOMIC_RELEASE);
+    ++take_pos;
+
+    return CT_TRUE;
+}
+
+/*****************************************************************
+ Return CT_TRUE if there may be an entry to take.  Only the OS
+ thread running the scheduler may call this function.
+ ****************************************************************/
+
+int CTInbox::ct_pending(void) {
+    const Ct_inbox_slot * pSrc = slots + (take_pos & (CT_INBOX_SLOTS - 1));
+
+    if (__atomic_load_n( &pSrc->sequence, __ATOMIC_ACQUIRE) == take_pos + 1)
+        return CT_TRUE;
+    else
+        return CT_FALSE;
+}
+
+#endif
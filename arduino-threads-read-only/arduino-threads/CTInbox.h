@@ -0,0 +1,81 @@
+/*****************************************************************
+ CTInbox -- a bounded, lock-free queue through which other OS
+ threads may post events to a scheduler.
+
+ Everything else in the scheduler belongs to the single OS thread
+ that runs it: the free lists, the event queue, the message queues
+ and the subscription lists.  The inbox is the one exception.  Any
+ number of OS threads may post to it concurrently; only the
+ scheduler's own thread takes from it, converting each entry into
+ an ordinary Ct_event at the top of its loop.
+
+ An entry is a Ct_posted_event, which carries its message data by
+ value, so that posting never touches the scheduler's memory pools.
+
+ The algorithm is Dmitry Vyukov's bounded queue: each slot carries
+ a sequence number telling producers and the consumer whose turn
+ it is to use the slot.
+
+ Compiled only if CT_THREADSAFE is defined.
+ ****************************************************************/
+
+#ifndef CTINBOX_H_
+#define CTINBOX_H_
+
+#include "ct.h"
+#include "ctpriv.h"
+
+#if defined CT_THREADSAFE
+
+#if ( CT_INBOX_SLOTS & ( CT_INBOX_SLOTS - 1 ) ) != 0
+#error "CT_INBOX_SLOTS must be a power of two"
+#endif
+
+typedef struct {
+        unsigned long sequence;
+        Ct_posted_event ev;
+} Ct_inbox_slot;
+
+class CTInbox {
+
+    public:
+
+        CTInbox();
+        virtual ~CTInbox();
+
+        /*****************************************************************
+         Copy an event into the inbox.  Safe to call from any OS thread.
+         Return CT_ERROR if the inbox is full or the message is too long
+         to carry by value, CT_OKAY otherwise.
+         ****************************************************************/
+
+        int ct_post(Ct_event_type ev_type, Ct_msgtype type,
+                const void * pData, size_t len,
+                Ct_dispatch_type dispatch_type, Ct_handle addressee);
+
+        /*****************************************************************
+         Copy the oldest entry, if any, into *pEv.  Return CT_TRUE if
+         there was one, CT_FALSE if the inbox was empty.  Only the OS
+         thread running the scheduler may call this function.
+         ****************************************************************/
+
+        int ct_take(Ct_posted_event * pEv);
+
+        /*****************************************************************
+         Return CT_TRUE if there may be an entry to take.  Only the OS
+         thread running the scheduler may call this function.
+         ****************************************************************/
+
+        int ct_pending(void);
+
+    private:
+
+        Ct_inbox_slot slots [CT_INBOX_SLOTS ];
+
+        unsigned long post_pos; /* shared by all producers */
+        unsigned long take_pos; /* owned by the consumer */
+};
+
+#endif
+
+#endif /*CTINBOX_H_*/
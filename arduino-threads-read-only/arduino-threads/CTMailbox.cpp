@@ -0,0 +1,230 @@
+/*****************************************************************
+ CTMailbox -- the parts of CTScheduler that keep each thread's
+ mailbox within its capacity.
+
+ A thread's mailbox holds the messages in its input queue, plus
+ those sent to it directly that are still in the event queue.  A
+ direct send claims its place when it is made, through
+ ct_admit_msg(), so that the sender can be told at once if there
+ is no room; any other message claims its place when attached.
+ Either way the place is given up by ct_remove_msg().
+
+ Senders blocked on a full mailbox wait on the sleeper list, where
+ broadcasts and snapshots find them like any other sleeper.  We
+ look for them there only when room appears in a mailbox whose
+ owner has been told that somebody is waiting, but then the search
+ costs O(sleepers), however few of them are blocked.
+
+ Compiled only if CT_MAILBOX is defined, except for ct_remove_msg(),
+ through which every message leaves an input queue regardless.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_MAILBOX
+
+/*****************************************************************
+ Set the capacity (0 for no limit) and overflow policy of a
+ thread's mailbox.  Messages already in it stay there, even if
+ more than the new capacity.
+ ****************************************************************/
+
+int CTScheduler::ct_set_mailbox(Ct_handle handle, unsigned capacity,
+        Ct_overflow_policy policy) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if ( !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_set_mailbox: invalid thread handle");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    if (policy < CT_OVERFLOW_REJECT || policy > CT_OVERFLOW_BLOCK) {
+        CTOut::ct_report_error("ct_set_mailbox: invalid overflow policy");
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    pThread->msg_capacity = capacity;
+    pThread->overflow = policy;
+
+    /* A larger mailbox may have room for blocked senders */
+
+    if (pThread->msg_blocked && has_room(pThread))
+        wake_blocked_senders(pThread);
+
+    return CT_OKAY;
+}
+
+int CTScheduler::ct_mailbox_stats(Ct_handle handle,
+        Ct_mailbox_stats * pStats) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_mailbox_stats: invalid argument");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    *pStats = pThread->mailbox_stats;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Claim a place in its addressee's mailbox for a message about to
+ be sent directly.  Return CT_OKAY if the message may be sent,
+ CT_MSG_DROPPED if it is to be discarded quietly, or
+ CT_MAILBOX_FULL if the sender is to be told there is no room --
+ in which case, under CT_OVERFLOW_BLOCK, the sender is now asleep.
+ ****************************************************************/
+
+int CTScheduler::ct_admit_msg(Ct_event * pE) {
+    Ct_thread * pT;
+
+    ASSERT( pE != NULL );
+    ASSERT( EVENT_MAGIC == pE->magic );
+    ASSERT( ctDataStore.ct_valid_handle( &pE->addressee ) );
+
+    pT = (Ct_thread *) pE->addressee.p;
+
+    if ( !has_room(pT)) {
+        switch (pT->overflow) {
+            case CT_OVERFLOW_DROP_OLDEST:
+            case CT_OVERFLOW_DROP_NEWEST:
+                ++pT->mailbox_stats.dropped;
+
+                /* If everything in the mailbox is still on its */
+                /* way, we can only drop the newest. */
+
+                if (CT_OVERFLOW_DROP_NEWEST == pT->overflow
+                        || NULL == pT->msg_q)
+                    return CT_MSG_DROPPED;
+
+                ct_remove_msg(pT);
+                break;
+
+            case CT_OVERFLOW_BLOCK:
+
+                /* Only a thread can wait, and not on itself */
+
+                if (pCurr_thread != NULL && pCurr_thread != pT) {
+                    pCurr_thread->status = CT_STATUS_ASLEEP;
+                    pCurr_thread->blocked_on = pE->addressee;
+                    pT->msg_blocked = 1;
+                }
+
+                ++pT->mailbox_stats.refused;
+                return CT_MAILBOX_FULL;
+
+            default:
+                ++pT->mailbox_stats.refused;
+                return CT_MAILBOX_FULL;
+        }
+    }
+
+    count_msg(pT);
+    pE->reserved = 1;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Claim a place in a thread's mailbox for a message about to be
+ attached, unless it claimed one when sent.  Return CT_FALSE if
+ the message is to be discarded instead.
+ ****************************************************************/
+
+int CTScheduler::admit_attached(Ct_event * pE, Ct_thread * pT) {
+    if (pE->reserved)
+        return CT_TRUE;
+
+    /* Only messages to subscribers or to everybody are */
+    /* subject to the overflow policy. */
+
+    if (pE->dispatch_type != CT_DISPATCH_ADDRESSEE && !has_room(pT)) {
+        ++pT->mailbox_stats.dropped;
+
+        if (CT_OVERFLOW_DROP_OLDEST == pT->overflow && pT->msg_q != NULL)
+            ct_remove_msg(pT);
+        else
+            return CT_FALSE;
+    }
+
+    count_msg(pT);
+    return CT_TRUE;
+}
+
+#endif
+
+/*****************************************************************
+ Remove and destroy the oldest message in a thread's input queue,
+ giving up its place in the mailbox, if any.
+ ****************************************************************/
+
+void CTScheduler::ct_remove_msg(Ct_thread * pT) {
+    Ct_msgnode * pNode;
+
+    ASSERT( pT != NULL );
+    ASSERT( CT_MAGIC == pT->magic );
+
+    pNode = pT->msg_q;
+    ASSERT( pNode != NULL );
+    ASSERT( MSGNODE_MAGIC == pNode->magic );
+#if defined CT_MAILBOX
+    ASSERT( pT->mailbox_stats.count > 0 );
+#endif
+
+    pT->msg_q = pNode->pNext;
+    pNode->pNext = NULL;
+    ctDataStore.ct_destruct_msgnode_list( &pNode);
+
+#if defined CT_MAILBOX
+    --pT->mailbox_stats.count;
+    if (pT->msg_blocked && has_room(pT))
+        wake_blocked_senders(pT);
+#endif
+}
+
+#if defined CT_MAILBOX
+
+void CTScheduler::count_msg(Ct_thread * pT) {
+    if (++pT->mailbox_stats.count > pT->mailbox_stats.high_water)
+        pT->mailbox_stats.high_water = pT->mailbox_stats.count;
+}
+
+int CTScheduler::has_room(const Ct_thread * pT) {
+    return 0 == pT->msg_capacity
+            || pT->mailbox_stats.count < pT->msg_capacity;
+}
+
+/*****************************************************************
+ Wake the threads asleep for want of room in a specified thread's
+ mailbox -- because it has room now, or because it is going away.
+ Each wakes at its own priority, to try again.
+ ****************************************************************/
+
+void CTScheduler::wake_blocked_senders(Ct_thread * pT) {
+    Ct_thread * pS;
+    Ct_thread * pNext;
+
+    pT->msg_blocked = 0;
+
+    for (pS = sleepers.pNext; pS != &sleepers; pS = pNext) {
+        ASSERT( CT_MAGIC == pS->magic );
+        pNext = pS->pNext;
+
+        if (pS->blocked_on.p == pT
+                && pS->blocked_on.incarnation == pT->incarnation) {
+            pS->blocked_on.p = NULL;
+            enqueue(pS, CT_PRIORITY_MAX);
+        }
+    }
+}
+
+#endif
@@ -282,6 +282,85 @@ void CTMemory::freePoolMemory(void) {
     return;
 }
 
+#if defined CT_ARENA
+
+/*******************************************************************
+ arenaInit -- prepares an empty arena for objects of a given size.
+ *******************************************************************/
+
+void CTMemory::arenaInit(Ct_arena * pArena, size_t size) {
+    ASSERT(pArena != NULL);
+    ASSERT(size != 0);
+
+    pArena->chunks = NULL;
+    pArena->size = size;
+    pArena->used = 0;
+}
+
+/*******************************************************************
+ arenaAlloc -- returns a new object from an arena, or NULL if out
+ of memory.  The object is not initialized.
+ *******************************************************************/
+
+void * CTMemory::arenaAlloc(Ct_arena * pArena) {
+    Ct_chunk * pChunk;
+
+    if (NULL == pArena->chunks || CT_ARENA_CHUNK == pArena->used) {
+        pChunk = (Ct_chunk *) allocMemory(sizeof(Ct_chunk)
+                + CT_ARENA_CHUNK * pArena->size);
+        if (NULL == pChunk)
+            return NULL;
+
+        pChunk->pNext = pArena->chunks;
+        pArena->chunks = pChunk;
+        pArena->used = 0;
+    }
+
+    return (unsigned char *) (pArena->chunks + 1)
+            + pArena->size * pArena->used++;
+}
+
+/*******************************************************************
+ arenaVisit -- calls a function for every object ever handed out
+ by an arena, passing it the object and a void pointer.
+ *******************************************************************/
+
+void CTMemory::arenaVisit(Ct_arena * pArena, void (* pVisit)(void *, void *),
+        void * p) {
+    Ct_chunk * pChunk;
+    unsigned char * pObj;
+    unsigned n;
+
+    ASSERT(pVisit != NULL);
+
+    n = pArena->used;
+    for (pChunk = pArena->chunks; pChunk != NULL; pChunk = pChunk->pNext) {
+        for (pObj = (unsigned char *) (pChunk + 1); n > 0; --n) {
+            pVisit(pObj, p);
+            pObj += pArena->size;
+        }
+        n = CT_ARENA_CHUNK;
+    }
+}
+
+/*******************************************************************
+ arenaRelease -- frees every chunk of an arena, leaving it empty.
+ *******************************************************************/
+
+void CTMemory::arenaRelease(Ct_arena * pArena) {
+    Ct_chunk * pChunk;
+
+    while (pArena->chunks != NULL) {
+        pChunk = pArena->chunks->pNext;
+        freeMemory(pArena->chunks);
+        pArena->chunks = pChunk;
+    }
+
+    pArena->used = 0;
+}
+
+#endif
+
 #ifndef NDEBUG
 
 /********************************************************************
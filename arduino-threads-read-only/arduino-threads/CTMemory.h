@@ -35,6 +35,27 @@ typedef struct {
         void * genericPtr; /* ptr to be passed to the above */
 } MemoryPool;
 
+#if defined CT_ARENA
+
+/* An arena hands out objects of one size from chunks of        */
+/* CT_ARENA_CHUNK, and takes them back only all at once.  Each  */
+/* chunk begins with a header aligned for any object: */
+
+typedef union Ct_chunk Ct_chunk;
+
+union Ct_chunk {
+        Ct_chunk * pNext; /* next older chunk */
+        long double align;
+};
+
+typedef struct {
+        Ct_chunk * chunks; /* newest first */
+        size_t size; /* of each object */
+        unsigned used; /* objects handed out from the newest chunk */
+} Ct_arena;
+
+#endif
+
 /* Note: all pointers in the following array are implicitly
  initialized to NULL.
  */
@@ -83,6 +104,27 @@ class CTMemory {
 
         void freePoolMemory(void);
 
+#if defined CT_ARENA
+
+        /*******************************************************************
+         arenaInit -- prepares an empty arena for objects of a given size.
+
+         arenaAlloc -- returns a new object from an arena, or NULL if out
+         of memory.  The object is not initialized.
+
+         arenaVisit -- calls a function for every object ever handed out
+         by an arena, passing it the object and a void pointer.
+
+         arenaRelease -- frees every chunk of an arena, leaving it empty.
+         *******************************************************************/
+
+        void arenaInit(Ct_arena * pArena, size_t size);
+        void * arenaAlloc(Ct_arena * pArena);
+        void arenaVisit(Ct_arena * pArena, void (* pVisit)(void *, void *),
+                void * p);
+        void arenaRelease(Ct_arena * pArena);
+#endif
+
         
     private:
 
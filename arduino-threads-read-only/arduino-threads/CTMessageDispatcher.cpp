@@ -41,6 +41,10 @@ CTMessageDispatcher::CTMessageDispatcher() {
     free_heads= NULL;
     free_head_count = 0;
 
+#if defined CT_ARENA
+    ctMemory.arenaInit( &sub_arena, sizeof(Ct_sub));
+    ctMemory.arenaInit( &head_arena, sizeof(Sub_list_head));
+#endif
 }
 
 CTMessageDispatcher::CTMessageDispatcher( CTScheduler& ctScheduler,
@@ -66,6 +70,7 @@ int CTMessageDispatcher::ct_subscribe(Ct_msgtype type, Ct_handle handle) {
     Ct_thread * pThread;
     Ct_sub * pSub;
     Sub_list_head * pHead;
+    CT_LOCKED( ctScheduler );
 
     if ( !ctDataStore.ct_valid_handle( &handle) ) {
         CTOut::ct_report_error("ct_subscribe: invalid thread handle");
@@ -135,6 +140,7 @@ int CTMessageDispatcher::ct_unsubscribe(Ct_msgtype type, Ct_handle handle) {
     Ct_thread * pThread;
     Ct_sub * pSub;
     Ct_sub * pPrev;
+    CT_LOCKED( ctScheduler );
 
     if ( !ctDataStore.ct_valid_handle( &handle) )
         return CT_OKAY; /* No thread to unsubscribe */
@@ -186,6 +192,8 @@ int CTMessageDispatcher::ct_unsubscribe(Ct_msgtype type, Ct_handle handle) {
  *********************************************************************/
 
 void CTMessageDispatcher::ct_unsubscribe_all(Ct_handle handle) {
+    CT_LOCKED( ctScheduler );
+
     if ( ! ctDataStore.ct_valid_handle( &handle) ) {
         return; /* No thread to unsubscribe */
     }
@@ -322,7 +330,11 @@ Ct_sub * CTMessageDispatcher::alloc_sub(void) {
     Ct_sub * pSub;
 
     if ( NULL == free_subs)
+#if defined CT_ARENA
+        pSub = (Ct_sub*) ctMemory.arenaAlloc( &sub_arena);
+#else
         pSub = (Ct_sub*) ctMemory.allocMemory(sizeof(Ct_sub));
+#endif
     else {
         pSub = free_subs;
         free_subs = free_subs->pNext;
@@ -399,6 +411,7 @@ void CTMessageDispatcher::ct_destruct_sub_list(Ct_sub ** ppSub) {
     pTail->pNext = free_subs;
     free_subs = pSub;
 
+#if ! defined CT_ARENA
     while (free_sub_count > MAX_FREE_SUBS) {
         ASSERT( free_subs != NULL );
 
@@ -407,6 +420,7 @@ void CTMessageDispatcher::ct_destruct_sub_list(Ct_sub ** ppSub) {
         ctMemory.freeMemory(pSub);
         --free_sub_count;
     }
+#endif
 }
 
 /************************************************************************
@@ -442,7 +456,11 @@ Sub_list_head * CTMessageDispatcher::alloc_head(void) {
     Sub_list_head * pHead;
 
     if ( NULL == free_heads)
+#if defined CT_ARENA
+        pHead = (Sub_list_head*) ctMemory.arenaAlloc( &head_arena);
+#else
         pHead = (Sub_list_head*) (ctMemory.allocMemory(sizeof(Sub_list_head)) );
+#endif
     else {
         pHead = free_heads;
         free_heads = free_heads->pNext;
@@ -494,6 +512,11 @@ void CTMessageDispatcher::dealloc_head(Sub_list_head **ppHead) {
 
     /* Deallocate it */
 
+#if defined CT_ARENA
+    pHead->pNext = free_heads;
+    free_heads = pHead;
+    ++free_head_count;
+#else
     if (free_head_count < MAX_FREE_HEADS) {
         pHead->pNext = free_heads;
         free_heads = pHead;
@@ -501,15 +524,30 @@ void CTMessageDispatcher::dealloc_head(Sub_list_head **ppHead) {
     }
     else
         ctMemory.freeMemory(pHead);
+#endif
 }
 
 /********************************************************************
  Physically free all the Ct_subs and Sub_list_heads on the free lists.
  This function should be called when the scheduler has destructed all
  the threads.
+
+ With CT_ARENA, the threads may not have been destructed, but only
+ released; so we forget their subscriptions and free the arenas.
  *******************************************************************/
 
 void CTMessageDispatcher::ct_free_subscriptions(void) {
+#if defined CT_ARENA
+    pFirst = pLast = NULL;
+
+    ctMemory.arenaRelease( &sub_arena);
+    free_subs = NULL;
+    free_sub_count = 0;
+
+    ctMemory.arenaRelease( &head_arena);
+    free_heads = NULL;
+    free_head_count = 0;
+#else
     Ct_sub * pSub;
     Sub_list_head * pHead;
 
@@ -529,4 +567,5 @@ void CTMessageDispatcher::ct_free_subscriptions(void) {
         free_heads = pHead;
     }
     free_head_count = 0;
+#endif
 }
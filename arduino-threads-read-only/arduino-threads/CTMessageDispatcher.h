@@ -89,6 +89,11 @@ class CTMessageDispatcher {
         Sub_list_head * free_heads;
         unsigned free_head_count;
 
+#if defined CT_ARENA
+        Ct_arena sub_arena;
+        Ct_arena head_arena;
+#endif
+
         /************************************************************************
          Subscribe to a message type.  I.e. until further notice, a specified
          thread is to receive all distributed events of a specified message type.
@@ -173,6 +178,9 @@ class CTMessageDispatcher {
          Physically free all the Ct_subs and Sub_list_heads on the free lists.
          This function should be called when the scheduler has destructed all
          the threads.
+
+         With CT_ARENA, the threads may not have been destructed, but only
+         released; so we forget their subscriptions and free the arenas.
          *******************************************************************/
 
         void ct_free_subscriptions(void);
@@ -45,6 +45,28 @@ CTMessageTransport::~CTMessageTransport() {
 
 int CTMessageTransport::ct_send_msg(Ct_msgtype type, void * pData, size_t len, Ct_handle dest) {
     Ct_event * pE;
+#if defined CT_MAILBOX
+    int rc;
+#endif
+    CT_LOCKED( ctScheduler );
+
+#if defined CT_THREADSAFE
+    if (ctScheduler.ct_is_remote( &dest) ) {
+        if (NULL == pData && len > 0) {
+            CTOut::ct_report_error("ct_send_msg: No data provided");
+            ctScheduler.ct_fatal_error();
+            return CT_ERROR;
+        }
+
+        if ( 0 == type) {
+            CTOut::ct_report_error("ct_send_msg: Invalid message type");
+            ctScheduler.ct_fatal_error();
+            return CT_ERROR;
+        }
+
+        return ctScheduler.ct_send_remote(CT_EV_MSG, type, pData, len, dest);
+    }
+#endif
 
     if ( ! ctDataStore.ct_valid_handle( &dest) ) {
         /* Addressee doesn't exist.  We don't treat this as */
@@ -73,10 +95,21 @@ int CTMessageTransport::ct_send_msg(Ct_msgtype type, void * pData, size_t len, C
         return CT_ERROR;
     else {
         pE->addressee = dest;
+#if defined CT_MAILBOX
 
-        /* Enqueue the event */
+        /* Make sure there's room for it */
 
-        return ctScheduler.ct_enqueue_event(pE);
+        rc = ctScheduler.ct_admit_msg(pE);
+        if (rc != CT_OKAY) {
+            ctDataStore.ct_destruct_event( &pE);
+            return CT_MSG_DROPPED == rc ? CT_OKAY : rc;
+        }
+
+#endif
+
+        /* Deliver the event directly if possible, else enqueue it */
+
+        return ctScheduler.ct_send_event(pE);
     }
 }
 
@@ -86,6 +119,12 @@ int CTMessageTransport::ct_send_msg(Ct_msgtype type, void * pData, size_t len, C
 
 int CTMessageTransport::ct_enqueue(Ct_handle dest) {
     Ct_event * pE;
+    CT_LOCKED( ctScheduler );
+
+#if defined CT_THREADSAFE
+    if (ctScheduler.ct_is_remote( &dest) )
+        return ctScheduler.ct_send_remote(CT_EV_ENQ, 0, NULL, 0, dest);
+#endif
 
     if ( ! ctDataStore.ct_valid_handle( &dest) ) {
         /* Addressee doesn't exist.  We don't treat this as */
@@ -95,6 +134,14 @@ int CTMessageTransport::ct_enqueue(Ct_handle dest) {
         return CT_OKAY;
     }
 
+#if defined CT_WAKEUPS
+
+    /* Usually a wakeup needs no event */
+
+    if (ctScheduler.ct_post_wakeup(dest))
+        return CT_OKAY;
+#endif
+
     pE = construct_enq_event( 0, CT_DISPATCH_ADDRESSEE);
     if (NULL == pE)
         return CT_ERROR;
@@ -114,6 +161,7 @@ int CTMessageTransport::ct_enqueue(Ct_handle dest) {
 
 int CTMessageTransport::ct_distribute_msg(Ct_msgtype type, void * pData, size_t len) {
     Ct_event * pE;
+    CT_LOCKED( ctScheduler );
 
     if (NULL == pData && len > 0) {
         CTOut::ct_report_error("ct_distribute_msg: No data provided");
@@ -145,6 +193,7 @@ int CTMessageTransport::ct_distribute_msg(Ct_msgtype type, void * pData, size_t
 
 int CTMessageTransport::ct_distribute_enq(Ct_msgtype type) {
     Ct_event * pE;
+    CT_LOCKED( ctScheduler );
 
     if ( 0 == type) {
         /* Zero is reserved to denote the absence of a message */
@@ -154,6 +203,11 @@ int CTMessageTransport::ct_distribute_enq(Ct_msgtype type) {
         return CT_ERROR;
     }
 
+#if defined CT_WAKEUPS
+    if (ctScheduler.ct_post_wakeup_subscribers(type))
+        return CT_OKAY;
+#endif
+
     pE = construct_enq_event(type, CT_DISPATCH_SUBSCRIBER);
     if (NULL == pE)
         return CT_ERROR;
@@ -170,6 +224,7 @@ int CTMessageTransport::ct_distribute_enq(Ct_msgtype type) {
 
 int CTMessageTransport::ct_broadcast_msg(Ct_msgtype type, void * pData, size_t len) {
     Ct_event * pE;
+    CT_LOCKED( ctScheduler );
 
     if (NULL == pData && len > 0) {
         CTOut::ct_report_error("ct_broadcast_msg: No data provided");
@@ -200,6 +255,10 @@ int CTMessageTransport::ct_broadcast_msg(Ct_msgtype type, void * pData, size_t l
  *******************************************************************/
 
 int CTMessageTransport::ct_broadcast_enq(void) {
+#if defined CT_WAKEUPS
+    ctScheduler.ct_post_wakeup_all();
+    return CT_OKAY;
+#else
     Ct_event * pE;
 
     pE = construct_enq_event( 0, CT_DISPATCH_ALL);
@@ -210,6 +269,7 @@ int CTMessageTransport::ct_broadcast_enq(void) {
 
         return ctScheduler.ct_enqueue_event(pE);
     }
+#endif
 }
 
 /********************************************************************
@@ -232,6 +292,10 @@ Ct_event * CTMessageTransport::construct_msg_event(Ct_msgtype type, void * pData
     pE->pNext = NULL;
     pE->type = type;
     pE->ev_type = CT_EV_MSG;
+    pE->priority = ctScheduler.ct_sender_priority();
+#if defined CT_MAILBOX
+    pE->reserved = 0;
+#endif
     pE->msg_len = len;
     pE->refcount = 0;
 #ifndef NDEBUG
@@ -241,7 +305,7 @@ Ct_event * CTMessageTransport::construct_msg_event(Ct_msgtype type, void * pData
     if (len > CT_MSG_BUF_LEN) {
         /* Allocate a copy of the data */
 
-        pE->pData = ctMemory.allocMemory(len);
+        pE->pData = ctDataStore.ct_alloc_msg_data(len);
         if (NULL == pE->pData) {
             CTOut::ct_report_error("ct_construct_msg_event: Out of memory");
             ctScheduler.ct_fatal_error();
@@ -279,6 +343,10 @@ Ct_event * CTMessageTransport::construct_enq_event(Ct_msgtype type,
     pE->pNext = NULL;
     pE->type = type;
     pE->ev_type = CT_EV_ENQ;
+    pE->priority = ctScheduler.ct_sender_priority();
+#if defined CT_MAILBOX
+    pE->reserved = 0;
+#endif
     pE->msg_len = 0;
     pE->refcount = 0;
 #ifndef NDEBUG
@@ -297,6 +365,7 @@ Ct_event * CTMessageTransport::construct_enq_event(Ct_msgtype type,
 Ct_msgheader CTMessageTransport::ct_query_msg(void) {
     Ct_handle self;
     Ct_msgheader hdr;
+    CT_LOCKED( ctScheduler );
 
     self = ctScheduler.ct_self();
     if (NULL == self.p) {
@@ -343,6 +412,7 @@ int CTMessageTransport::ct_dequeue_msg(unsigned char * buff) {
     Ct_thread * pThread;
     Ct_msgnode * pNode;
     const Ct_event * pE;
+    CT_LOCKED( ctScheduler );
 
     if (NULL == buff) {
         CTOut::ct_report_error("ct_dequeue_msg: no buffer provided");
@@ -383,9 +453,10 @@ int CTMessageTransport::ct_dequeue_msg(unsigned char * buff) {
 
     /* Dequeue and discard the message */
 
-    pThread->msg_q = pNode->pNext;
-    pNode->pNext = NULL;
-    ctDataStore.ct_destruct_msgnode_list( &pNode);
+    ctScheduler.ct_remove_msg(pThread);
+#if defined CT_STATS
+    ++pThread->stats.messages;
+#endif
 
     return CT_OKAY;
 }
@@ -398,6 +469,7 @@ void CTMessageTransport::ct_discard_msg(void) {
     Ct_handle self;
     Ct_thread * pThread;
     Ct_msgnode * pNode;
+    CT_LOCKED( ctScheduler );
 
     self = ctScheduler.ct_self();
     if (NULL == self.p) {
@@ -418,10 +490,10 @@ void CTMessageTransport::ct_discard_msg(void) {
 
     /* Dequeue and discard the message */
 
-    pThread->msg_q = pNode->pNext;
-    pNode->pNext = NULL;
-
-    ctDataStore.ct_destruct_msgnode_list( &pNode);
+    ctScheduler.ct_remove_msg(pThread);
+#if defined CT_STATS
+    ++pThread->stats.messages;
+#endif
 
     return;
 }
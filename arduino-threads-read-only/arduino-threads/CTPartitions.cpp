@@ -0,0 +1,212 @@
+/*****************************************************************
+ CTPartitions -- a group of schedulers, each running on its own
+ OS thread, that exchange messages without sharing anything else.
+ ****************************************************************/
+
+#include <new>
+#include <time.h>
+#include "CTPartitions.h"
+#include "CTScheduler.h"
+
+#if defined CT_THREADSAFE
+
+CTPartitions::CTPartitions() {
+    unsigned i;
+    unsigned j;
+
+    count = 0;
+    in_flight = 0;
+    busy = 0;
+
+    for (i = 0; i < CT_PARTITIONS_MAX; ++i) {
+        for (j = 0; j < CT_PARTITIONS_MAX; ++j)
+            rings[ i ][ j ] = NULL;
+        pthread_cond_init( &bells[ i ], NULL);
+        napping[ i ] = 0;
+    }
+    pthread_mutex_init( &nap_lock, NULL);
+}
+
+CTPartitions::~CTPartitions() {
+    unsigned i;
+    unsigned j;
+
+    for (i = 0; i < CT_PARTITIONS_MAX; ++i) {
+        for (j = 0; j < CT_PARTITIONS_MAX; ++j)
+            delete rings[ i ][ j ];
+        pthread_cond_destroy( &bells[ i ]);
+    }
+    pthread_mutex_destroy( &nap_lock);
+}
+
+/*****************************************************************
+ Add a scheduler to the group, with a ring each way between it and
+ every partition already added.  Return its partition number, or
+ -1 if the group is full or its rings cannot be allocated.
+ ****************************************************************/
+
+int CTPartitions::ct_add_partition(CTScheduler * pScheduler) {
+    unsigned i;
+
+    ASSERT( pScheduler != NULL );
+
+    if (count >= CT_PARTITIONS_MAX) {
+        CTOut::ct_report_error("ct_add_partition: too many partitions");
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        rings[ i ][ count ] = new (std::nothrow) CTRing;
+        rings[ count ][ i ] = new (std::nothrow) CTRing;
+
+        if (NULL == rings[ i ][ count ] || NULL == rings[ count ][ i ]) {
+            /* Give back this partition's rings */
+
+            for (i = 0; i < count; ++i) {
+                delete rings[ i ][ count ];
+                delete rings[ count ][ i ];
+                rings[ i ][ count ] = NULL;
+                rings[ count ][ i ] = NULL;
+            }
+
+            CTOut::ct_report_error("ct_add_partition: out of memory");
+            return -1;
+        }
+    }
+
+    pScheduler->ct_set_partition(this, count);
+    ++busy;
+    return count++;
+}
+
+/*****************************************************************
+ Return the number of partitions in the group.
+ ****************************************************************/
+
+unsigned CTPartitions::ct_partition_count(void) {
+    return count;
+}
+
+/*****************************************************************
+ Return the ring carrying messages from one partition to another.
+ ****************************************************************/
+
+CTRing * CTPartitions::ct_ring(unsigned from, unsigned to) {
+    ASSERT( from < count );
+    ASSERT( to < count );
+    ASSERT( from != to );
+
+    return rings[ from ][ to ];
+}
+
+/*****************************************************************
+ Note a message about to be pushed onto a ring.  We count it
+ before pushing, so that it is never in a ring uncounted.
+ ****************************************************************/
+
+void CTPartitions::ct_message_sent(void) {
+    __atomic_add_fetch( &in_flight, 1, __ATOMIC_ACQ_REL);
+}
+
+/*****************************************************************
+ Note a message just popped from a ring.  The receiving partition
+ must already have marked itself busy, so that the group can never
+ look finished while the message is being acted upon.
+ ****************************************************************/
+
+void CTPartitions::ct_message_received(void) {
+    __atomic_sub_fetch( &in_flight, 1, __ATOMIC_ACQ_REL);
+}
+
+/*****************************************************************
+ Note that a partition has run out of work.  If it was the last
+ one, wake the others so that they can finish.
+ ****************************************************************/
+
+void CTPartitions::ct_partition_idle(void) {
+    unsigned i;
+
+    if (__atomic_sub_fetch( &busy, 1, __ATOMIC_ACQ_REL) > 0
+            || !ct_quiescent())
+        return;
+
+    for (i = 0; i < count; ++i)
+        ct_wake(i);
+}
+
+/*****************************************************************
+ Note that an idle partition has work again.
+ ****************************************************************/
+
+void CTPartitions::ct_partition_busy(void) {
+    __atomic_add_fetch( &busy, 1, __ATOMIC_ACQ_REL);
+}
+
+/*****************************************************************
+ Return CT_TRUE if no partition has anything to do and no message
+ is in transit.  Since only a busy partition can send a message,
+ nothing can happen after that.
+ ****************************************************************/
+
+int CTPartitions::ct_quiescent(void) {
+    if ( 0 == __atomic_load_n( &busy, __ATOMIC_ACQUIRE)
+            && 0 == __atomic_load_n( &in_flight, __ATOMIC_ACQUIRE))
+        return CT_TRUE;
+    else
+        return CT_FALSE;
+}
+
+/*****************************************************************
+ Sleep, as idle partition id, until a message is sent or posted to
+ it, the group is finished, or CT_PARTITION_NAP_US pass.  We look
+ at our inbound rings again after saying that we are asleep, so a
+ sender that pushed before seeing us asleep is never missed.  A
+ post that slips in between the scheduler's last look at its inbox
+ and our falling asleep waits for the nap to run out.
+ ****************************************************************/
+
+void CTPartitions::ct_nap(unsigned id) {
+    struct timespec until;
+    unsigned i;
+    int pending = CT_FALSE;
+
+    ASSERT( id < count );
+
+    pthread_mutex_lock( &nap_lock);
+    __atomic_store_n( &napping[ id ], 1, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < count && !pending; ++i)
+        if (i != id && rings[ i ][ id ]->ct_pending())
+            pending = CT_TRUE;
+
+    if ( !pending && !ct_quiescent()) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += CT_PARTITION_NAP_US * 1000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec += until.tv_nsec / 1000000000L;
+            until.tv_nsec %= 1000000000L;
+        }
+        pthread_cond_timedwait( &bells[ id ], &nap_lock, &until);
+    }
+
+    __atomic_store_n( &napping[ id ], 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock( &nap_lock);
+}
+
+/*****************************************************************
+ Wake partition id if it is asleep.  The fence orders the message
+ just pushed before our look at napping, as ct_nap() orders its
+ setting of napping before its look at the rings.
+ ****************************************************************/
+
+void CTPartitions::ct_wake(unsigned id) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ( !__atomic_load_n( &napping[ id ], __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock( &nap_lock);
+    pthread_cond_signal( &bells[ id ]);
+    pthread_mutex_unlock( &nap_lock);
+}
+
+#endif
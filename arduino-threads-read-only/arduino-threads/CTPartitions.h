@@ -0,0 +1,109 @@
+/*****************************************************************
+ CTPartitions -- a group of schedulers, each running on its own
+ OS thread, that exchange messages without sharing anything else.
+
+ Each scheduler in the group is a partition.  A handle records the
+ partition of the thread it refers to, so that sending a message
+ to a thread in another partition pushes it onto a single-producer
+ single-consumer ring from the sender's partition to the
+ addressee's.  Each partition drains its inbound rings into its
+ own event queue at the top of its loop.  Apart from the rings,
+ no memory is touched by more than one OS thread.
+
+ A partition with nothing left to do sleeps until a message is
+ sent or posted to it, looking at its rings again each time it
+ wakes, until every partition in the group has nothing left to do
+ and no message is in transit; then they all finish.  A sender
+ rings the addressee's bell only if it is asleep, so a busy group
+ takes no locks.
+
+ Rings are allocated as partitions are added, one each way between
+ each pair, rather than for the largest possible group.
+
+ Partitions must all be added before any of them starts running.
+ Pinning each OS thread to a core is up to the application.
+
+ Compiled only if CT_THREADSAFE is defined.
+ ****************************************************************/
+
+#ifndef CTPARTITIONS_H_
+#define CTPARTITIONS_H_
+
+#include "ct.h"
+#include "ctpriv.h"
+#include "CTRing.h"
+
+#if defined CT_THREADSAFE
+
+#include <pthread.h>
+
+class CTScheduler;
+
+class CTPartitions {
+
+    public:
+
+        CTPartitions();
+        virtual ~CTPartitions();
+
+        /*****************************************************************
+         Add a scheduler to the group.  Return its partition number, or
+         -1 if the group is full or its rings cannot be allocated.
+         ****************************************************************/
+
+        int ct_add_partition(CTScheduler * pScheduler);
+
+        /*****************************************************************
+         Return the number of partitions in the group.
+         ****************************************************************/
+
+        unsigned ct_partition_count(void);
+
+        /*****************************************************************
+         Return the ring carrying messages from one partition to another.
+         ****************************************************************/
+
+        CTRing * ct_ring(unsigned from, unsigned to);
+
+        /*****************************************************************
+         Bookkeeping for deciding when the whole group is finished:
+         the number of messages pushed but not yet popped, and the
+         number of partitions that still have something to do.
+         ****************************************************************/
+
+        void ct_message_sent(void);
+        void ct_message_received(void);
+        void ct_partition_idle(void);
+        void ct_partition_busy(void);
+        int ct_quiescent(void);
+
+        /*****************************************************************
+         Sleep, as an idle partition, until a message is sent or posted
+         to it, the group is finished, or CT_PARTITION_NAP_US pass.
+         ****************************************************************/
+
+        void ct_nap(unsigned id);
+
+        /*****************************************************************
+         Wake a partition if it is asleep.  Call this after pushing a
+         message for it.
+         ****************************************************************/
+
+        void ct_wake(unsigned id);
+
+    private:
+
+        unsigned count;
+        unsigned long in_flight;
+        unsigned busy;
+
+        CTRing * rings [CT_PARTITIONS_MAX ][CT_PARTITIONS_MAX ];
+
+        pthread_mutex_t nap_lock;
+        pthread_cond_t bells [CT_PARTITIONS_MAX ];
+        int napping [CT_PARTITIONS_MAX ]; /* asleep in ct_nap() */
+};
+
+#endif
+
+#endif /*CTPARTITIONS_H_*/
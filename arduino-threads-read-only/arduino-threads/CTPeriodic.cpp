@@ -0,0 +1,209 @@
+/*****************************************************************
+ CTPeriodic -- the parts of CTScheduler that release periodic
+ threads.
+
+ A periodic thread keeps the absolute time of its next release.
+ Each release advances it by exactly one period, so the releases
+ stay on the boundaries fixed by the first one, however late the
+ thread is dispatched or however long its steps take.  A thread
+ re-arming itself with ct_wait_on_timeout() measures from the time
+ of the call instead, and so drifts by the sum of those delays.
+
+ Between releases the thread waits on the same timing wheel as
+ any other thread awaiting a timeout, so that a periodic thread
+ costs no more than a call to ct_wait_on_timeout() would: constant
+ time to queue, and a visit per sweep of the slot it hashes to.
+ With thousands of periodic threads, raise CT_WHEEL_SLOTS to keep
+ the slots short.  A release sends no message; the sweep simply
+ puts the thread back on the priority queue.
+
+ A message arriving between releases wakes the thread as usual.
+ Once it has dealt with its messages, the thread goes back to
+ waiting for the release it was waiting for.  If a step puts the
+ thread to sleep or sets a timeout of its own, its releases stop
+ until it wakes.
+
+ Compiled only if CT_PERIODIC is defined.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_PERIODIC
+
+/****************************************************************
+ Create a periodic thread, released every period clock ticks.  Its
+ first release comes phase ticks from now, or at once if phase is
+ zero; staggering the phases of threads with the same period keeps
+ them from all becoming runnable together.  The policy determines
+ how the thread recovers from an overrun.
+
+ Return CT_ERROR, without creating a thread, if the period is zero
+ or the policy unknown.  Neither is a fatal error.
+ ***************************************************************/
+
+int CTScheduler::ct_create_periodic_thread(Ct_handle * pHandle,
+        unsigned long period, unsigned long phase, Ct_periodic_policy policy,
+        int priority, void * pData, Ct_step_function step,
+        Ct_destructor destruct) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (0 == period
+            || (policy != CT_PERIODIC_SKIP && policy != CT_PERIODIC_CATCH_UP)) {
+        CTOut::ct_report_error("ct_create_periodic_thread: invalid period or policy");
+        return CT_ERROR;
+    }
+
+    if ( !opened) {
+        ct_open();
+        opened = 1;
+    }
+
+    if (priority > CT_PRIORITY_MAX)
+        priority = CT_PRIORITY_MAX;
+    else
+        if (priority < 0)
+            priority = 0;
+
+    pThread = ctDataStore.ct_construct(priority, pData, step, destruct);
+    if (NULL == pThread)
+        return CT_ERROR;
+
+    ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_REPLAY
+    note_creation(pThread);
+#endif
+
+    pThread->period = period;
+    pThread->periodic_policy = policy;
+    pThread->periodic_stats.releases = 0;
+    pThread->periodic_stats.overruns = 0;
+    pThread->periodic_stats.skipped = 0;
+    pThread->release = read_clock();
+
+    if (0 == phase) {
+        pThread->released = 1;
+        ++pThread->periodic_stats.releases;
+        insert_thread(pThread);
+    }
+    else {
+        add_ticks( &pThread->release, phase);
+        pThread->status = CT_STATUS_TIMEOUT;
+        pThread->deadline = pThread->release;
+        pThread->releasing = 1;
+        insert_timeout(pThread);
+    }
+
+    if (pHandle != NULL) {
+        /* Provide a handle to the new thread */
+
+        pHandle->p = pThread;
+        pHandle->incarnation = pThread->incarnation;
+#if defined CT_THREADSAFE
+        pHandle->partition = partition_id;
+#endif
+    }
+
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Report how a periodic thread has kept up with its releases.
+ ***************************************************************/
+
+int CTScheduler::ct_periodic_stats(Ct_handle handle,
+        Ct_periodic_stats * pStats) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_periodic_stats: invalid argument");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    if ( 0 == pThread->period) {
+        CTOut::ct_report_error("ct_periodic_stats: thread is not periodic");
+        return CT_ERROR;
+    }
+
+    *pStats = pThread->periodic_stats;
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Called at the end of each dispatch of a periodic thread.  If the
+ dispatch began a period, the next release falls one period after
+ this one.  Unless the thread has other business -- messages to
+ read, a sleep or timeout of its own, or an exit -- it then waits
+ for that release.  If the release has already passed, the thread
+ has overrun: under CT_PERIODIC_SKIP it waits for the first
+ boundary still to come, while under CT_PERIODIC_CATCH_UP it stays
+ runnable and is released again at once.
+ ***************************************************************/
+
+void CTScheduler::periodic_complete(Ct_thread * pThread) {
+    Ct_time now;
+    unsigned long missed;
+
+    pThread->releasing = 0;
+
+    if (pThread->released) {
+        pThread->released = 0;
+        add_ticks( &pThread->release, pThread->period);
+    }
+
+    if (pThread->status != CT_STATUS_ACTIVE || pThread->msg_q != NULL)
+        return;
+
+    now = read_clock();
+    if (ct_timecmp( &pThread->release, &now) < 0) {
+        ++pThread->periodic_stats.overruns;
+
+        if (CT_PERIODIC_CATCH_UP == pThread->periodic_policy) {
+            pThread->released = 1;
+            ++pThread->periodic_stats.releases;
+            return;
+        }
+
+        /* Count the boundaries passed, and move to the next one */
+
+        missed = (ticks_between( &pThread->release, &now) - 1)
+                / pThread->period + 1;
+        pThread->periodic_stats.skipped += missed;
+        while (missed > ULONG_MAX / pThread->period) {
+            add_ticks( &pThread->release, ULONG_MAX / pThread->period
+                    * pThread->period);
+            missed -= ULONG_MAX / pThread->period;
+        }
+        add_ticks( &pThread->release, missed * pThread->period);
+    }
+
+    pThread->status = CT_STATUS_TIMEOUT;
+    pThread->deadline = pThread->release;
+    pThread->releasing = 1;
+}
+
+/****************************************************************
+ Release a periodic thread from the timing wheel, returning it to
+ the priority queue.
+ ***************************************************************/
+
+void CTScheduler::release_periodic(Ct_thread * pThread) {
+    ASSERT( CT_MAGIC == pThread->magic );
+    ASSERT( CT_STATUS_TIMEOUT == pThread->status );
+
+    unlink_thread(pThread);
+    --timeout_count;
+
+    pThread->releasing = 0;
+    pThread->released = 1;
+    ++pThread->periodic_stats.releases;
+    pThread->status = CT_STATUS_ACTIVE;
+    insert_thread(pThread);
+}
+
+#endif
@@ -0,0 +1,439 @@
+/*****************************************************************
+ CTPolicy -- the parts of CTScheduler specific to the scheduling
+ policies other than multilevel, which needs nothing here.
+
+ Every policy keeps runnable threads on the same priority queue as
+ the multilevel policy, so that everything else in the scheduler
+ (enqueuing, broadcasting, cleaning up) works unchanged.  They
+ differ only in where a thread is queued and which thread in the
+ chosen queue runs next.
+ ****************************************************************/
+
+#include <stdlib.h>
+
+#include "CTScheduler.h"
+
+#if CT_POLICY == CT_POLICY_STRIDE
+
+/****************************************************************
+ Stride scheduling.  Each thread has a pass, which advances by its
+ stride -- inversely proportional to its weight -- for every step
+ it takes.  The thread with the lowest pass runs next.
+
+ Rather than keep the threads sorted by pass, we approximate: each
+ priority level holds the threads whose passes fall within one
+ bucket of CT_STRIDE_BUCKET units, with pri_q[ 0 ] starting at
+ base_pass.  next_ready() then finds the lowest bucket -- in constant
+ time under CT_READY_BITMAP -- and within a bucket threads run in
+ FIFO order.
+ ***************************************************************/
+
+/****************************************************************
+ Return the level at which to queue a thread, according to its
+ pass.  A thread returning from a sleep gets no credit for the
+ time it spent asleep; its pass is brought up to the present.
+ ***************************************************************/
+
+int CTScheduler::stride_level(Ct_thread * pThread) {
+    unsigned long ahead;
+
+    /* Compare by difference, which survives wraparound */
+
+    if ((long) (pThread->pass - base_pass) < 0)
+        pThread->pass = base_pass;
+
+    ahead = (pThread->pass - base_pass) / CT_STRIDE_BUCKET;
+    if (ahead > CT_PRIORITY_MAX)
+        return CT_PRIORITY_MAX;
+    else
+        return (int) ahead;
+}
+
+/****************************************************************
+ The lowest non-empty bucket is the specified level.  If that is
+ not level 0, advance virtual time to the start of it by moving
+ every bucket down by that many levels, and return 0.
+
+ We move the queues in ascending order, so that each one lands on
+ a queue that is empty by then.
+ ***************************************************************/
+
+int CTScheduler::advance_virtual_time(int level) {
+    int i;
+
+    if ( 0 == level)
+        return 0;
+
+    for (i = level; i >= 0; i = next_ready(i + 1))
+        append_queue(i, i - level);
+
+    base_pass += (unsigned long) level * CT_STRIDE_BUCKET;
+    return 0;
+}
+
+#elif CT_POLICY == CT_POLICY_LOTTERY
+
+/****************************************************************
+ Lottery scheduling.  Each runnable thread holds as many tickets
+ as its weight, and we draw one ticket from among the threads in
+ the chosen queue.
+
+ So that a draw costs time logarithmic in the length of the queue,
+ rather than linear, each level at which draws are held keeps the
+ threads queued there in numbered slots, with a Fenwick tree of
+ their weights: sums[ k ] holds the total weight of the slots from
+ k - lowbit(k) + 1 to k, where lowbit(k) is the lowest bit set in
+ k.  A thread joining the queue takes the next slot; one leaving
+ gives its slot to the thread in the last one, so the slots in use
+ stay contiguous.  The queue itself keeps its FIFO order for the
+ rest of the scheduler.
+
+ The generator is Marsaglia's xorshift, confined to 32 bits so
+ that it behaves the same wherever an unsigned long is longer.
+ ***************************************************************/
+
+/****************************************************************
+ Add delta to the weight in slot k, updating every sum that covers
+ it.  A weight is taken away by adding its negation, which works
+ out in unsigned arithmetic since no true sum is negative.  We go
+ all the way to max, so that the sums over the empty slots beyond
+ count stay correct for the threads that later fill them.
+ ***************************************************************/
+
+static void lottery_add(Ct_lottery * pL, unsigned k, unsigned long delta) {
+    ASSERT( k > 0 );
+
+    for (; k <= pL->max; k += k & (0U - k))
+        pL->sums[ k ] += delta;
+}
+
+Ct_thread * CTScheduler::draw_lottery(int level) {
+    Ct_lottery * pL;
+    unsigned long ticket;
+    unsigned pos;
+    unsigned bit;
+
+    ASSERT( level >= 0 && level < CT_LOTTERY_LEVELS );
+    pL = lottery + level;
+
+    lottery_state ^= (lottery_state << 13) & 0xFFFFFFFFUL;
+    lottery_state ^= lottery_state >> 17;
+    lottery_state ^= (lottery_state << 5) & 0xFFFFFFFFUL;
+
+    /* Only if lottery_enter() ran out of memory can */
+    /* a queued thread be missing from the draw */
+
+    if ( 0 == pL->total)
+        return pri_q[ level ].pNext;
+
+    ticket = lottery_state % pL->total;
+
+    /* Descend the tree for the first slot whose running */
+    /* total exceeds the ticket */
+
+    pos = 0;
+    for (bit = pL->max; bit > 0; bit >>= 1) {
+        if (pos + bit <= pL->max && pL->sums[ pos + bit ] <= ticket) {
+            pos += bit;
+            ticket -= pL->sums[ pos ];
+        }
+    }
+
+    ASSERT( pos < pL->count );
+    ASSERT( CT_MAGIC == pL->slots[ pos + 1 ]->magic );
+    return pL->slots[ pos + 1 ];
+}
+
+/****************************************************************
+ Enter a thread, just queued at the specified level, in the draw
+ held there, doubling the slots if they are all in use.  Return
+ CT_ERROR if out of memory, leaving the thread out of the draw.
+ ***************************************************************/
+
+int CTScheduler::lottery_enter(Ct_thread * pThread, int level) {
+    Ct_lottery * pL;
+    unsigned long * pSums;
+    Ct_thread ** pSlots;
+    unsigned new_max;
+    unsigned k;
+    unsigned j;
+
+    ASSERT( 0 == pThread->lottery_slot );
+    ASSERT( level >= 0 && level < CT_LOTTERY_LEVELS );
+    pL = lottery + level;
+
+    if (pL->count == pL->max) {
+        new_max = pL->max ? pL->max * 2 : 16;
+
+        pSums = (unsigned long *) realloc(pL->sums,
+                (new_max + 1) * sizeof(unsigned long));
+        if (NULL == pSums) {
+            CTOut::ct_report_error("lottery_enter: out of memory");
+            return CT_ERROR;
+        }
+        pL->sums = pSums;
+
+        pSlots = (Ct_thread **) realloc(pL->slots,
+                (new_max + 1) * sizeof(Ct_thread *));
+        if (NULL == pSlots) {
+            CTOut::ct_report_error("lottery_enter: out of memory");
+            return CT_ERROR;
+        }
+        pL->slots = pSlots;
+        pL->max = new_max;
+
+        /* Rebuild the sums in linear time, each one */
+        /* passing itself on to the next that covers it */
+
+        for (k = 1; k <= new_max; ++k)
+            pSums[ k ] = k <= pL->count ? pSlots[ k ]->weight : 0;
+        for (k = 1; k <= new_max; ++k) {
+            j = k + (k & (0U - k));
+            if (j <= new_max)
+                pSums[ j ] += pSums[ k ];
+        }
+    }
+
+    k = ++pL->count;
+    pL->slots[ k ] = pThread;
+    lottery_add(pL, k, pThread->weight);
+    pL->total += pThread->weight;
+
+    pThread->lottery_slot = k;
+    pThread->lottery_level = level;
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Withdraw a thread from the draw it was entered in, moving the
+ thread in the last slot into its place.
+ ***************************************************************/
+
+void CTScheduler::lottery_leave(Ct_thread * pThread) {
+    Ct_lottery * pL = lottery + pThread->lottery_level;
+    Ct_thread * pLast;
+    unsigned k = pThread->lottery_slot;
+
+    ASSERT( k > 0 && k <= pL->count );
+    ASSERT( pL->slots[ k ] == pThread );
+
+    lottery_add(pL, k, 0UL - pThread->weight);
+    pL->total -= pThread->weight;
+
+    if (k != pL->count) {
+        pLast = pL->slots[ pL->count ];
+        lottery_add(pL, pL->count, 0UL - pLast->weight);
+        lottery_add(pL, k, pLast->weight);
+        pL->slots[ k ] = pLast;
+        pLast->lottery_slot = k;
+    }
+
+    --pL->count;
+    pThread->lottery_slot = 0;
+}
+
+/****************************************************************
+ Change the weight of a thread entered in a draw.
+ ***************************************************************/
+
+void CTScheduler::lottery_reweigh(Ct_thread * pThread, unsigned weight) {
+    Ct_lottery * pL = lottery + pThread->lottery_level;
+
+    ASSERT( pThread->lottery_slot > 0 );
+
+    lottery_add(pL, pThread->lottery_slot,
+            (unsigned long) weight - pThread->weight);
+    pL->total += (unsigned long) weight - pThread->weight;
+}
+
+/****************************************************************
+ Forget every draw, once the queues have been emptied wholesale,
+ and release their memory.
+ ***************************************************************/
+
+void CTScheduler::clear_lottery(void) {
+    int i;
+
+    for (i = 0; i < CT_LOTTERY_LEVELS; ++i) {
+        free(lottery[ i ].sums);
+        free(lottery[ i ].slots);
+        lottery[ i ].sums = NULL;
+        lottery[ i ].slots = NULL;
+        lottery[ i ].count = 0;
+        lottery[ i ].max = 0;
+        lottery[ i ].total = 0;
+    }
+}
+
+#elif CT_POLICY == CT_POLICY_EDF
+
+/****************************************************************
+ Earliest deadline first.  A real-time thread declares a period
+ and a worst-case cost per dispatch, both in clock ticks.  Each
+ dispatch is one job, due one period after the previous job was
+ due.  Real-time threads sit in pri_q[ 0 ] in order of deadline,
+ so picking one takes constant time and queuing one takes time
+ proportional to the number of real-time threads ready.
+
+ Scheduling is work-conserving: a thread that stays active may
+ run its next job early.  A periodic thread should therefore wait
+ for its next release, e.g. with ct_wait_on_timeout().
+
+ If the total utilization, i.e. the sum of cost / period, is at
+ most 100%, EDF meets every deadline.  ct_create_rt_thread()
+ refuses any thread that would push it over.
+ ***************************************************************/
+
+/****************************************************************
+ Insert a real-time thread into pri_q[ 0 ] behind every thread
+ with the same or an earlier deadline.  We search from the tail,
+ since a new deadline is usually later than the others.
+ ***************************************************************/
+
+void CTScheduler::edf_insert(Ct_thread * pThread) {
+    Ct_thread * pPrev;
+
+    edf_release(pThread);
+
+    for (pPrev = pri_q[ 0 ].pPrev; pPrev != pri_q; pPrev = pPrev->pPrev)
+        if (ct_timecmp( &pPrev->rt_deadline, &pThread->rt_deadline) <= 0)
+            break;
+
+    pThread->pPrev = pPrev;
+    pThread->pNext = pPrev->pNext;
+    pPrev->pNext->pPrev = pThread;
+    pPrev->pNext = pThread;
+
+    mark_ready(0);
+}
+
+/****************************************************************
+ If a thread's deadline has passed while it was not runnable --
+ asleep, say -- start a new job due one period from now, rather
+ than charge it with a miss it could not help.
+ ***************************************************************/
+
+void CTScheduler::edf_release(Ct_thread * pThread) {
+    Ct_time now = read_clock();
+
+    if (ct_timecmp( &pThread->rt_deadline, &now) < 0) {
+        pThread->rt_deadline = now;
+        add_ticks( &pThread->rt_deadline, pThread->rt_period);
+    }
+}
+
+/****************************************************************
+ Note the completion of a job: count a miss if it finished late,
+ and make the next job due one period after this one.
+ ***************************************************************/
+
+void CTScheduler::edf_complete(Ct_thread * pThread) {
+    Ct_time now = read_clock();
+
+    if (ct_timecmp( &now, &pThread->rt_deadline) > 0) {
+        ++pThread->rt_misses;
+        ++edf_misses;
+    }
+
+    add_ticks( &pThread->rt_deadline, pThread->rt_period);
+}
+
+/****************************************************************
+ Create a real-time thread with the specified period and cost,
+ in clock ticks, and add it to the priority queue.  Its first
+ job is due one period from now.  Under CT_QUANTUM the cost also
+ serves as the thread's time budget per dispatch (see
+ ct_set_quantum_ticks()).
+
+ Return CT_ERROR, without creating a thread, if the period is
+ zero, the cost exceeds the period, or admitting the thread
+ would reserve more than 100% of the CPU.  None of these is a
+ fatal error.
+ ***************************************************************/
+
+int CTScheduler::ct_create_rt_thread(Ct_handle * pHandle,
+        unsigned long period, unsigned long cost, void * pData,
+        Ct_step_function step, Ct_destructor destruct) {
+    unsigned long c = cost;
+    unsigned long p = period;
+    unsigned long util;
+    Ct_thread * pThread;
+
+    if (0 == period || cost > period) {
+        CTOut::ct_report_error("ct_create_rt_thread: invalid period or cost");
+        return CT_ERROR;
+    }
+
+    if ( !opened) {
+        ct_open();
+        opened = 1;
+    }
+
+    /* Compute cost / period in parts of CT_EDF_SCALE, rounding */
+    /* up.  If the product would overflow, lose precision from  */
+    /* both terms, still rounding the cost up. */
+
+    while (c > ULONG_MAX / CT_EDF_SCALE) {
+        c = c / 2 + c % 2;
+        p /= 2;
+    }
+    util = (c * CT_EDF_SCALE + p - 1) / p;
+    if (util > CT_EDF_SCALE)
+        util = CT_EDF_SCALE;
+
+    if (util > CT_EDF_SCALE - edf_util) {
+        CTOut::ct_report_error("ct_create_rt_thread: utilization would exceed 100%");
+        return CT_ERROR;
+    }
+
+    pThread = ctDataStore.ct_construct(0, pData, step, destruct);
+    if (NULL == pThread)
+        return CT_ERROR;
+
+    ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_REPLAY
+    note_creation(pThread);
+#endif
+
+    pThread->rt_period = period;
+    pThread->rt_util = util;
+#if defined CT_QUANTUM
+    pThread->quantum_ticks = cost;
+#endif
+    pThread->rt_deadline = read_clock();
+    add_ticks( &pThread->rt_deadline, period);
+
+    edf_util += util;
+    insert_thread(pThread);
+
+    if (pHandle != NULL) {
+        /* Provide a handle to the new thread */
+
+        pHandle->p = pThread;
+        pHandle->incarnation = pThread->incarnation;
+#if defined CT_THREADSAFE
+        pHandle->partition = partition_id;
+#endif
+    }
+
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Report the number of deadlines missed so far.
+ ***************************************************************/
+
+unsigned long CTScheduler::ct_deadline_misses(void) {
+    return edf_misses;
+}
+
+/****************************************************************
+ Report the CPU share reserved by real-time threads, in parts of
+ CT_EDF_SCALE.
+ ***************************************************************/
+
+unsigned long CTScheduler::ct_utilization(void) {
+    return edf_util;
+}
+
+#endif
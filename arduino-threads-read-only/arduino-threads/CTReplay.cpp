@@ -0,0 +1,338 @@
+/*****************************************************************
+ CTReplay -- encoding and decoding the log of a recorded schedule.
+ See CTReplay.h for the format.
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "CTReplay.h"
+#include "CTOut.h"
+#include "CTAssert.h"
+
+#if defined CT_REPLAY
+
+static const unsigned char header[ 5 ] = { 'C', 'T', 'R', 'P',
+        CT_REPLAY_VERSION };
+
+CTReplay::CTReplay() {
+    mode = CT_REPLAY_OFF;
+    writer = NULL;
+    reader = NULL;
+    len = 0;
+    pos = 0;
+    eof = 0;
+    peeked = -1;
+    peeked_loops = 0;
+    last_clock.tick = 0;
+    last_clock.era = 0;
+    thread_count = 0;
+    threads = NULL;
+    threads_max = 0;
+}
+
+CTReplay::~CTReplay() {
+    ct_stop();
+    free(threads);
+}
+
+/* ---------------- starting and stopping: ------------------------ */
+
+int CTReplay::ct_start_record(Ct_replay_writer w) {
+    if (mode != CT_REPLAY_OFF || NULL == w) {
+        CTOut::ct_report_error("ct_start_record: invalid request");
+        return CT_ERROR;
+    }
+
+    mode = CT_REPLAY_RECORD;
+    writer = w;
+    memcpy(buff, header, sizeof( header ));
+    len = sizeof( header );
+    return CT_OKAY;
+}
+
+int CTReplay::ct_start_replay(Ct_replay_reader r) {
+    unsigned i;
+
+    if (mode != CT_REPLAY_OFF || NULL == r) {
+        CTOut::ct_report_error("ct_start_replay: invalid request");
+        return CT_ERROR;
+    }
+
+    mode = CT_REPLAY_PLAY;
+    reader = r;
+    len = pos = 0;
+    eof = 0;
+    peeked = -1;
+
+    for (i = 0; i < sizeof( header ); ++i) {
+        if (get_byte() != header[ i ]) {
+            CTOut::ct_report_error("ct_start_replay: not a replay log");
+            mode = CT_REPLAY_OFF;
+            return CT_ERROR;
+        }
+    }
+
+    return CT_OKAY;
+}
+
+void CTReplay::ct_stop(void) {
+    if (CT_REPLAY_RECORD == mode) {
+        put_byte('e');
+        flush();
+    }
+
+    mode = CT_REPLAY_OFF;
+}
+
+int CTReplay::ct_exhausted(void) {
+    int tag = peek_tag();
+
+    return -1 == tag || 'e' == tag ? CT_TRUE : CT_FALSE;
+}
+
+/* ---------------- clock readings: ------------------------------- */
+
+/*****************************************************************
+ A reading usually follows the previous one closely, so we record
+ only the difference in ticks, inferring a new era if the tick
+ count went down.  Otherwise we record the whole reading.
+ ****************************************************************/
+
+void CTReplay::ct_put_clock(const Ct_time * pT) {
+    unsigned long era = last_clock.era;
+
+    if (pT->tick < last_clock.tick)
+        ++era;
+
+    if (pT->era == era) {
+        put_byte('c');
+        put_number(pT->tick - last_clock.tick);
+    }
+    else {
+        put_byte('C');
+        put_number(pT->tick);
+        put_number(pT->era);
+    }
+
+    last_clock = *pT;
+}
+
+int CTReplay::ct_get_clock(Ct_time * pT) {
+    if (take_tag('c')) {
+        pT->tick = last_clock.tick + get_number();
+        pT->era = last_clock.era;
+        if (pT->tick < last_clock.tick)
+            ++pT->era;
+    }
+    else
+        if (take_tag('C')) {
+            pT->tick = get_number();
+            pT->era = get_number();
+        }
+        else {
+            CTOut::ct_report_error("replay: expected a clock reading");
+            return CT_ERROR;
+        }
+
+    last_clock = *pT;
+    return CT_OKAY;
+}
+
+/* ---------------- thread creation: ------------------------------ */
+
+void CTReplay::ct_put_create(Ct_thread * pThread) {
+    pThread->replay_id = ++thread_count;
+    put_byte('n');
+    put_number((unsigned long) pThread->priority);
+}
+
+int CTReplay::ct_check_create(Ct_thread * pThread) {
+    if ( !take_tag('n')
+            || get_number() != (unsigned long) pThread->priority) {
+        CTOut::ct_report_error("replay: thread creation differs from log");
+        return CT_ERROR;
+    }
+
+    pThread->replay_id = ++thread_count;
+    return bind_thread(pThread);
+}
+
+/*****************************************************************
+ Remember a thread by its replay_id, growing the table as needed.
+ ****************************************************************/
+
+int CTReplay::bind_thread(Ct_thread * pThread) {
+    unsigned long i = pThread->replay_id;
+
+    if (i >= threads_max) {
+        unsigned long new_max = threads_max ? threads_max * 2 : 16;
+        Ct_handle * p;
+
+        while (new_max <= i)
+            new_max *= 2;
+
+        p = (Ct_handle *) realloc(threads, new_max * sizeof(Ct_handle));
+        if (NULL == p) {
+            CTOut::ct_report_error("replay: out of memory");
+            return CT_ERROR;
+        }
+
+        memset(p + threads_max, 0,
+                (new_max - threads_max) * sizeof(Ct_handle));
+        threads = p;
+        threads_max = new_max;
+    }
+
+    threads[ i ].p = pThread;
+    threads[ i ].incarnation = pThread->incarnation;
+    return CT_OKAY;
+}
+
+/* ---------------- posted events: -------------------------------- */
+
+#if defined CT_THREADSAFE
+
+void CTReplay::ct_put_post(unsigned long loops, const Ct_posted_event * pEv) {
+    const Ct_thread * pThread = (const Ct_thread *) pEv->addressee.p;
+    unsigned long id = 0;
+    unsigned i;
+
+    /* Name the addressee by order of creation, if it's still alive */
+
+    if (pThread != NULL && pThread->status != CT_STATUS_DEFUNCT
+            && pThread->incarnation == pEv->addressee.incarnation)
+        id = pThread->replay_id;
+
+    put_byte('p');
+    put_number(loops);
+    put_byte((unsigned char) pEv->ev_type);
+    put_number(pEv->type);
+    put_number(pEv->msg_len);
+    put_byte((unsigned char) pEv->dispatch_type);
+    put_number(id);
+    for (i = 0; i < pEv->msg_len; ++i)
+        put_byte(pEv->buff[ i ]);
+}
+
+int CTReplay::ct_get_post(unsigned long loops, Ct_posted_event * pEv) {
+    unsigned long id;
+    unsigned i;
+
+    if (peek_tag() != 'p' || peeked_loops != loops)
+        return CT_FALSE;
+
+    take_tag('p');
+    pEv->ev_type = (Ct_event_type) get_byte();
+    pEv->type = (Ct_msgtype) get_number();
+    pEv->msg_len = (size_t) get_number();
+    pEv->dispatch_type = (Ct_dispatch_type) get_byte();
+    id = get_number();
+    for (i = 0; i < pEv->msg_len && i < CT_MSG_BUF_LEN; ++i)
+        pEv->buff[ i ] = (unsigned char) get_byte();
+
+    if (id > 0 && id < threads_max)
+        pEv->addressee = threads[ id ];
+    else {
+        pEv->addressee.p = NULL;
+        pEv->addressee.incarnation = 0;
+    }
+
+    return CT_TRUE;
+}
+
+#endif
+
+/* ---------------- encoding: ------------------------------------- */
+
+void CTReplay::put_byte(unsigned char c) {
+    if (len >= CT_REPLAY_BUF)
+        flush();
+    buff[ len++ ] = c;
+}
+
+/*****************************************************************
+ Write a number seven bits at a time, low bits first, with the
+ high bit of each byte set if more follow.
+ ****************************************************************/
+
+void CTReplay::put_number(unsigned long n) {
+    while (n >= 0x80) {
+        put_byte((unsigned char) ( n | 0x80 ));
+        n >>= 7;
+    }
+    put_byte((unsigned char) n);
+}
+
+void CTReplay::flush(void) {
+    if (len > 0 && writer != NULL)
+        writer(buff, len);
+    len = 0;
+}
+
+/* ---------------- decoding: ------------------------------------- */
+
+/*****************************************************************
+ Return the next byte of the log, or -1 at the end.
+ ****************************************************************/
+
+int CTReplay::get_byte(void) {
+    if (pos >= len) {
+        if (eof)
+            return -1;
+
+        len = reader(buff, CT_REPLAY_BUF);
+        pos = 0;
+        if (0 == len) {
+            eof = 1;
+            return -1;
+        }
+    }
+
+    return buff[ pos++ ];
+}
+
+unsigned long CTReplay::get_number(void) {
+    unsigned long n = 0;
+    unsigned shift = 0;
+    int c;
+
+    do {
+        c = get_byte();
+        if (c < 0)
+            break;
+        n |= (unsigned long) ( c & 0x7F ) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return n;
+}
+
+/*****************************************************************
+ Return the next tag without consuming it, or -1 at the end.  For
+ a posted event, read the loop count along with the tag, since
+ it decides whether the event is due.
+ ****************************************************************/
+
+int CTReplay::peek_tag(void) {
+    if (peeked < 0) {
+        peeked = get_byte();
+        if ('p' == peeked)
+            peeked_loops = get_number();
+    }
+    return peeked;
+}
+
+/*****************************************************************
+ If the next tag is the one specified, consume it and return
+ CT_TRUE; otherwise return CT_FALSE.
+ ****************************************************************/
+
+int CTReplay::take_tag(int tag) {
+    if (peek_tag() != tag)
+        return CT_FALSE;
+
+    peeked = -1;
+    return CT_TRUE;
+}
+
+#endif
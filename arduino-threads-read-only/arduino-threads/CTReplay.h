@@ -0,0 +1,168 @@
+/*********************************************************************
+ CTReplay -- recording and replaying a schedule
+
+ Given the same threads, the scheduler makes the same decisions
+ except where it consults the outside world: clock readings, and
+ (with CT_THREADSAFE) events posted by other OS threads or other
+ partitions.  With CT_REPLAY defined, the scheduler can record each
+ of these inputs, in the order it meets them, to a compact binary
+ log; and later it can replay them from the log instead of from
+ the outside world, so as to reproduce the same schedule exactly.
+
+ The creation of each thread is logged too, so that a replay can
+ detect when it has strayed from the recording -- because the
+ program or its threads behave differently -- and stop with a
+ fatal error instead of carrying on meaninglessly.
+
+ The log passes through a user-supplied writer or reader function,
+ so that it may go to a file, a serial port, or whatever.  Its
+ records are a tag byte and a few variable-length integers:
+
+     'c' tick-delta            clock reading, relative to the last
+     'C' tick era              clock reading, in full
+     'n' priority              thread creation
+     'p' loops ev_type type len dispatch addressee data...
+                               posted event, taken after the
+                               specified number of scheduler loops
+     'e'                       end of log
+ ********************************************************************/
+
+#ifndef CTREPLAY_H_
+#define CTREPLAY_H_
+
+#if defined CT_REPLAY
+
+#include "ct.h"
+#include "ctpriv.h"
+
+#define CT_REPLAY_VERSION 1
+
+/* Bytes buffered between calls to the writer or reader: */
+
+#ifndef CT_REPLAY_BUF
+#define CT_REPLAY_BUF 64
+#endif
+
+typedef enum
+{
+    CT_REPLAY_OFF,
+    CT_REPLAY_RECORD,
+    CT_REPLAY_PLAY
+} Ct_replay_mode;
+
+class CTReplay {
+
+    public:
+
+        CTReplay();
+        virtual ~CTReplay();
+
+        /*****************************************************************
+         Start recording through the specified writer, or replaying
+         through the specified reader.  Either must happen before any
+         thread is created.  Return CT_ERROR if already started, or if
+         the log being replayed doesn't begin with a valid header.
+         ****************************************************************/
+
+        int ct_start_record(Ct_replay_writer writer);
+        int ct_start_replay(Ct_replay_reader reader);
+
+        /*****************************************************************
+         Finish: write the end of the log and flush it, if recording.
+         ****************************************************************/
+
+        void ct_stop(void);
+
+        int ct_recording(void) const {
+            return CT_REPLAY_RECORD == mode;
+        }
+
+        int ct_replaying(void) const {
+            return CT_REPLAY_PLAY == mode;
+        }
+
+        /*****************************************************************
+         Return CT_TRUE if a replay has consumed the whole log.
+         ****************************************************************/
+
+        int ct_exhausted(void);
+
+        /*****************************************************************
+         Log a clock reading, or fetch the next one from the log.  The
+         latter returns CT_ERROR if the log has something else next.
+         ****************************************************************/
+
+        void ct_put_clock(const Ct_time * pT);
+        int ct_get_clock(Ct_time * pT);
+
+        /*****************************************************************
+         Log the creation of a thread, or check that the log has the
+         same creation next, and remember the thread by its place in
+         the order of creation.  Return CT_ERROR if the log disagrees.
+         ****************************************************************/
+
+        void ct_put_create(Ct_thread * pThread);
+        int ct_check_create(Ct_thread * pThread);
+
+#if defined CT_THREADSAFE
+
+        /*****************************************************************
+         Log an event posted from outside, taken after the specified
+         number of scheduler loops since the last one.
+         ****************************************************************/
+
+        void ct_put_post(unsigned long loops, const Ct_posted_event * pEv);
+
+        /*****************************************************************
+         If the next thing in the log is an event posted after the
+         specified number of loops, fetch it into *pEv, addressed to
+         the corresponding thread of this run, and return CT_TRUE.
+         Otherwise return CT_FALSE.
+         ****************************************************************/
+
+        int ct_get_post(unsigned long loops, Ct_posted_event * pEv);
+
+        /*****************************************************************
+         Return CT_TRUE if the next thing in the log is a posted event.
+         ****************************************************************/
+
+        int ct_post_pending(void) {
+            return 'p' == peek_tag() ? CT_TRUE : CT_FALSE;
+        }
+#endif
+
+    private:
+
+        Ct_replay_mode mode;
+        Ct_replay_writer writer;
+        Ct_replay_reader reader;
+
+        unsigned char buff[ CT_REPLAY_BUF ];
+        unsigned len; /* bytes in buff */
+        unsigned pos; /* next byte to read from buff */
+        int eof; /* boolean: the reader has no more */
+        int peeked; /* next tag, already read, or -1 */
+        unsigned long peeked_loops; /* loop count, if that tag is 'p' */
+
+        Ct_time last_clock;
+        unsigned long thread_count;
+
+        /* For replay, the threads of this run, indexed by */
+        /* order of creation, with their incarnations: */
+
+        Ct_handle * threads;
+        unsigned long threads_max;
+
+        void put_byte(unsigned char c);
+        void put_number(unsigned long n);
+        void flush(void);
+        int get_byte(void);
+        unsigned long get_number(void);
+        int peek_tag(void);
+        int take_tag(int tag);
+        int bind_thread(Ct_thread * pThread);
+};
+
+#endif
+
+#endif /*CTREPLAY_H_*/
@@ -0,0 +1,96 @@
+/*****************************************************************
+ CTRing -- a bounded, lock-free, single-producer single-consumer
+ ring of posted events.
+ ****************************************************************/
+
+#include <string.h>
+#include "CTRing.h"
+#include "CTAssert.h"
+
+#if defined CT_THREADSAFE
+
+CTRing::CTRing() {
+    head = 0;
+    tail = 0;
+}
+
+CTRing::~CTRing() {
+}
+
+/*****************************************************************
+ Copy an event onto the ring.  Only the producing OS thread may
+ call this function.  Return CT_ERROR if the ring is full or the
+ message is too long to carry by value, CT_OKAY otherwise.
+ ****************************************************************/
+
+int CTRing::ct_push(Ct_event_type ev_type, Ct_msgtype type,
+        const void * pData, size_t len, Ct_handle addressee) {
+    Ct_posted_event * pEv;
+    unsigned long t;
+
+    if (len > CT_MSG_BUF_LEN || (NULL == pData && len > 0))
+        return CT_ERROR;
+
+    t = tail; /* only we write it */
+    if (t - __atomic_load_n( &head, __ATOMIC_ACQUIRE) >= CT_RING_SLOTS)
+        return CT_ERROR; /* full */
+
+    pEv = slots + (t & (CT_RING_SLOTS - 1));
+    pEv->ev_type = ev_type;
+    pEv->type = type;
+    pEv->msg_len = len;
+    pEv->dispatch_type = CT_DISPATCH_ADDRESSEE;
+    pEv->addressee = addressee;
+    if (len > 0)
+        memcpy(pEv->buff, pData, len);
+
+    /* Publish the filled slot to the consumer */
+
+    __atomic_store_n( &tail, t + 1, __ATOMIC_RELEASE);
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Copy the oldest event, if any, into *pEv.  Only the consuming
+ OS thread may call this function.  Return CT_TRUE if there was
+ an event, CT_FALSE if the ring was empty.
+ ****************************************************************/
+
+int CTRing::ct_pop(Ct_posted_event * pEv) {
+    const Ct_posted_event * pSrc;
+    unsigned long h;
+
+    ASSERT( pEv != NULL );
+
+    h = head; /* only we write it */
+    if (h == __atomic_load_n( &tail, __ATOMIC_ACQUIRE))
+        return CT_FALSE; /* empty */
+
+    pSrc = slots + (h & (CT_RING_SLOTS - 1));
+    pEv->ev_type = pSrc->ev_type;
+    pEv->type = pSrc->type;
+    pEv->msg_len = pSrc->msg_len;
+    pEv->dispatch_type = pSrc->dispatch_type;
+    pEv->addressee = pSrc->addressee;
+    if (pSrc->msg_len > 0)
+        memcpy(pEv->buff, pSrc->buff, pSrc->msg_len);
+
+    /* Hand the slot back to the producer */
+
+    __atomic_store_n( &head, h + 1, __ATOMIC_RELEASE);
+    return CT_TRUE;
+}
+
+/*****************************************************************
+ Return CT_TRUE if there is an event to pop.  Only the consuming
+ OS thread may call this function.
+ ****************************************************************/
+
+int CTRing::ct_pending(void) {
+    if (head != __atomic_load_n( &tail, __ATOMIC_ACQUIRE))
+        return CT_TRUE;
+    else
+        return CT_FALSE;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*****************************************************************
+ CTRing -- a bounded, lock-free, single-producer single-consumer
+ ring of posted events, carrying messages from one partition's
+ scheduler to another's.
+
+ Each index is written by only one side: the producer advances
+ tail, the consumer advances head.  Neither side ever waits for
+ the other, and no atomic read-modify-write is needed, so a ring
+ costs two ordinary loads and a store per event.
+
+ Compiled only if CT_THREADSAFE is defined.
+ ****************************************************************/
+
+#ifndef CTRING_H_
+#define CTRING_H_
+
+#include "ct.h"
+#include "ctpriv.h"
+
+#if defined CT_THREADSAFE
+
+#if ( CT_RING_SLOTS & ( CT_RING_SLOTS - 1 ) ) != 0
+#error "CT_RING_SLOTS must be a power of two"
+#endif
+
+/* Size of a cache line, to keep the producer's */
+/* and the consumer's indexes apart: */
+
+#ifndef CT_CACHE_LINE
+#define CT_CACHE_LINE 64
+#endif
+
+class CTRing {
+
+    public:
+
+        CTRing();
+        virtual ~CTRing();
+
+        /*****************************************************************
+         Copy an event onto the ring.  Only the producing OS thread may
+         call this function.  Return CT_ERROR if the ring is full or the
+         message is too long to carry by value, CT_OKAY otherwise.
+         ****************************************************************/
+
+        int ct_push(Ct_event_type ev_type, Ct_msgtype type,
+                const void * pData, size_t len, Ct_handle addressee);
+
+        /*****************************************************************
+         Copy the oldest event, if any, into *pEv.  Only the consuming
+         OS thread may call this function.  Return CT_TRUE if there was
+         an event, CT_FALSE if the ring was empty.
+         ****************************************************************/
+
+        int ct_pop(Ct_posted_event * pEv);
+
+        /*****************************************************************
+         Return CT_TRUE if there is an event to pop.  Only the consuming
+         OS thread may call this function.
+         ****************************************************************/
+
+        int ct_pending(void);
+
+    private:
+
+        Ct_posted_event slots [CT_RING_SLOTS ];
+
+        unsigned long head; /* next slot to pop; written by consumer */
+        char pad [CT_CACHE_LINE ];
+        unsigned long tail; /* next slot to push; written by producer */
+};
+
+#endif
+
+#endif /*CTRING_H_*/
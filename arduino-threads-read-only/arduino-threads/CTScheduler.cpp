@@ -7,6 +7,9 @@ class CTDataStore;
 // Function that handles the creation and setup of instances
 
 CTScheduler::CTScheduler() {
+#if CT_POLICY == CT_POLICY_LOTTERY
+    int i;
+#endif
     
     pCurr_thread = NULL;
 
@@ -28,12 +31,120 @@ CTScheduler::CTScheduler() {
     fatal_error = 0; /* boolean for noting fatal error */
     halted = 0; /* boolean for halting scheduler  */
     self_msg = 0; /* boolean for message to self */
+    self_priority = CT_PRIORITY_MAX;
+    handoff = 0; /* boolean for running the addressee next */
+    handoff_run = 0;
+    pHandoff_to = NULL;
+    sender_priority = 0;
+
+#if defined CT_WAKEUPS
+    wake_count = 0;
+    wake_type_count = 0;
+    wake_all = 0;
+    wake_all_priority = CT_PRIORITY_MAX;
+    wakeups = 0;
+    wakeup_stats.posted = 0;
+    wakeup_stats.coalesced = 0;
+    wakeup_stats.delivered = 0;
+    wakeup_stats.overflowed = 0;
+
+    wake_event.pNext = NULL;
+    wake_event.type = 0;
+    wake_event.ev_type = CT_EV_ENQ;
+    wake_event.priority = 0;
+#if defined CT_MAILBOX
+    wake_event.reserved = 0;
+#endif
+    wake_event.msg_len = 0;
+    wake_event.refcount = 0;
+    wake_event.pData = NULL;
+    wake_event.dispatch_type = CT_DISPATCH_ADDRESSEE;
+    wake_event.addressee.p = NULL;
+    wake_event.addressee.incarnation = 0;
+#ifndef NDEBUG
+    wake_event.magic = EVENT_MAGIC;
+#endif
+#endif
 
     /* function pointers for user exits, to be invoked */
     /* just before and just after each thread step:    */
 
     pre_function = NULL;
     post_function = NULL;
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    lottery_state = 2463534242UL;
+    for (i = 0; i < CT_LOTTERY_LEVELS; ++i) {
+        lottery[ i ].sums = NULL;
+        lottery[ i ].slots = NULL;
+        lottery[ i ].count = 0;
+        lottery[ i ].max = 0;
+        lottery[ i ].total = 0;
+    }
+#endif
+
+#if defined CT_THREADSAFE
+    partitions = NULL;
+    partition_id = 0;
+    partition_idle = 0;
+#endif
+
+#if defined CT_WORKERS
+    {
+        pthread_mutexattr_t attr;
+
+        pthread_mutexattr_init( &attr);
+        pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init( &sched_lock, &attr);
+        pthread_mutexattr_destroy( &attr);
+    }
+    pthread_cond_init( &work_cond, NULL);
+    worker_count = CT_WORKERS;
+    napping = 0;
+    claimed_count = 0;
+    workers_done = 0;
+#endif
+
+#if defined CT_REPLAY
+    replay_loops = 0;
+#endif
+
+#if defined CT_WATCHDOG
+    overrun_handler = NULL;
+    overrun_penalty = 0;
+#if defined CT_WATCHDOG_BACKTRACE
+    watchdog_created = 0;
+    hard_limit = 0;
+#endif
+#endif
+
+#if defined CT_GROUPS
+    clear_groups();
+#endif
+
+#if defined CT_FIBERS
+    free_fibers = NULL;
+#endif
+
+#if defined CT_EPOLL
+    epoll_fd = -1;
+    fd_waits = NULL;
+    fd_waits_max = 0;
+    fd_wait_count = 0;
+    epoll_countdown = CT_EPOLL_LOOPS;
+#if defined CT_AIO
+    aio_watch_fd = -1;
+#endif
+#endif
+
+#if defined CT_TIMEOUT
+    timeout_count = 0;
+    wheel_time.tick = 0;
+    wheel_time.era = 0;
+    ticker = default_clock;
+    idle_function = NULL;
+    idling = 0;
+#endif
  
 }
 
@@ -70,10 +181,59 @@ CTScheduler::CTScheduler( CTDataStore& ctDataStore ) {
 
     countdown = init_countdown;
 
+#if defined CT_TIMEOUT
+    idle_stats.idle_ticks = 0;
+    idle_stats.busy_ticks = 0;
+    idle_stats.idle_count = 0;
+    idling = 0;
+    busy_since = read_clock();
+#endif
+
+#if defined CT_WORKERS
+
+    /* Run the threads on all the workers, this OS thread included */
+
+    run_workers();
+#else
     while ( !halted) {
+#if defined CT_THREADSAFE
+#if defined CT_REPLAY
+        if (replay.ct_replaying()) {
+            Ct_posted_event posted;
+
+            /* Take posted events from the log, not from outside */
+
+            while (replay.ct_get_post(replay_loops, &posted)) {
+                posted.addressee.partition = partition_id;
+                replay_loops = 0;
+                enqueue_posted( &posted);
+            }
+        }
+        else
+#endif
+        {
+            /* Pick up any events posted by other OS threads */
+
+            if (inbox.ct_pending())
+                drain_inbox();
+
+            /* ...and any messages from other partitions */
+
+            if (partitions != NULL)
+                drain_partitions();
+        }
+#endif
+#if defined CT_REPLAY
+        ++replay_loops;
+#endif
+
         /* Dispatch any pending events to the relevant threads */
 
-        if (ev_head != NULL)
+        if (ev_head != NULL || self_msg
+#if defined CT_WAKEUPS
+                || wakeups
+#endif
+                )
             dispatch_event_queue();
 
 #if defined CT_TIMEOUT
@@ -83,35 +243,132 @@ CTScheduler::CTScheduler( CTDataStore& ctDataStore ) {
         if( check_timeouts() )
         dispatch_event_queue();
 #endif
+#if defined CT_EPOLL
+
+        /* Now and then, wake any threads whose descriptors are */
+        /* ready, without waiting for the others: */
+
+        if (fd_wait_count > 0 && 0 == --epoll_countdown) {
+            epoll_countdown = CT_EPOLL_LOOPS;
+            poll_fds(0);
+        }
+#endif
+#if defined CT_AIO
+
+        /* Submit the I/O queued by the last step, in one batch, */
+        /* and pass on any results: */
+
+        if (aio.ct_outstanding() > 0)
+            poll_aio(CT_FALSE);
+#endif
 
         /* Select the next thread to run */
 
         pick_thread();
         if (NULL == pCurr_thread) {
-#if defined CT_TIMEOUT
-            if( CT_STATUS_TIMEOUT == sleepers.pNext->status )
-            /* Keep waiting for timeout */
+#if defined CT_GROUPS
+            if (groups_parked()) {
+                /* Only capped groups have work.  Wait out the */
+                /* window, without blocking on anything else.  */
+
+                wait_window();
+                continue;
+            }
+#endif
+#if defined CT_AIO
+            if (aio.ct_outstanding() > 0) {
+                int wait = CT_TRUE;
 
-            continue;
+                /* Block until some I/O completes -- unless a timeout */
+                /* or a file descriptor may wake a thread sooner, in  */
+                /* which case we sleep on all of them below. */
+
+#if defined CT_TIMEOUT
+                if (timeout_count > 0)
+                    wait = CT_FALSE;
+#endif
+#if defined CT_EPOLL
+                if (fd_wait_count > 0)
+                    wait = CT_FALSE;
+#endif
+                if (wait) {
+                    poll_aio(CT_TRUE);
+                    continue;
+                }
+            }
+#endif
+#if defined CT_TIMEOUT
+            if( timeout_count > 0
+#if defined CT_EPOLL
+                    || fd_wait_count > 0
+#endif
+                    )
+            {
+                /* Keep waiting for timeout, sleeping */
+                /* if we have been told how to.       */
+
+                enter_idle();
+                continue;
+            }
             else
+#elif defined CT_EPOLL
+            if (fd_wait_count > 0) {
+                /* Nothing to do until a descriptor is ready, */
+                /* or some I/O completes */
+
+                poll_fds( -1);
+                continue;
+            }
+            else
+#endif
+#if defined CT_THREADSAFE
+#if defined CT_REPLAY
+            if (replay.ct_post_pending())
+                continue; /* more events to replay */
+            else
+#endif
+            if (partitions != NULL) {
+                /* Other partitions may yet send us something.  */
+                /* Carry on until the whole group is finished. */
+
+                if ( !partition_idle) {
+                    partitions->ct_partition_idle();
+                    partition_idle = 1;
+                }
+
+                if ( !partitions->ct_quiescent()) {
+                    partitions->ct_nap(partition_id);
+                    continue;
+                }
+            }
 #endif
             /* No active threads -- we're done. */
 
             break;
         }
         else {
+#if defined CT_TIMEOUT
+            if( idling )
+                leave_idle();
+#endif
             ASSERT( CT_MAGIC == pCurr_thread->magic );
             rc = step();
             if (rc != CT_OKAY)
                 break;
         }
 
+#if CT_POLICY == CT_POLICY_MULTILEVEL
+
+        /* The proportional policies need no aging */
+
         --countdown;
         if ( 0 == countdown) {
             scrunch_queue();
             countdown = init_countdown;
         }
+#endif
     }
+#endif
 
     if (fatal_error) {
         CTOut::ct_report_error("ct_schedule: halted with fatal error");
@@ -125,6 +382,10 @@ CTScheduler::CTScheduler( CTDataStore& ctDataStore ) {
 }
 
 CTScheduler::~CTScheduler() {
+#if defined CT_WORKERS
+    pthread_cond_destroy( &work_cond);
+    pthread_mutex_destroy( &sched_lock);
+#endif
 }
 
 /****************************************************************
@@ -134,18 +395,54 @@ CTScheduler::~CTScheduler() {
  ***************************************************************/
 
 void CTScheduler::pick_thread(void) {
-    int i;
+#if defined CT_GROUPS
 
-    /* Scan the priority levels for a non-empty queue, i.e. one */
-    /* that doesn't just point to itself: */
+    /* Set aside any thread whose group has had its share, until */
+    /* the other groups catch up (see CTGroup.cpp): */
 
-    for (i = 0; i <= CT_PRIORITY_MAX; ++i) {
-        if (pri_q[ i ].pNext != pri_q + i) {
-            pCurr_thread = pri_q[ i ].pNext;
-            ASSERT( CT_MAGIC == pCurr_thread->magic );
-            curr_priority = i;
-            return;
+    for (;;) {
+        pick_ready();
+        if (pCurr_thread != NULL) {
+#if CT_POLICY == CT_POLICY_EDF
+            if (pCurr_thread->rt_period > 0)
+                return;
+#endif
+            if ( !group_held(groups + pCurr_thread->group))
+                return;
+            park_thread(pCurr_thread);
         }
+        else if ( !release_groups())
+            return; /* none parked, or all held till the window ends */
+    }
+#else
+    pick_ready();
+#endif
+}
+
+/****************************************************************
+ Select the runnable thread that the scheduling policy would run
+ next, if any, as for pick_thread().
+ ***************************************************************/
+
+void CTScheduler::pick_ready(void) {
+    int i;
+
+    /* Find the first non-empty queue: */
+
+    i = next_ready( 0 );
+    if (i >= 0) {
+        ASSERT( pri_q[ i ].pNext != pri_q + i );
+#if CT_POLICY == CT_POLICY_STRIDE
+        i = advance_virtual_time(i);
+#endif
+#if CT_POLICY == CT_POLICY_LOTTERY
+        pCurr_thread = draw_lottery(i);
+#else
+        pCurr_thread = pri_q[ i ].pNext;
+#endif
+        ASSERT( CT_MAGIC == pCurr_thread->magic );
+        curr_priority = i;
+        return;
     }
 
     /* If we reach this point, then we didn't find a thread. */
@@ -154,54 +451,342 @@ void CTScheduler::pick_thread(void) {
     curr_priority = -1;
 }
 
+#if defined CT_READY_BITMAP
+
 /****************************************************************
- Invoke the specified cheap thread for one step.  If the thread
- is now defunct, discard it.  Otherwise move it to the appropriate
+ Return the index of the lowest bit set in a non-zero word.
+ ***************************************************************/
+
+static int lowest_bit(unsigned long word) {
+#if defined __GNUC__
+    return __builtin_ctzl(word);
+#else
+    int n = 0;
+
+    ASSERT( word != 0 );
+
+    while ( !(word & 1UL)) {
+        word >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/****************************************************************
+ Note in the readiness bitmap that a priority queue is non-empty.
+ ***************************************************************/
+
+void CTScheduler::mark_ready(int i) {
+    ASSERT( i >= 0 && i <= CT_PRIORITY_MAX );
+
+    ready_map[ i / CT_READY_BITS ] |= 1UL << (i % CT_READY_BITS);
+    ready_summary |= 1UL << (i / CT_READY_BITS);
+}
+
+/****************************************************************
+ Note in the readiness bitmap that a priority queue is empty.
+ ***************************************************************/
+
+void CTScheduler::mark_empty(int i) {
+    int w;
+
+    ASSERT( i >= 0 && i <= CT_PRIORITY_MAX );
+
+    w = i / CT_READY_BITS;
+    ready_map[ w ] &= ~(1UL << (i % CT_READY_BITS));
+    if ( 0 == ready_map[ w ])
+        ready_summary &= ~(1UL << w);
+}
+
+/****************************************************************
+ Return the first non-empty priority level at or after level i,
+ or -1 if there is none.
+ ***************************************************************/
+
+int CTScheduler::next_ready(int i) {
+    int w;
+    unsigned long word;
+    unsigned long summary;
+
+    if (i > CT_PRIORITY_MAX)
+        return -1;
+
+    /* Look first in the word containing level i, */
+    /* ignoring the bits below level i: */
+
+    w = i / CT_READY_BITS;
+    word = ready_map[ w ] & (~0UL << (i % CT_READY_BITS));
+    if (word != 0)
+        return w * CT_READY_BITS + lowest_bit(word);
+
+    /* Otherwise let the summary tell us which */
+    /* later word, if any, has a bit set: */
+
+    if (w + 1 >= CT_READY_BITS)
+        return -1;
+
+    summary = ready_summary & (~0UL << (w + 1));
+    if ( 0 == summary)
+        return -1;
+
+    w = lowest_bit(summary);
+    return w * CT_READY_BITS + lowest_bit(ready_map[ w ]);
+}
+
+#else
+
+/****************************************************************
+ Without a readiness bitmap, an empty priority queue is one that
+ just points to itself, so there is nothing to note.
+ ***************************************************************/
+
+void CTScheduler::mark_ready(int i) {
+    ASSERT( i >= 0 && i <= CT_PRIORITY_MAX );
+    ASSERT( pri_q[ i ].pNext != pri_q + i );
+}
+
+void CTScheduler::mark_empty(int i) {
+    ASSERT( i >= 0 && i <= CT_PRIORITY_MAX );
+}
+
+/****************************************************************
+ Return the first non-empty priority level at or after level i,
+ or -1 if there is none, by scanning the levels in turn.
+ ***************************************************************/
+
+int CTScheduler::next_ready(int i) {
+    if (i < 0)
+        i = 0;
+
+    for (; i <= CT_PRIORITY_MAX; ++i) {
+        if (pri_q[ i ].pNext != pri_q + i)
+            return i;
+    }
+    return -1;
+}
+
+#endif
+
+/****************************************************************
+ Remove a thread from whatever list it's on, by stitching the
+ adjacent threads together.  If that leaves a priority queue
+ empty, update any readiness bitmap accordingly.  The thread's
+ own pointers are left dangling for the caller to deal with.
+ ***************************************************************/
+
+void CTScheduler::unlink_thread(Ct_thread * pThread) {
+#if defined CT_READY_BITMAP
+    Ct_thread * pAnchor;
+#endif
+
+    ASSERT( pThread != NULL );
+    ASSERT( CT_MAGIC == pThread->pNext->magic );
+    ASSERT( CT_MAGIC == pThread->pPrev->magic );
+
+    pThread->pNext->pPrev = pThread->pPrev;
+    pThread->pPrev->pNext = pThread->pNext;
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    if (pThread->lottery_slot != 0)
+        lottery_leave(pThread);
+#endif
+
+#if defined CT_READY_BITMAP
+
+    /* A list left empty consists of nothing but its dummy */
+    /* anchor.  Of the dummies, only those in pri_q have   */
+    /* bits in the readiness bitmap. */
+
+    pAnchor = pThread->pNext;
+    if (pAnchor == pThread->pPrev && CT_STATUS_DUMMY == pAnchor->status
+            && pAnchor >= pri_q && pAnchor <= pri_q + CT_PRIORITY_MAX)
+        mark_empty(pAnchor - pri_q);
+#endif
+}
+
+/****************************************************************
+ Invoke the specified cheap thread for one step -- or for several,
+ if it has a run quantum larger than one.  If the thread is now
+ defunct, discard it.  Otherwise move it to the appropriate
  priority queue, or to the sleeper list.
+
+ Taking several steps per dispatch saves unlinking and reinserting
+ the thread between steps, which for a thread with a tiny step
+ function may cost more than the step itself.
+
+ Under CT_WORKERS, called with the scheduler lock held; the lock is
+ released while the thread's step function runs.
  ***************************************************************/
 
 int CTScheduler::step() {
     int rc= CT_OKAY;
     int thread_rc;
+    unsigned steps = 0;
+#if defined CT_STATS || defined CT_WATCHDOG || defined CT_GROUPS
+    Ct_cycles started;
+    Ct_cycles elapsed;
+#endif
 
     ASSERT( pCurr_thread != NULL );
     ASSERT( CT_MAGIC == pCurr_thread->magic );
 
-    /* Invoke the pre-function, if one has been installed */
+#if defined CT_STATS
+    pCurr_thread->stats.wait_cycles += CT_CYCLES() - pCurr_thread->ready_since;
+#endif
 
-    if (pre_function != NULL) {
-        rc = pre_function(pCurr_thread->pData);
-        if (rc != CT_OKAY)
-            return CT_ERROR;
-    }
+#if defined CT_QUANTUM && defined CT_TIMEOUT
+    if (pCurr_thread->quantum_ticks > 0)
+        quantum_start = read_clock();
+#endif
 
-    /* Invoke the thread for one step, then any post-function: */
+    /* Whatever the thread sends carries its effective priority, */
+    /* including any it inherited from the messages it answers: */
 
-#ifdef CT_RETURN
-    if( setjmp( jumper ) ) /* if returning from longjmp() */
-    thread_rc = jump_rc; /* as set by ct_return() */
+#if CT_POLICY == CT_POLICY_EDF
+    if (pCurr_thread->rt_period > 0)
+        sender_priority = 0;
     else
 #endif
-    thread_rc = pCurr_thread->step(pCurr_thread->pData);
+    sender_priority = inherit_priority(pCurr_thread, pCurr_thread->priority);
+
+    do {
+        /* Invoke the pre-function, if one has been installed */
+
+        if (pre_function != NULL) {
+            rc = pre_function(pCurr_thread->pData);
+            if (rc != CT_OKAY) {
+                sender_priority = 0;
+#if defined CT_WORKERS
+                release_claim(pCurr_thread);
+#endif
+                return CT_ERROR;
+            }
+        }
+
+        /* Invoke the thread for one step, then any post-function: */
+
+#if defined CT_STATS || defined CT_WATCHDOG || defined CT_GROUPS
+        started = CT_CYCLES();
+#endif
+#if defined CT_WATCHDOG_BACKTRACE
+        if (hard_limit > 0)
+            set_watchdog(hard_limit);
+#endif
+        CT_TRACE_EVENT( CT_TRACE_STEP_BEGIN, pCurr_thread, 0 );
+
+        /* Under CT_WORKERS, the other workers carry on meanwhile */
 
-    if (post_function != NULL && CT_OKAY == thread_rc)
-        thread_rc = post_function(pCurr_thread->pData);
+        CT_UNLOCK();
+
+#if defined CT_COROUTINES
+        if (pCurr_thread->coroutine != NULL)
+            thread_rc = resume_coroutine(pCurr_thread);
+        else
+#endif
+#if defined CT_FIBERS
+        if (pCurr_thread->fiber != NULL)
+            thread_rc = resume_fiber(pCurr_thread);
+        else
+#endif
+#ifdef CT_RETURN
+        if( setjmp( jumper ) ) /* if returning from longjmp() */
+        thread_rc = jump_rc; /* as set by ct_return() */
+        else
+#endif
+        thread_rc = pCurr_thread->step(pCurr_thread->pData);
+
+        CT_LOCK();
+
+        CT_TRACE_EVENT( CT_TRACE_STEP_END, pCurr_thread,
+                (unsigned long) thread_rc );
+
+#if defined CT_WATCHDOG_BACKTRACE
+        if (hard_limit > 0)
+            set_watchdog( 0 );
+#endif
+#if defined CT_STATS || defined CT_WATCHDOG || defined CT_GROUPS
+        elapsed = CT_CYCLES() - started;
+#endif
+#if defined CT_WATCHDOG
+        if (pCurr_thread->step_budget > 0
+                && elapsed > pCurr_thread->step_budget)
+            note_overrun(elapsed);
+#endif
+#if defined CT_STATS
+        ++pCurr_thread->stats.steps;
+        pCurr_thread->stats.step_cycles += elapsed;
+        if (elapsed > pCurr_thread->stats.max_step_cycles)
+            pCurr_thread->stats.max_step_cycles = elapsed;
+#endif
+#if defined CT_GROUPS
+        charge_group(pCurr_thread, started, elapsed);
+#endif
+
+        if (post_function != NULL && CT_OKAY == thread_rc)
+            thread_rc = post_function(pCurr_thread->pData);
+
+        ++steps;
+#if defined CT_QUANTUM
+    } while (CT_OKAY == thread_rc && continue_quantum(steps));
+#else
+    } while (0);
+#endif
+
+    sender_priority = 0;
+
+#if CT_POLICY == CT_POLICY_STRIDE
+
+    /* Charge the thread for the steps it took */
+
+    pCurr_thread->pass += pCurr_thread->stride * steps;
+#elif CT_POLICY == CT_POLICY_EDF
+
+    /* The dispatch completes a job of a real-time thread */
+
+    if (pCurr_thread->rt_period > 0)
+        edf_complete(pCurr_thread);
+#endif
+#if defined CT_PERIODIC
+
+    /* A periodic thread waits for its next release */
+
+    if (pCurr_thread->period > 0)
+        periodic_complete(pCurr_thread);
+#endif
+
+#if defined CT_QUANTUM
+    ++pCurr_thread->quantum_stats.dispatches;
+    pCurr_thread->quantum_stats.steps += steps;
+    if (steps >= pCurr_thread->quantum)
+        ++pCurr_thread->quantum_stats.exhausted;
+#endif
+
+#if defined CT_WORKERS
+
+    /* The thread is on no list, only held by this worker */
+
+    pCurr_thread->claim_level = -1;
+    --claimed_count;
+#else
 
     /* Remove the thread from the priority queue by stitching  */
     /* the adjacent threads together.   We'll let the thread's */
     /* own forward and backward pointers dangle harmlessly for */
     /* a little while... */
 
-    ASSERT( CT_MAGIC == pCurr_thread->pNext->magic );
-    ASSERT( CT_MAGIC == pCurr_thread->pPrev->magic );
-
-    pCurr_thread->pNext->pPrev = pCurr_thread->pPrev;
-    pCurr_thread->pPrev->pNext = pCurr_thread->pNext;
+    unlink_thread(pCurr_thread);
+#endif
 
     /* Don't let a thread put itself to sleep if */
     /* it still has a message in its input queue */
+    /* -- unless a coroutine awaits another type */
 
-    if (pCurr_thread->msg_q != NULL && CT_STATUS_ASLEEP == pCurr_thread->status)
+    if (pCurr_thread->msg_q != NULL && CT_STATUS_ASLEEP == pCurr_thread->status
+#if defined CT_COROUTINES
+            && !coroutine_awaiting(pCurr_thread)
+#endif
+            )
         pCurr_thread->status = CT_STATUS_ACTIVE;
 
     switch (pCurr_thread->status) {
@@ -226,155 +811,582 @@ int CTScheduler::step() {
 #if defined CT_TIMEOUT
             case CT_STATUS_TIMEOUT :
 
-            insert_timeout();
+            insert_timeout( pCurr_thread );
+            break;
+#endif
+
+        case CT_STATUS_DEFUNCT:
+#if defined CT_MAILBOX
+
+            /* Anybody waiting for room in its mailbox may go */
+
+            if (pCurr_thread->msg_blocked)
+                wake_blocked_senders(pCurr_thread);
+#endif
+
+#if defined CT_EPOLL
+
+            /* Stop watching any descriptor it was waiting on */
+
+            if (pCurr_thread->wait_fd >= 0)
+                drop_fd_wait(pCurr_thread);
+#endif
+#if CT_POLICY == CT_POLICY_EDF
+
+            /* Give up the thread's reservation, if any */
+
+            edf_util -= pCurr_thread->rt_util;
+#endif
+
+            /* Deallocate the thread.  This function call sets */
+            /* pCurr_thread to NULL.  Consequently any message */
+            /* dispatching later will know better than to send */
+            /* a message to this defunct thread. */
+
+            ctDataStore.ct_destruct( &pCurr_thread);
+
+            break;
+
+        default:
+            CTOut::ct_report_error("step: invalid thread status");
+            rc = CT_ERROR;
             break;
+    }
+
+    if (thread_rc != CT_OKAY)
+        rc = CT_ERROR;
+
+    return rc;
+}
+
+#if defined CT_QUANTUM
+
+/****************************************************************
+ Decide whether the current thread, having taken the specified
+ number of steps in this dispatch, may take another.  It may do
+ so only if it is still active, has quantum left, and nothing
+ has happened that the scheduler ought to attend to first: a
+ pending event, a penalty, a halt, or a thread of higher
+ priority becoming ready.
+ ***************************************************************/
+
+int CTScheduler::continue_quantum(unsigned steps) {
+#if defined CT_WORKERS
+    int i;
+#endif
+
+    if (steps >= pCurr_thread->quantum)
+        return CT_FALSE;
+
+    if (pCurr_thread->status != CT_STATUS_ACTIVE || halted
+            || ev_head != NULL || pri_penalty != 0)
+        return CT_FALSE;
+#if defined CT_WAKEUPS
+    if (wakeups)
+        return CT_FALSE;
+#endif
+
+#if defined CT_WORKERS
+
+    /* No level before the one the thread was taken from may be */
+    /* ready.  (It left its queue then, so the level itself may */
+    /* be empty now.) */
+
+    i = next_ready( 0 );
+    if (i >= 0 && i < curr_priority)
+        return CT_FALSE;
+#else
+
+    /* The current thread is still in its own queue, */
+    /* so no level before it may be ready: */
+
+    if (next_ready( 0 ) != curr_priority)
+        return CT_FALSE;
+#endif
+
+#if CT_POLICY == CT_POLICY_EDF
+
+    /* Nor may any earlier deadline have arrived */
+
+    if (0 == curr_priority && pri_q[ 0 ].pNext != pCurr_thread)
+        return CT_FALSE;
+#endif
+
+#if defined CT_TIMEOUT
+    if (pCurr_thread->quantum_ticks > 0) {
+        Ct_time t = read_clock();
+
+        if (ticks_between( &quantum_start, &t) >= pCurr_thread->quantum_ticks)
+            return CT_FALSE;
+    }
+#endif
+
+    return CT_TRUE;
+}
+
+#endif
+
+/*****************************************************************
+ Append the specified cheap thread to the queue at the appropriate
+ priority level.
+ ****************************************************************/
+
+int CTScheduler::insert_thread(Ct_thread * pThread) {
+    int i;
+
+    ASSERT( pThread != NULL );
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    i = pThread->priority;
+    ASSERT( i <= CT_PRIORITY_MAX );
+    ASSERT( i >= 0 );
+
+    pThread->status = CT_STATUS_ACTIVE;
+
+#if defined CT_STATS
+    pThread->ready_since = CT_CYCLES();
+#endif
+
+    /* Impose penalty, if any, but keep the result in bounds */
+
+    i += pri_penalty;
+    pri_penalty = 0;
+    if (i > CT_PRIORITY_MAX)
+        i = CT_PRIORITY_MAX;
+
+#if CT_POLICY == CT_POLICY_STRIDE
+
+    /* Place the thread by virtual time instead of static */
+    /* priority, keeping any penalty. */
+
+    i += stride_level(pThread) - pThread->priority;
+    if (i > CT_PRIORITY_MAX)
+        i = CT_PRIORITY_MAX;
+#elif CT_POLICY == CT_POLICY_LOTTERY
+
+    /* All threads share one draw, except those with messages */
+
+    i = CT_PRIORITY_MAX > 0 ? 1 : 0;
+#endif
+
+#if CT_POLICY == CT_POLICY_STRIDE || CT_POLICY == CT_POLICY_LOTTERY
+
+    /* If the thread still has a message in its input queue,   */
+    /* enqeue it at the highest priority, despite any penalty. */
+
+    if (pThread->msg_q != NULL)
+        i = 0;
+#else
+
+    /* If the thread still has messages in its input queue,  */
+    /* enqueue it at the priority of the most urgent sender, */
+    /* if that is higher, despite any penalty. */
+
+    if (pThread->msg_q != NULL)
+        i = inherit_priority(pThread, i);
+#endif
+
+#if CT_POLICY == CT_POLICY_EDF
+
+    /* Real-time threads go by deadline, regardless of */
+    /* messages or penalties.  The rest run beneath    */
+    /* them, by static priority. */
+
+    if (pThread->rt_period > 0) {
+        edf_insert(pThread);
+        return CT_OKAY;
+    }
+
+    if (++i > CT_PRIORITY_MAX)
+        i = CT_PRIORITY_MAX;
+#endif
+
+    /* Juggle the pointers, appending */
+    /* the new thread to the tail     */
+
+    pThread->pNext = pri_q + i;
+    pThread->pPrev = pri_q[ i ].pPrev;
+    pri_q[ i ].pPrev = pThread;
+    pThread->pPrev->pNext = pThread;
+
+    mark_ready(i);
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    return lottery_enter(pThread, i);
+#else
+    return CT_OKAY;
 #endif
+}
+
+#if defined CT_TIMEOUT
+/********************************************************************
+ Put the current thread to sleep for the specified interval.
+ *******************************************************************/
+
+int CTScheduler::ct_wait_on_timeout( unsigned long interval )
+{
+    CT_LOCKED( *this );
+
+    if( NULL == pCurr_thread )
+    {
+        CTOut::ct_report_error( "ct_wait_on_timeout: no thread is active" );
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+    else
+    {
+        ASSERT( CT_MAGIC == pCurr_thread->magic );
+
+        pCurr_thread->status = CT_STATUS_TIMEOUT;
+        pCurr_thread->deadline = read_clock();
+
+        if( ULONG_MAX - pCurr_thread->deadline.tick < interval )
+        ++pCurr_thread->deadline.era;
+        pCurr_thread->deadline.tick += interval;
+        return CT_OKAY;
+    }
+}
+
+/********************************************************************
+ Read the installed clock -- or, when replaying, take the reading
+ from the log instead.  When recording, log the reading.
+ *******************************************************************/
+
+Ct_time CTScheduler::read_clock( void )
+{
+#if defined CT_REPLAY
+    Ct_time t;
+
+    if( replay.ct_replaying() )
+    {
+        if( replay.ct_get_clock( &t ) != CT_OKAY )
+        {
+            ct_fatal_error();
+            t = ticker();
+        }
+        return t;
+    }
+
+    t = ticker();
+    if( replay.ct_recording() )
+        replay.ct_put_clock( &t );
+    return t;
+#else
+    return ticker();
+#endif
+}
+
+/********************************************************************
+ Insert a thread into the timing wheel, at the tail of the
+ slot to which its deadline hashes.  This takes constant time no
+ matter how many other threads are waiting.  Cancelling the timeout
+ (as enqueue() does when a message arrives early) is likewise just
+ a matter of unlinking the thread.
+ *******************************************************************/
+
+void CTScheduler::insert_timeout( Ct_thread * pThread )
+{
+    Ct_thread * pSlot;
+
+    /* Keep wheel_time at or before every pending deadline, */
+    /* so that the next sweep will visit this thread's slot. */
+
+    if( 0 == timeout_count
+            || ct_timecmp( &pThread->deadline, &wheel_time ) < 0 )
+        wheel_time = pThread->deadline;
+
+    pSlot = timer_wheel
+            + ( pThread->deadline.tick & ( CT_WHEEL_SLOTS - 1 ) );
+
+    pThread->pNext = pSlot;
+    pThread->pPrev = pSlot->pPrev;
+    pSlot->pPrev->pNext = pThread;
+    pSlot->pPrev = pThread;
+
+    ++timeout_count;
+}
+
+/********************************************************************
+ Send a timeout message to each sleeping thread that is overdue.
+
+ We visit only the slots for the ticks that have passed since the
+ previous sweep (or every slot once, if the wheel has gone all the
+ way around).  All the threads expiring in the same sweep share a
+ single event, instead of each getting one of its own.
+ *******************************************************************/
+
+int CTScheduler::check_timeouts( void )
+{
+    Ct_time t;
+    unsigned long span;
+    unsigned long i;
+    Ct_thread * pSlot;
+    Ct_thread * pThread;
+    Ct_thread * pNext;
+    Ct_event * pE = NULL;
+    int found = FALSE;
+
+    if( 0 == timeout_count )
+        return FALSE;
+
+    t = read_clock();
+
+    /* Count the ticks since the last sweep, */
+    /* but never visit a slot twice.         */
+
+    span = ticks_between( &wheel_time, &t );
+    if( span >= CT_WHEEL_SLOTS )
+        span = CT_WHEEL_SLOTS - 1;
+
+    for( i = 0; i <= span; ++i )
+    {
+        pSlot = timer_wheel
+                + ( ( wheel_time.tick + i ) & ( CT_WHEEL_SLOTS - 1 ) );
 
-        case CT_STATUS_DEFUNCT:
+        /* A slot may also hold threads whose deadlines lie in */
+        /* later turns of the wheel; we leave those alone.     */
+        /* Delivering the event unlinks the thread, so we note */
+        /* its successor first. */
 
-            /* Deallocate the thread.  This function call sets */
-            /* pCurr_thread to NULL.  Consequently any message */
-            /* dispatching later will know better than to send */
-            /* a message to this defunct thread. */
+        for( pThread = pSlot->pNext; pThread != pSlot; pThread = pNext )
+        {
+            ASSERT( CT_MAGIC == pThread->magic );
+            ASSERT( CT_STATUS_TIMEOUT == pThread->status );
 
-            ctDataStore.ct_destruct( &pCurr_thread);
+            pNext = pThread->pNext;
+            if( ct_timecmp( &t, &pThread->deadline ) <= 0 )
+                continue;
 
-            break;
+#if defined CT_PERIODIC
 
-        default:
-            CTOut::ct_report_error("step: invalid thread status");
-            rc = CT_ERROR;
-            break;
-    }
+            /* A periodic thread's release needs no message */
 
-    if (thread_rc != CT_OKAY)
-        rc = CT_ERROR;
+            if( pThread->releasing )
+            {
+                release_periodic( pThread );
+                continue;
+            }
+#endif
 
-    return rc;
-}
+            if( NULL == pE )
+            {
+                pE = ctDataStore.ct_alloc_event();
+                if( NULL == pE )
+                    return found;
+
+                pE->pNext = NULL;
+                pE->type = CT_TIMEOUT_MSGTYPE;
+                pE->ev_type = CT_EV_MSG;
+                pE->priority = 0;
+#if defined CT_MAILBOX
+                pE->reserved = 0;
+#endif
+                pE->msg_len = 0;
+                pE->refcount = 0;
+                pE->pData = NULL;
+                pE->dispatch_type = CT_DISPATCH_ADDRESSEE;
+                pE->addressee.p = NULL;
+                pE->addressee.incarnation = 0;
+#ifndef NDEBUG
+                pE->magic = EVENT_MAGIC;
+#endif
+            }
 
-/*****************************************************************
- Append the specified cheap thread to the queue at the appropriate
- priority level.
- ****************************************************************/
+            found = TRUE;
+            CT_TRACE_EVENT( CT_TRACE_TIMEOUT, pThread, 0 );
+            if( ct_deliver_event( pE, pThread ) != CT_OKAY )
+            {
+                ct_fatal_error();
+                if( 0 == pE->refcount )
+                    ctDataStore.ct_destruct_event( &pE );
+                return found;
+            }
+        }
+    }
 
-int CTScheduler::insert_thread(Ct_thread * pThread) {
-    int i;
+    wheel_time = t;
+    return found;
+}
 
-    ASSERT( pThread != NULL );
-    ASSERT( CT_MAGIC == pThread->magic );
+/********************************************************************
+ Return the earliest deadline in the timing wheel, which must not be
+ empty.
 
-    i = pThread->priority;
-    ASSERT( i <= CT_PRIORITY_MAX );
-    ASSERT( i >= 0 );
+ Starting from the slot for wheel_time, the first thread we meet
+ whose deadline falls within the current turn of the wheel has the
+ earliest deadline.  Failing that, we settle for the earliest of the
+ deadlines in later turns.
+ *******************************************************************/
 
-    pThread->status = CT_STATUS_ACTIVE;
+Ct_time CTScheduler::next_deadline( void )
+{
+    Ct_time earliest;
+    int found = FALSE;
+    int i;
+    Ct_thread * pSlot;
+    Ct_thread * pThread;
 
-    /* Impose penalty, if any, but keep the result in bounds */
+    ASSERT( timeout_count > 0 );
 
-    i += pri_penalty;
-    pri_penalty = 0;
-    if (i > CT_PRIORITY_MAX)
-        i = CT_PRIORITY_MAX;
+    earliest = wheel_time;
 
-    /* If the thread still has a message in its input queue,   */
-    /* enqeue it at the highest priority, despite any penalty. */
+    for( i = 0; i < CT_WHEEL_SLOTS; ++i )
+    {
+        pSlot = timer_wheel
+                + ( ( wheel_time.tick + i ) & ( CT_WHEEL_SLOTS - 1 ) );
 
-    if (pThread->msg_q != NULL)
-        i = 0;
+        for( pThread = pSlot->pNext; pThread != pSlot;
+                pThread = pThread->pNext )
+        {
+            ASSERT( CT_MAGIC == pThread->magic );
 
-    /* Juggle the pointers, appending */
-    /* the new thread to the tail     */
+            if( ticks_between( &wheel_time, &pThread->deadline )
+                    < CT_WHEEL_SLOTS )
+                return pThread->deadline;
 
-    pThread->pNext = pri_q + i;
-    pThread->pPrev = pri_q[ i ].pPrev;
-    pri_q[ i ].pPrev = pThread;
-    pThread->pPrev->pNext = pThread;
+            if( !found || ct_timecmp( &pThread->deadline, &earliest ) < 0 )
+            {
+                earliest = pThread->deadline;
+                found = TRUE;
+            }
+        }
+    }
 
-    return CT_OKAY;
+    ASSERT( found );
+    return earliest;
 }
 
-#if defined CT_TIMEOUT
 /********************************************************************
- Put the current thread to sleep for the specified interval.
+ No thread is runnable, but some are awaiting a timeout.  Note the
+ start of an idle period, if this is one; then, if there is an idle
+ function, let it block until the earliest deadline has passed.
+ Without an idle function we simply return, and the scheduler loop
+ keeps polling the clock as before.
+
+ With CT_EPOLL, threads may be awaiting file descriptors instead of
+ (or as well as) timeouts.  Then epoll_wait() does the blocking, up
+ to the earliest deadline, in place of the idle function.  So does
+ poll() on the eventfd of CTAio while I/O is in flight, since the
+ idle function knows nothing of it.
  *******************************************************************/
 
-int CTScheduler::ct_wait_on_timeout( unsigned long interval )
+void CTScheduler::enter_idle( void )
 {
-    if( NULL == pCurr_thread )
+    Ct_time t;
+    Ct_time wake;
+
+    t = read_clock();
+
+    if( !idling )
     {
-        ct_report_error( "ct_wait_on_timeout: no thread is active" );
-        ct_fatal_error();
-        return CT_ERROR;
+        idle_stats.busy_ticks += ticks_between( &busy_since, &t );
+        ++idle_stats.idle_count;
+        idle_since = t;
+        idling = 1;
     }
-    else
-    {
-        ASSERT( CT_MAGIC == pCurr_thread->magic );
 
-        pCurr_thread->status = CT_STATUS_TIMEOUT;
-        pCurr_thread->deadline = ticker();
+#if defined CT_EPOLL
+    if( fd_wait_count > 0 )
+    {
+        poll_fds( idle_ms( &t ) );
+        return;
+    }
+#endif
+#if defined CT_AIO
+    if( aio.ct_outstanding() > 0 )
+    {
+        /* The next loop reaps whatever has completed */
 
-        if( ULONG_MAX - pCurr_thread->deadline.tick < interval )
-        ++pCurr_thread->deadline.era;
-        pCurr_thread->deadline.tick += interval;
-        return CT_OKAY;
+        aio.ct_wait_done( idle_ms( &t ) );
+        return;
     }
+#endif
+
+    if( NULL == idle_function )
+        return;
+
+#if defined CT_REPLAY
+
+    /* A replayed clock needs no waiting for */
+
+    if( replay.ct_replaying() )
+        return;
+#endif
+
+    /* A timeout fires once the clock is past the deadline, */
+    /* so the time to wake up is one tick after it. */
+
+    wake = next_deadline();
+    if( ULONG_MAX == wake.tick )
+        ++wake.era;
+    ++wake.tick;
+
+    if( ct_timecmp( &t, &wake ) < 0 )
+        idle_function( &wake );
 }
 
+#if defined CT_EPOLL || defined CT_AIO
+
 /********************************************************************
- Insert a thread at or near the head of the sleeper queue.  If any
- threads are awaiting a timeout, we store them at the head end of
- the sleeper queue, sorted by deadline.
+ Return the milliseconds from now until the earliest deadline,
+ rounded up lest we wake just short of it; or -1, for ever, if no
+ thread awaits a timeout.
  *******************************************************************/
 
-void CTScheduler::insert_timeout( void )
+int CTScheduler::idle_ms( const Ct_time * pNow )
 {
-    Ct_time deadline = pCurr_thread->deadline;
-    Ct_thread * pThread;
+    Ct_time wake;
+    unsigned long ms;
+    unsigned long ticks_per_ms = CT_TICKS_PER_MS;
 
-    /* Find the thread following the proper spot to put */
-    /* the current thread, in order.  Since the list is */
-    /* circular, anchored by a dummy thread with status */
-    /* != CT_STATUS_TIMEOUT, we know the loop will terminate. */
+    if( 0 == timeout_count )
+        return -1;
 
-    for( pThread = sleepers.pNext;
-            CT_STATUS_TIMEOUT == pThread->status
-            && ct_timecmp( &pThread->deadline, &deadline ) <= 0;
-            pThread = pThread->pNext )
-    ;
+    if( 0 == ticks_per_ms )
+        ticks_per_ms = 1;
 
-    /* Insert the current thread before */
-    /* the thread that we just found.   */
+    wake = next_deadline();
+    if( ct_timecmp( pNow, &wake ) >= 0 )
+        ms = 0;
+    else
+        ms = ( ticks_between( pNow, &wake ) + ticks_per_ms )
+                / ticks_per_ms;
 
-    pCurr_thread->pNext = pThread;
-    pCurr_thread->pPrev = pThread->pPrev;
-    pThread->pPrev->pNext = pCurr_thread;
-    pThread->pPrev = pCurr_thread;
+    return ms > INT_MAX ? INT_MAX : (int) ms;
 }
+#endif
 
 /********************************************************************
- Send a timeout message to each sleeping thread that is overdue.
+ A thread is runnable again; note the end of the idle period.
  *******************************************************************/
 
-int check_timeouts( void )
+void CTScheduler::leave_idle( void )
 {
-    Ct_thread * pThread = sleepers.pNext;
-    Ct_time t = ticker();
-    int found = FALSE;
-    Ct_handle handle;
+    Ct_time t;
 
-    while( CT_STATUS_TIMEOUT == pThread->status
-            && ct_timecmp( &t, &pThread->deadline )> 0 )
-    {
-        found = TRUE;
-        handle.p = pThread;
-        handle.incarnation = pThread->incarnation;
-        ct_send_msg( CT_TIMEOUT_MSGTYPE, NULL, 0, handle );
+    t = read_clock();
+    idle_stats.idle_ticks += ticks_between( &idle_since, &t );
+    busy_since = t;
+    idling = 0;
+}
+
+/********************************************************************
+ Destruct all threads still waiting in the timing wheel.
+ *******************************************************************/
+
+void CTScheduler::clear_timer_wheel( void )
+{
+    int i;
 
-        pThread = pThread->pNext;
+    for( i = 0; i < CT_WHEEL_SLOTS; ++i )
+    {
+        timer_wheel[ i ].pPrev->pNext = NULL;
+        timer_wheel[ i ].pPrev = timer_wheel + i;
+        destruct_thread_list( &timer_wheel[ i ].pNext );
+        timer_wheel[ i ].pNext = timer_wheel + i;
     }
 
-    return found;
+    timeout_count = 0;
 }
 
 /********************************************************************
@@ -444,9 +1456,9 @@ Ct_clock CTScheduler::ct_install_clock( Ct_clock clock_function )
 {
     Ct_clock prev_clock = ticker;
 
-    if( CT_STATUS_TIMEOUT == sleepers.pNext->status )
+    if( timeout_count > 0 )
     {
-        ct_report_error( "ct_install_clock: Cannot replace clock "
+        CTOut::ct_report_error( "ct_install_clock: Cannot replace clock "
                 "when a timeout is already pending" );
         ct_fatal_error();
     }
@@ -460,6 +1472,64 @@ Ct_clock CTScheduler::ct_install_clock( Ct_clock clock_function )
 
     return prev_clock;
 }
+
+#if defined CT_QUANTUM
+
+/**********************************************************
+ Limit the time a thread may spend on consecutive steps in
+ one dispatch, in ticks of the installed clock.  Zero (the
+ default) means no limit other than the step quantum.  The
+ budget is checked between steps, so a single step may
+ still overrun it.
+ *********************************************************/
+
+int CTScheduler::ct_set_quantum_ticks( Ct_handle handle, unsigned long ticks )
+{
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if( !ctDataStore.ct_valid_handle( &handle ) )
+    {
+        CTOut::ct_report_error( "ct_set_quantum_ticks: invalid thread handle" );
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    pThread->quantum_ticks = ticks;
+    return CT_OKAY;
+}
+
+#endif
+
+/**********************************************************
+ Install a function to block the scheduler while it has
+ nothing to do but wait for a timeout.  Return a pointer
+ to the previous idle function.  A NULL parameter makes
+ the scheduler poll the clock instead.
+
+ The idle function must agree with the installed clock
+ about the length of a tick.
+ *********************************************************/
+
+Ct_idle_function CTScheduler::ct_install_idle_function( Ct_idle_function f )
+{
+    Ct_idle_function prev_function = idle_function;
+
+    idle_function = f;
+    return prev_function;
+}
+
+/**********************************************************
+ Report the time spent idle and busy so far.
+ *********************************************************/
+
+Ct_idle_stats CTScheduler::ct_idle_stats( void )
+{
+    return idle_stats;
+}
 #endif
 
 /**********************************************************
@@ -494,13 +1564,43 @@ int CTScheduler::ct_timecmp(const Ct_time * t1, const Ct_time * t2) {
 
  Periodically scrunching the queue guarantees that every active thread
  will execute eventually.
+
+ We visit only the non-empty queues, as told by next_ready().  Moving
+ them in ascending order means that each one lands either on queue 0
+ or on a queue that we have just emptied.  Since every level moves
+ down by one, we then shift any readiness bitmap at once, rather than
+ clear and set a bit for each queue moved.
  *******************************************************************/
 
 void CTScheduler::scrunch_queue(void) {
     int i;
+#if defined CT_READY_BITMAP
+    int w;
+    unsigned long low;
+#endif
+
+    /* Any bitmap still shows the old levels while we splice */
+
+    for (i = next_ready( 1 ); i > 0; i = next_ready(i + 1))
+        splice_queue(i, i - 1);
 
-    for (i = 1; i <= CT_PRIORITY_MAX; ++i)
-        append_queue(i, i - 1);
+#if defined CT_READY_BITMAP
+
+    /* Queue 0 stays non-empty if it was; every other level takes */
+    /* the bit of the level above it, which may be in the next word */
+
+    low = ready_map[ 0 ] & 1UL;
+    ready_summary = 0;
+    for (w = 0; w < CT_READY_WORDS; ++w) {
+        ready_map[ w ] >>= 1;
+        if (w + 1 < CT_READY_WORDS)
+            ready_map[ w ] |= ready_map[ w + 1 ] << (CT_READY_BITS - 1);
+        if (ready_map[ w ] != 0)
+            ready_summary |= 1UL << w;
+    }
+    ready_map[ 0 ] |= low;
+    ready_summary |= low;
+#endif
 }
 
 /********************************************************************
@@ -514,6 +1614,20 @@ void CTScheduler::append_queue(int from, int to) {
 
         return;
 
+    splice_queue(from, to);
+
+    mark_empty(from);
+    mark_ready(to);
+}
+
+/********************************************************************
+ Transfer a non-empty thread list to the tail of another, leaving the
+ readiness bitmap for the caller to bring up to date.
+ *******************************************************************/
+
+void CTScheduler::splice_queue(int from, int to) {
+    ASSERT( pri_q[ from ].pNext != pri_q + from );
+
     if (pri_q[ to ].pPrev == pri_q + to) {
         /* Receiving list is empty */
 
@@ -534,18 +1648,25 @@ void CTScheduler::append_queue(int from, int to) {
     }
 
     pri_q[ from ].pNext = pri_q[ from ].pPrev = pri_q + from;
-    return;
 }
 
 /*******************************************************************
  Create a new cheap thread and add it to the priority queue as an
  active process.  Return a handle if a pointer to one is supplied.
+ Under CT_GROUPS, the thread joins the specified group.
  *******************************************************************/
 
+#if defined CT_GROUPS
+int CTScheduler::ct_create_thread(Ct_handle * pHandle, int priority,
+        void * pData, Ct_step_function step, Ct_destructor destruct,
+        unsigned group) {
+#else
 int CTScheduler::ct_create_thread(Ct_handle * pHandle, int priority,
         void * pData, Ct_step_function step, Ct_destructor destruct) {
+#endif
     int rc;
     Ct_thread * pThread;
+    CT_LOCKED( *this );
 
     /* Initialize the queue and the sleeper */
     /* list, if we haven't already done so. */
@@ -555,6 +1676,13 @@ int CTScheduler::ct_create_thread(Ct_handle * pHandle, int priority,
         opened = 1;
     }
 
+#if defined CT_GROUPS
+    if ( !valid_group(group)) {
+        CTOut::ct_report_error("ct_create_thread: invalid group");
+        return CT_ERROR;
+    }
+#endif
+
     if (priority > CT_PRIORITY_MAX)
         priority = CT_PRIORITY_MAX;
     else
@@ -565,11 +1693,22 @@ int CTScheduler::ct_create_thread(Ct_handle * pHandle, int priority,
     if (NULL == pThread)
         rc = CT_ERROR;
     else {
+#if defined CT_THREADSAFE
+        if (pHandle != NULL)
+            pHandle->partition = partition_id;
+#endif
+#if defined CT_REPLAY
+        note_creation(pThread);
+#endif
+
         /* Insert the thread into the priority queue.  If the  */
         /* attempt fails, discard the thread.  We here rely on */
         /* destruct_ct() to set pThread to NULL. */
 
         ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_GROUPS
+        pThread->group = group;
+#endif
 
         rc = insert_thread(pThread);
         if ( CT_OKAY != rc)
@@ -594,10 +1733,17 @@ int CTScheduler::ct_create_thread(Ct_handle * pHandle, int priority,
  a handle if a pointer to one is supplied.
  *******************************************************************/
 
+#if defined CT_GROUPS
+int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
+        void * pData, Ct_step_function step, Ct_destructor destruct,
+        unsigned group) {
+#else
 int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
         void * pData, Ct_step_function step, Ct_destructor destruct) {
+#endif
     int rc;
     Ct_thread * pThread;
+    CT_LOCKED( *this );
 
     /* Initialize the queue and the sleeper */
     /* list, if we haven't already done so. */
@@ -607,6 +1753,13 @@ int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
         opened = 1;
     }
 
+#if defined CT_GROUPS
+    if ( !valid_group(group)) {
+        CTOut::ct_report_error("ct_create_sleeping_thread: invalid group");
+        return CT_ERROR;
+    }
+#endif
+
     if (priority > CT_PRIORITY_MAX)
         priority = CT_PRIORITY_MAX;
     else
@@ -618,7 +1771,13 @@ int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
         rc = CT_ERROR;
     else {
         ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_GROUPS
+        pThread->group = group;
+#endif
         pThread->status = CT_STATUS_ASLEEP;
+#if defined CT_REPLAY
+        note_creation(pThread);
+#endif
 
         /* Add the thread to the tail of the sleeper list.  */
 
@@ -632,6 +1791,9 @@ int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
 
             pHandle->p = pThread;
             pHandle->incarnation = pThread->incarnation;
+#if defined CT_THREADSAFE
+            pHandle->partition = partition_id;
+#endif
         }
 
         rc = CT_OKAY;
@@ -640,26 +1802,157 @@ int CTScheduler::ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
     return rc;
 }
 
+/*******************************************************************
+ Create count threads at once, all with the same priority, step
+ function and destructor, and add them to the priority queue.  The
+ ith thread gets ppData[ i ] as its data, or NULL if ppData is NULL.
+ Return their handles in pHandles, if supplied.
+
+ The threads come from a single slab, reserved up front; so either
+ they are all created or, for want of memory, none is.
+ *******************************************************************/
+
+#if defined CT_GROUPS
+int CTScheduler::ct_create_threads(Ct_handle * pHandles, unsigned count,
+        int priority, void * const * ppData, Ct_step_function step,
+        Ct_destructor destruct, unsigned group) {
+#else
+int CTScheduler::ct_create_threads(Ct_handle * pHandles, unsigned count,
+        int priority, void * const * ppData, Ct_step_function step,
+        Ct_destructor destruct) {
+#endif
+    Ct_thread * pThread;
+    unsigned i;
+    CT_LOCKED( *this );
+
+    if ( !opened) {
+        ct_open();
+        opened = 1;
+    }
+
+#if defined CT_GROUPS
+    if ( !valid_group(group)) {
+        CTOut::ct_report_error("ct_create_threads: invalid group");
+        return CT_ERROR;
+    }
+#endif
+
+    if (priority > CT_PRIORITY_MAX)
+        priority = CT_PRIORITY_MAX;
+    else
+        if (priority < 0)
+            priority = 0;
+
+    if (ctDataStore.ct_reserve_threads(count) != CT_OKAY)
+        return CT_ERROR;
+
+    for (i = 0; i < count; ++i) {
+        pThread = ctDataStore.ct_construct(priority,
+                NULL == ppData ? NULL : ppData[ i ], step, destruct);
+        ASSERT( pThread != NULL );
+        ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_GROUPS
+        pThread->group = group;
+#endif
+#if defined CT_REPLAY
+        note_creation(pThread);
+#endif
+
+        insert_thread(pThread);
+
+        if (pHandles != NULL) {
+            pHandles[ i ].p = pThread;
+            pHandles[ i ].incarnation = pThread->incarnation;
+#if defined CT_THREADSAFE
+            pHandles[ i ].partition = partition_id;
+#endif
+        }
+    }
+
+    return CT_OKAY;
+}
+
+/******************************************************************
+ Destruct all thread lists in the priority queue.  Before
+ destructing each non-empty list, we convert it from a circular
+ list to a linear list.
+ *****************************************************************/
+
+void CTScheduler::clear_priority_queue(void) {
+    int i;
+
+    for (i = CT_PRIORITY_MAX; i >= 0; --i) {
+        if (pri_q[ i ].pNext != NULL) {
+            pri_q[ i ].pPrev->pNext = NULL;
+            pri_q[ i ].pPrev = pri_q + i;
+
+            destruct_thread_list( &pri_q[ i ].pNext);
+            pri_q[ i ].pNext = pri_q + i;
+        }
+    }
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    clear_lottery();
+#endif
+#if defined CT_READY_BITMAP
+    for (i = 0; i < CT_READY_WORDS; ++i)
+        ready_map[ i ] = 0;
+    ready_summary = 0;
+#endif
+}
+
+#if defined CT_ARENA
+
+/******************************************************************
+ Release every thread, at shutdown, through CTDataStore's
+ ct_release(), and leave the queues and lists empty.
+ *****************************************************************/
+
+void CTScheduler::release_threads(void) {
+    int i;
+
+    for (i = 0; i <= CT_PRIORITY_MAX; ++i)
+        release_thread_list(pri_q + i);
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    clear_lottery();
+#endif
+#if defined CT_READY_BITMAP
+    for (i = 0; i < CT_READY_WORDS; ++i)
+        ready_map[ i ] = 0;
+    ready_summary = 0;
+#endif
+
+    release_thread_list( &sleepers);
+
+#if defined CT_TIMEOUT
+    for (i = 0; i < CT_WHEEL_SLOTS; ++i)
+        release_thread_list(timer_wheel + i);
+    timeout_count = 0;
+#endif
+#if defined CT_GROUPS
+    for (i = 0; i < CT_GROUPS_MAX; ++i)
+        release_thread_list( &groups[ i ].parked);
+#endif
+}
+
 /******************************************************************
- Destruct all thread lists in the priority queue.  Before
- destructing each non-empty list, we convert it from a circular
- list to a linear list.
+ Release the threads of a circular list anchored by a dummy, and
+ leave it empty.
  *****************************************************************/
 
-void CTScheduler::clear_priority_queue(void) {
-    int i;
+void CTScheduler::release_thread_list(Ct_thread * pAnchor) {
+    Ct_thread * pThread;
 
-    for (i = CT_PRIORITY_MAX; i >= 0; --i) {
-        if (pri_q[ i ].pNext != NULL) {
-            pri_q[ i ].pPrev->pNext = NULL;
-            pri_q[ i ].pPrev = pri_q + i;
+    for (pThread = pAnchor->pNext; pThread != pAnchor;
+            pThread = pThread->pNext)
+        ctDataStore.ct_release(pThread);
 
-            destruct_thread_list( &pri_q[ i ].pNext);
-            pri_q[ i ].pNext = pri_q + i;
-        }
-    }
+    pAnchor->pNext = pAnchor->pPrev = pAnchor;
 }
 
+#endif
+
 /******************************************************************
  Destruct and discard a NULL-terminated linked list of cheap
  threads.  We use only the forward pointers, ignoring the backwards
@@ -706,6 +1999,19 @@ void CTScheduler::ct_clear(void) {
  **************************************************************/
 
 void CTScheduler::clean_up_all(void) {
+#if defined CT_GROUPS && ! defined CT_ARENA
+    unsigned g;
+
+#endif
+#if defined CT_ARENA
+
+    /* Call the destructors of any remaining threads, wherever */
+    /* they are, without taking apart their input queues or     */
+    /* subscriptions; the arenas holding those go whole below.  */
+
+    release_threads();
+    ev_head = NULL;
+#else
     /* Discard any remaining threads on the queues.  */
 
     clear_priority_queue();
@@ -720,25 +2026,76 @@ void CTScheduler::clean_up_all(void) {
     destruct_thread_list( &sleepers.pNext);
     sleepers.pNext = &sleepers;
 
+#if defined CT_TIMEOUT
+    clear_timer_wheel();
+#endif
+#if defined CT_GROUPS
+
+    /* Likewise any threads held back for the sake of other groups */
+
+    for (g = 0; g < CT_GROUPS_MAX; ++g) {
+        if (groups[ g ].parked.pNext != &groups[ g ].parked) {
+            groups[ g ].parked.pPrev->pNext = NULL;
+            destruct_thread_list( &groups[ g ].parked.pNext);
+        }
+    }
+#endif
+#endif
+#if defined CT_GROUPS
+    clear_groups();
+#endif
+
     /* Now that we have logically discarded all threads, physically */
     /* deallocate all memory resources for threads, messages, etc.  */
 
     ctDataStore.ct_free_all_threads();
+#if ! defined CT_ARENA
     ctDataStore.ct_destruct_event_list( &ev_head);
+#endif
     ctDataStore.ct_free_all_msgnodes();
     ctDataStore.ct_free_all_events();
     ctDataStore.ct_free_subscriptions();
+#if defined CT_REPLAY
+
+    /* Finish the log, if we were recording */
+
+    replay.ct_stop();
+#endif
+#if defined CT_COROUTINES
+    frame_pool.ct_release();
+#endif
+#if defined CT_FIBERS
+    ct_free_all_stacks( &free_fibers);
+#endif
+#if defined CT_EPOLL
+    close_epoll();
+#endif
+#if defined CT_WATCHDOG_BACKTRACE
+    close_watchdog();
+#endif
+#if defined CT_AIO
+    aio.ct_shutdown();
+#endif
 
     /* Restore initial values of static variables -- except    */
     /* for fatal_error, which can be reset only by ct_clear(). */
 
     ev_tail = ev_head = NULL;
+#if defined CT_WAKEUPS
+    wake_count = 0;
+    wake_type_count = 0;
+    wake_all = 0;
+    wake_all_priority = CT_PRIORITY_MAX;
+    wakeups = 0;
+#endif
     pCurr_thread = NULL;
     curr_priority = -1;
     pri_penalty = 0;
     opened = 0;
     halted = 0;
     self_msg = 0;
+    self_priority = CT_PRIORITY_MAX;
+    sender_priority = 0;
 #if defined CT_TIMEOUT
     ticker = default_clock;
 #endif
@@ -821,6 +2178,185 @@ void CTScheduler::ct_penalize(unsigned penalty) {
     }
 }
 
+#if defined CT_QUANTUM
+
+/***************************************************************
+ Set the run quantum of a thread: the largest number of steps it
+ may take each time it is dispatched, provided that nothing more
+ urgent turns up in the meantime.  Zero is treated as one, which
+ is the default.
+ **************************************************************/
+
+int CTScheduler::ct_set_quantum(Ct_handle handle, unsigned steps) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if ( !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_set_quantum: invalid thread handle");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    pThread->quantum = steps > 0 ? steps : 1;
+    return CT_OKAY;
+}
+
+#endif
+
+/***************************************************************
+ Set the weight of a thread, i.e. its share of the CPU relative
+ to other threads, under a proportional scheduling policy.  The
+ multilevel policy ignores it.  Zero is treated as one.
+ **************************************************************/
+
+int CTScheduler::ct_set_weight(Ct_handle handle, unsigned weight) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if ( !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_set_weight: invalid thread handle");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+    if (pThread->lottery_slot != 0)
+        lottery_reweigh(pThread, weight > 0 ? weight : 1);
+#endif
+#if CT_POLICY != CT_POLICY_MULTILEVEL
+    pThread->weight = weight > 0 ? weight : 1;
+#endif
+#if CT_POLICY == CT_POLICY_STRIDE
+    pThread->stride = CT_STRIDE1 / pThread->weight;
+#endif
+    return CT_OKAY;
+}
+
+#if defined CT_QUANTUM
+
+/***************************************************************
+ Report how fully a thread has been using its run quantum.
+ **************************************************************/
+
+int CTScheduler::ct_quantum_stats(Ct_handle handle,
+        Ct_quantum_stats * pStats) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_quantum_stats: invalid argument");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    *pStats = pThread->quantum_stats;
+    return CT_OKAY;
+}
+
+#endif
+
+#if defined CT_REPLAY
+/***************************************************************
+ Log a thread's creation if recording; if replaying, check that
+ the log agrees, treating any disagreement as fatal.
+ **************************************************************/
+
+void CTScheduler::note_creation(Ct_thread * pThread) {
+    if (replay.ct_recording())
+        replay.ct_put_create(pThread);
+    else
+        if (replay.ct_replaying()
+                && replay.ct_check_create(pThread) != CT_OKAY)
+            ct_fatal_error();
+}
+
+/***************************************************************
+ Start logging the scheduler's inputs through the specified
+ writer, so that the schedule may be replayed later.  Call
+ before creating any thread.  The log is finished when the
+ scheduler returns, or by ct_end_replay().
+ **************************************************************/
+
+int CTScheduler::ct_record_schedule(Ct_replay_writer writer) {
+    return replay.ct_start_record(writer);
+}
+
+/***************************************************************
+ Start taking the scheduler's inputs from a log, read through
+ the specified reader, so as to repeat the recorded schedule.
+ Call before creating any thread; then create the same threads
+ as the recorded run did.  A scheduler replaying a log should
+ not belong to a group of partitions.
+ **************************************************************/
+
+int CTScheduler::ct_replay_schedule(Ct_replay_reader reader) {
+    return replay.ct_start_replay(reader);
+}
+
+/***************************************************************
+ Stop recording or replaying.
+ **************************************************************/
+
+void CTScheduler::ct_end_replay(void) {
+    replay.ct_stop();
+}
+#endif
+
+#if defined CT_TRACE
+/***************************************************************
+ Copy the trace records to a buffer, oldest first, for
+ converting with tools/ct_trace2json.py.  Return the number of
+ bytes used; see CTTrace::ct_dump().
+ **************************************************************/
+
+unsigned long CTScheduler::ct_trace_dump(void * buff, unsigned long len) {
+    return trace.ct_dump(buff, len);
+}
+
+/***************************************************************
+ Discard all trace records.
+ **************************************************************/
+
+void CTScheduler::ct_trace_clear(void) {
+    trace.ct_clear();
+}
+#endif
+
+#if defined CT_STATS
+/***************************************************************
+ Report the accounting kept for a thread: its steps and the time
+ they took, the time it has spent waiting to run, and the number
+ of messages it has dequeued or discarded.
+ **************************************************************/
+
+int CTScheduler::ct_thread_stats(Ct_handle handle,
+        Ct_thread_stats * pStats) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_thread_stats: invalid argument");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    *pStats = pThread->stats;
+    return CT_OKAY;
+}
+#endif
+
 /***************************************************************
  Note a fatal error.
  **************************************************************/
@@ -837,8 +2373,12 @@ void CTScheduler::ct_fatal_error(void) {
  **************************************************************/
 
 void CTScheduler::ct_halt(void) {
-    if (curr_priority >= 0)
+    CT_LOCKED( *this );
+
+    if (curr_priority >= 0) {
+        CT_TRACE_EVENT( CT_TRACE_HALT, pCurr_thread, 0 );
         halted = 1;
+    }
 }
 
 /***************************************************************
@@ -846,6 +2386,8 @@ void CTScheduler::ct_halt(void) {
  **************************************************************/
 
 int CTScheduler::ct_exit(void) {
+    CT_LOCKED( *this );
+
     if (NULL == pCurr_thread) {
         CTOut::ct_report_error("ct_exit: no thread is active");
         ct_fatal_error();
@@ -865,6 +2407,8 @@ int CTScheduler::ct_exit(void) {
  **************************************************************/
 
 int CTScheduler::ct_wait(void) {
+    CT_LOCKED( *this );
+
     if (NULL == pCurr_thread) {
         CTOut::ct_report_error("ct_wait: no thread is active");
         ct_fatal_error();
@@ -896,50 +2440,266 @@ Ct_handle CTScheduler::ct_self(void) {
         handle.incarnation = pCurr_thread->incarnation;
     }
 
+#if defined CT_THREADSAFE
+    handle.partition = partition_id;
+#endif
+
     return handle;
 }
 
-/*************************************************************
- Return a pointer to the thread's data, as installed when it
- was created.
- ************************************************************/
+/*************************************************************
+ Return a pointer to the thread's data, as installed when it
+ was created.
+ ************************************************************/
+
+void * CTScheduler::ct_self_data(void) {
+    if (NULL == pCurr_thread)
+        return NULL;
+    else {
+        ASSERT( CT_MAGIC == pCurr_thread->magic );
+        return pCurr_thread->pData;
+    }
+}
+
+/****************************************************************
+ Enqueue a Ct_event for eventual dispatching.
+ ***************************************************************/
+
+int CTScheduler::ct_enqueue_event(Ct_event * pE) {
+    CT_LOCKED( *this );
+
+    if (NULL == pE) {
+        CTOut::ct_report_error("ct_enqueue_event: No event supplied");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    ASSERT( EVENT_MAGIC == pE->magic );
+    CT_TRACE_EVENT( CT_TRACE_POST, pCurr_thread, pE->type );
+
+    if (NULL == ev_head)
+        ev_head = ev_tail = pE;
+    else {
+        ASSERT( EVENT_MAGIC == ev_head->magic );
+        ASSERT( ev_tail != NULL );
+        ASSERT( EVENT_MAGIC == ev_tail->magic );
+        ev_tail->pNext = pE;
+        ev_tail = pE;
+    }
+
+    pE->pNext = NULL;
+
+    return CT_OKAY;
+}
+
+#if defined CT_THREADSAFE
+/****************************************************************
+ Post a message to a designated addressee from another OS thread.
+ The message is copied into the inbox, and reaches the event queue
+ the next time around the scheduler loop.  We can't validate the
+ handle here without racing the scheduler, so an invalid addressee
+ is ignored at dispatch time, as it would be for ct_send_msg().
+
+ Return CT_ERROR if the message is invalid or too long, or if the
+ inbox is full; the caller may retry later.  We don't treat any of
+ these as fatal, since the caller is not a cheap thread.
+ ***************************************************************/
+
+int CTScheduler::ct_post_msg(Ct_msgtype type, const void * pData,
+        size_t len, Ct_handle dest) {
+    if ( 0 == type)
+        return CT_ERROR; /* zero denotes the absence of a message */
+
+    if (inbox.ct_post(CT_EV_MSG, type, pData, len,
+            CT_DISPATCH_ADDRESSEE, dest) != CT_OKAY)
+        return CT_ERROR;
+
+    if (partitions != NULL)
+        partitions->ct_wake(partition_id); /* in case it is idle */
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Enqueue a designated thread for execution, from another OS thread.
+ ***************************************************************/
+
+int CTScheduler::ct_post_enq(Ct_handle dest) {
+    if (inbox.ct_post(CT_EV_ENQ, 0, NULL, 0, CT_DISPATCH_ADDRESSEE,
+            dest) != CT_OKAY)
+        return CT_ERROR;
+
+    if (partitions != NULL)
+        partitions->ct_wake(partition_id);
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Transfer the contents of the inbox to the event queue, turning
+ each entry into an ordinary event.
+ ***************************************************************/
+
+void CTScheduler::drain_inbox(void) {
+    Ct_posted_event posted;
+
+    /* As in drain_partitions(), tell the group we're busy */
+    /* before taking anything. */
+
+    if (partition_idle) {
+        partitions->ct_partition_busy();
+        partition_idle = 0;
+    }
+
+    while (inbox.ct_take( &posted))
+        enqueue_posted( &posted);
+}
+
+/****************************************************************
+ Join a group of partitions.  Called by CTPartitions, before the
+ scheduler starts running.
+ ***************************************************************/
+
+void CTScheduler::ct_set_partition(CTPartitions * pGroup, unsigned id) {
+    partitions = pGroup;
+    partition_id = id;
+    partition_idle = 0;
+}
+
+/****************************************************************
+ Return CT_TRUE if a handle refers to a thread belonging to another
+ partition.  Such a handle must not be validated or dereferenced
+ here, since the thread belongs to another OS thread.
+ ***************************************************************/
+
+int CTScheduler::ct_is_remote(const Ct_handle * pH) {
+    if (partitions != NULL && pH->partition != partition_id)
+        return CT_TRUE;
+    else
+        return CT_FALSE;
+}
+
+/****************************************************************
+ Send a message or wakeup to a thread in another partition, by
+ way of the ring from this partition to that one.  The addressee's
+ partition validates the handle when it drains the ring.
+
+ If the ring is full, return CT_ERROR without treating it as
+ fatal; the sender may try again on a later step.
+ ***************************************************************/
+
+int CTScheduler::ct_send_remote(Ct_event_type ev_type, Ct_msgtype type,
+        const void * pData, size_t len, Ct_handle dest) {
+    ASSERT( partitions != NULL );
+
+    if (dest.partition >= partitions->ct_partition_count()) {
+        CTOut::ct_report_error("ct_send_remote: no such partition");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    if (len > CT_MSG_BUF_LEN) {
+        CTOut::ct_report_error("ct_send_remote: message too long "
+                "to send to another partition");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    partitions->ct_message_sent();
+    if (partitions->ct_ring(partition_id, dest.partition)->ct_push(ev_type,
+            type, pData, len, dest) != CT_OKAY) {
+        partitions->ct_message_received(); /* never sent, after all */
+        return CT_ERROR;
+    }
+
+    partitions->ct_wake(dest.partition);
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Transfer the contents of our inbound rings to the event queue.
+ ***************************************************************/
+
+void CTScheduler::drain_partitions(void) {
+    Ct_posted_event posted;
+    CTRing * pRing;
+    unsigned i;
+    unsigned n = partitions->ct_partition_count();
+
+    for (i = 0; i < n; ++i) {
+        if (i == partition_id)
+            continue;
+
+        pRing = partitions->ct_ring(i, partition_id);
+        if ( !pRing->ct_pending())
+            continue;
+
+        /* Tell the group we're busy before taking the message, */
+        /* lest it look finished while we are acting on it.     */
 
-void * CTScheduler::ct_self_data(void) {
-    if (NULL == pCurr_thread)
-        return NULL;
-    else {
-        ASSERT( CT_MAGIC == pCurr_thread->magic );
-        return pCurr_thread->pData;
+        if (partition_idle) {
+            partitions->ct_partition_busy();
+            partition_idle = 0;
+        }
+
+        while (pRing->ct_pop( &posted)) {
+            partitions->ct_message_received();
+            enqueue_posted( &posted);
+        }
     }
 }
 
 /****************************************************************
- Enqueue a Ct_event for eventual dispatching.
+ Turn an event received from another OS thread into an ordinary
+ event, and add it to the event queue.
  ***************************************************************/
 
-int CTScheduler::ct_enqueue_event(Ct_event * pE) {
-    if (NULL == pE) {
-        CTOut::ct_report_error("ct_enqueue_event: No event supplied");
-        ct_fatal_error();
-        return CT_ERROR;
+void CTScheduler::enqueue_posted(const Ct_posted_event * pPosted) {
+    Ct_event * pE;
+
+#if defined CT_REPLAY
+    if (replay.ct_recording()) {
+        replay.ct_put_post(replay_loops, pPosted);
+        replay_loops = 0;
     }
+#endif
 
-    ASSERT( EVENT_MAGIC == pE->magic );
+#if defined CT_WAKEUPS
 
-    if (NULL == ev_head)
-        ev_head = ev_tail = pE;
-    else {
-        ASSERT( EVENT_MAGIC == ev_head->magic );
-        ASSERT( ev_tail != NULL );
-        ASSERT( EVENT_MAGIC == ev_tail->magic );
-        ev_tail->pNext = pE;
-        ev_tail = pE;
+    /* A wakeup needs no event, unless the wakeup list is full */
+
+    if (CT_EV_ENQ == pPosted->ev_type
+            && CT_DISPATCH_ADDRESSEE == pPosted->dispatch_type) {
+        if ( !ctDataStore.ct_valid_handle( &pPosted->addressee))
+            return;
+        if (ct_post_wakeup(pPosted->addressee))
+            return;
     }
+#endif
+
+    pE = ctDataStore.ct_alloc_event();
+    if (NULL == pE)
+        return; /* ct_alloc_event() has reported the error */
 
     pE->pNext = NULL;
+    pE->type = pPosted->type;
+    pE->ev_type = pPosted->ev_type;
+    pE->priority = 0; /* from outside, so urgent */
+#if defined CT_MAILBOX
+    pE->reserved = 0;
+#endif
+    pE->msg_len = pPosted->msg_len;
+    pE->refcount = 0;
+    pE->pData = NULL;
+    if (pPosted->msg_len > 0)
+        memcpy(pE->buff, pPosted->buff, pPosted->msg_len);
+    pE->dispatch_type = pPosted->dispatch_type;
+    pE->addressee = pPosted->addressee;
+#ifndef NDEBUG
+    pE->magic = EVENT_MAGIC;
+#endif
 
-    return CT_OKAY;
+    ct_enqueue_event(pE);
 }
+#endif
 
 /****************************************************************
  Dispatch all the pending events.
@@ -948,6 +2708,11 @@ int CTScheduler::ct_enqueue_event(Ct_event * pE) {
 void CTScheduler::dispatch_event_queue(void) {
     Ct_event * pE;
 
+#if defined CT_WAKEUPS
+    if (wakeups)
+        dispatch_wakeups();
+#endif
+
     while (ev_head != NULL) {
         /* Detach event from queue */
 
@@ -963,6 +2728,7 @@ void CTScheduler::dispatch_event_queue(void) {
                 dispatch_addressee(pE);
                 break;
             case CT_DISPATCH_SUBSCRIBER:
+                CT_TRACE_EVENT( CT_TRACE_SUBSCRIPTION, NULL, pE->type );
                 ct_dispatch_subscription(pE);
                 break;
             case CT_DISPATCH_ALL:
@@ -990,27 +2756,202 @@ void CTScheduler::dispatch_event_queue(void) {
     /* all other recipients, enqueue the current thread.  */
 
     if (self_msg) {
-        int saved_priority;
-
         ASSERT( pCurr_thread != NULL );
         ASSERT( CT_MAGIC == pCurr_thread->magic );
 
-        /* Detach the thread from whatever queue it's on */
+        /* Detach the thread from whatever queue it's on.  Having */
+        /* finished its step, it may already be waiting on the    */
+        /* timing wheel, from which the message takes it, as      */
+        /* enqueue() would. */
 
-        pCurr_thread->pPrev->pNext = pCurr_thread->pNext;
-        pCurr_thread->pNext->pPrev = pCurr_thread->pPrev;
+#if defined CT_TIMEOUT
+        if (CT_STATUS_TIMEOUT == pCurr_thread->status)
+            --timeout_count;
+#endif
+        unlink_thread(pCurr_thread);
 
-        /* Enqueue it at the highest priority */
+        /* Enqueue it at the priority of the most urgent sender */
 
-        saved_priority = pCurr_thread->priority;
-        pCurr_thread->priority = 0;
-        insert_thread(pCurr_thread);
-        pCurr_thread->priority = saved_priority;
+        insert_at(pCurr_thread, self_priority);
+        pCurr_thread->status = CT_STATUS_AWAKENED;
 
         self_msg = 0;
+        self_priority = CT_PRIORITY_MAX;
+    }
+}
+
+#if defined CT_WAKEUPS
+
+/****************************************************************
+ Request a wakeup for a thread, to be delivered at the top of the
+ next scheduler loop, as for an enqueue event but without one.
+ Return CT_TRUE if the wakeup is pending (perhaps already), or
+ CT_FALSE if the wakeup list is full, in which case the caller
+ should send an event instead.
+
+ Like an event, the wakeup carries the sender's priority.  When
+ wakeups coalesce, the most urgent prevails; a wakeup for
+ everybody subsumes only those no more urgent than itself.
+ ***************************************************************/
+
+int CTScheduler::ct_post_wakeup(Ct_handle dest) {
+    Ct_thread * pT;
+    CT_LOCKED( *this );
+
+    ASSERT( ctDataStore.ct_valid_handle( &dest ) );
+
+    pT = (Ct_thread *) dest.p;
+    ++wakeup_stats.posted;
+
+    if (wake_all && wake_all_priority <= sender_priority) {
+        ++wakeup_stats.coalesced;
+        return CT_TRUE;
+    }
+
+    if (pT->wake_pending) {
+        if (sender_priority < pT->wake_priority)
+            pT->wake_priority = sender_priority;
+        ++wakeup_stats.coalesced;
+        return CT_TRUE;
+    }
+
+    if (wake_count >= CT_WAKE_SLOTS) {
+        ++wakeup_stats.overflowed;
+        return CT_FALSE;
+    }
+
+    wake_q[ wake_count++ ] = dest;
+    pT->wake_pending = 1;
+    pT->wake_priority = sender_priority;
+    wakeups = 1;
+    return CT_TRUE;
+}
+
+/****************************************************************
+ Likewise for the subscribers to a message type.
+ ***************************************************************/
+
+int CTScheduler::ct_post_wakeup_subscribers(Ct_msgtype type) {
+    unsigned i;
+    CT_LOCKED( *this );
+
+    ++wakeup_stats.posted;
+
+    if (wake_all && wake_all_priority <= sender_priority) {
+        ++wakeup_stats.coalesced;
+        return CT_TRUE;
+    }
+
+    for (i = 0; i < wake_type_count; ++i) {
+        if (wake_types[ i ] == type) {
+            if (sender_priority < wake_type_priority[ i ])
+                wake_type_priority[ i ] = sender_priority;
+            ++wakeup_stats.coalesced;
+            return CT_TRUE;
+        }
+    }
+
+    if (wake_type_count >= CT_WAKE_TYPES) {
+        ++wakeup_stats.overflowed;
+        return CT_FALSE;
+    }
+
+    wake_type_priority[ wake_type_count ] = sender_priority;
+    wake_types[ wake_type_count++ ] = type;
+    wakeups = 1;
+    return CT_TRUE;
+}
+
+/****************************************************************
+ Likewise for every thread.  This one never overflows.
+ ***************************************************************/
+
+void CTScheduler::ct_post_wakeup_all(void) {
+    CT_LOCKED( *this );
+
+    ++wakeup_stats.posted;
+
+    if ( !wake_all)
+        wake_all_priority = sender_priority;
+    else {
+        if (sender_priority < wake_all_priority)
+            wake_all_priority = sender_priority;
+        ++wakeup_stats.coalesced;
+    }
+
+    wake_all = 1;
+    wakeups = 1;
+}
+
+Ct_wakeup_stats CTScheduler::ct_wakeup_stats(void) {
+    CT_LOCKED( *this );
+
+    return wakeup_stats;
+}
+
+/****************************************************************
+ Deliver the pending wakeups in one pass, each at its own priority.
+ A thread that finished since its wakeup was requested is skipped.
+ Wakeups go ahead of any queued events; carrying no data, they can
+ affect only the order in which the awakened threads are queued.
+ ***************************************************************/
+
+void CTScheduler::dispatch_wakeups(void) {
+    Ct_thread * pT;
+    unsigned i;
+
+    for (i = 0; i < wake_count; ++i) {
+        if ( !ctDataStore.ct_valid_handle(wake_q + i))
+            continue;
+
+        pT = (Ct_thread *) wake_q[ i ].p;
+        if ( !pT->wake_pending)
+            continue;
+
+        pT->wake_pending = 0;
+        ++wakeup_stats.delivered;
+        wake_event.priority = pT->wake_priority;
+        if (ct_deliver_event( &wake_event, pT) != CT_OKAY) {
+            ct_fatal_error();
+            break;
+        }
+    }
+
+    for (i = 0; i < wake_type_count; ++i) {
+        wake_event.type = wake_types[ i ];
+        wake_event.priority = wake_type_priority[ i ];
+        wake_event.dispatch_type = CT_DISPATCH_SUBSCRIBER;
+        ct_dispatch_subscription( &wake_event);
+    }
+
+    /* Threads already awakened above stay where they are, */
+    /* unless this wakeup is the more urgent: */
+
+    if (wake_all) {
+        wake_event.priority = wake_all_priority;
+        dispatch_all( &wake_event);
+        ++wakeup_stats.delivered;
+    }
+
+    wake_event.type = 0;
+    wake_event.priority = 0;
+    wake_event.dispatch_type = CT_DISPATCH_ADDRESSEE;
+
+    /* Clear the flags of any threads we didn't visit */
+
+    for (i = 0; i < wake_count; ++i) {
+        if (ctDataStore.ct_valid_handle(wake_q + i))
+            ( (Ct_thread *) wake_q[ i ].p)->wake_pending = 0;
     }
+
+    wake_count = 0;
+    wake_type_count = 0;
+    wake_all = 0;
+    wakeups = 0;
 }
 
+#endif
+
 /****************************************************************
  Dispatch an event to every thread, then destroy the event.
  ***************************************************************/
@@ -1037,6 +2978,29 @@ void CTScheduler::dispatch_all(Ct_event * pE) {
         ct_fatal_error();
         return;
     }
+
+#if defined CT_GROUPS
+
+    /* Broadcast to threads held back for the sake of other groups */
+
+    for (i = 0; i < CT_GROUPS_MAX; ++i) {
+        if (broadcast_to_queue(pE, &groups[ i ].parked) != CT_OKAY) {
+            ct_fatal_error();
+            return;
+        }
+    }
+#endif
+#if defined CT_TIMEOUT
+
+    /* Broadcast to threads awaiting a timeout */
+
+    for (i = 0; i < CT_WHEEL_SLOTS; ++i) {
+        if (broadcast_to_queue(pE, timer_wheel + i) != CT_OKAY) {
+            ct_fatal_error();
+            return;
+        }
+    }
+#endif
 }
 
 /****************************************************************
@@ -1078,36 +3042,166 @@ int CTScheduler::ct_deliver_event(Ct_event * pE, Ct_thread * pT) {
     ASSERT( pT != NULL );
     ASSERT( CT_MAGIC == pT->magic );
 
-    if (CT_EV_MSG == pE->ev_type) {
-        Ct_msgnode * pM = ctDataStore.ct_alloc_msgnode();
-        if (NULL == pM)
-            return CT_ERROR;
-        else {
-            /* Populate the newly-allocated message */
-            /* node, giving it a copy of the data.  */
+    if (CT_EV_MSG == pE->ev_type && attach_event(pE, pT) != CT_OKAY)
+        return CT_ERROR;
+
+#if ! defined CT_WORKERS
+    if (pT == pCurr_thread) {
+        /* Don't enqueue the originator yet -- wait until */
+        /* all other affected threads have been enqueued. */
+
+        self_msg = 1;
+        if (pE->priority < self_priority)
+            self_priority = pE->priority;
+    }
+    else
+#endif
+        enqueue(pT, pE->priority);
+
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Put a message event in a thread's input queue.
+ ***************************************************************/
+
+int CTScheduler::attach_event(Ct_event * pE, Ct_thread * pT) {
+    Ct_msgnode * pM;
+
+#if defined CT_MAILBOX
+    if ( !admit_attached(pE, pT))
+        return CT_OKAY; /* no room: discarded */
+#endif
 
-            pM->pNext = NULL;
+    pM = ctDataStore.ct_alloc_msgnode();
+    if (NULL == pM) {
+#if defined CT_MAILBOX
+        --pT->mailbox_stats.count;
+#endif
+        return CT_ERROR;
+    }
+
+    /* Populate the newly-allocated message */
+    /* node, giving it a copy of the data.  */
+
+    pM->pNext = NULL;
 #ifndef NDEBUG
-            pM->magic = MSGNODE_MAGIC;
+    pM->magic = MSGNODE_MAGIC;
 #endif
-            pM->pE = pE;
-            ++pE->refcount;
-            attach_msg(pM, pT);
-        }
+    pM->pE = pE;
+    ++pE->refcount;
+    attach_msg(pM, pT);
+    return CT_OKAY;
+}
+
+/****************************************************************
+ Send an event to its addressee at once, if we can, instead of by
+ way of the event queue.  We can if nothing is queued ahead of it,
+ so that events still arrive in the order sent.
+
+ A message to the current thread is delivered as through the
+ queue: once the step ends, the thread is requeued at the
+ message's priority, even if it has just begun to wait on a
+ timeout.
+
+ A message to another thread is delivered as dispatch_event_queue()
+ would have delivered it -- but only if that thread is asleep, or
+ of the same static priority as the sender, so that the early
+ delivery reorders nothing but a peer or a sleeper.
+
+ With handoff enabled (and the multilevel policy), the addressee
+ then moves to the head of the sender's level, unless already
+ queued ahead of it, so that it runs next -- e.g. to answer a
+ request promptly -- while threads more urgent than the sender
+ still run first.  After CT_HANDOFF_MAX handoffs in a row, each to
+ the thread that made the last, the addressee waits its turn like
+ any other, lest a pair trading messages starve its level.
+
+ Otherwise, or for an event of any other kind, we just enqueue it.
+ ***************************************************************/
+
+int CTScheduler::ct_send_event(Ct_event * pE) {
+    Ct_thread * pT;
+    CT_LOCKED( *this );
+
+    if (NULL == pE || ev_head != NULL || pE->dispatch_type
+            != CT_DISPATCH_ADDRESSEE || pE->ev_type != CT_EV_MSG)
+        return ct_enqueue_event(pE);
+
+    ASSERT( EVENT_MAGIC == pE->magic );
+
+    pT = ctDataStore.ct_valid_handle( &pE->addressee)
+            ? (Ct_thread *) pE->addressee.p : NULL;
+
+    if (pT != NULL && pT != pCurr_thread
+            && pT->status != CT_STATUS_ASLEEP
+#if defined CT_TIMEOUT
+            && pT->status != CT_STATUS_TIMEOUT
+#endif
+            && (NULL == pCurr_thread || pT->priority != pCurr_thread->priority))
+        return ct_enqueue_event(pE);
+
+    CT_TRACE_EVENT( CT_TRACE_POST, pCurr_thread, pE->type );
+
+    if (NULL == pT) {
+        /* Invalid addressee; silently discard event */
+
+        ctDataStore.ct_destruct_event( &pE);
+        return CT_OKAY;
+    }
+
+    /* A message to itself wakes the sender after its step, at */
+    /* the message's priority, as it would through the queue.  */
+
+    if (ct_deliver_event(pE, pT) != CT_OKAY) {
+        if ( 0 == pE->refcount)
+            ctDataStore.ct_destruct_event( &pE);
+        return CT_ERROR;
     }
 
     if (pT == pCurr_thread)
+        return CT_OKAY;
 
-        /* Don't enqueue the originator yet -- wait until */
-        /* all other affected threads have been enqueued. */
+#if CT_POLICY == CT_POLICY_MULTILEVEL && ! defined CT_WORKERS
+    if (handoff && pCurr_thread != NULL) {
+        if (pCurr_thread != pHandoff_to)
+            handoff_run = 0; /* a new run of handoffs */
 
-        self_msg = 1;
-    else
-        enqueue(pT);
+        if (handoff_run < CT_HANDOFF_MAX && pT->pPrev != pri_q + curr_priority
+                && queued_priority(pT) >= curr_priority) {
+            /* Take the sender's turn */
+
+            unlink_thread(pT);
+            pT->pPrev = pri_q + curr_priority;
+            pT->pNext = pri_q[ curr_priority ].pNext;
+            pri_q[ curr_priority ].pNext->pPrev = pT;
+            pri_q[ curr_priority ].pNext = pT;
+            mark_ready(curr_priority);
+
+            ++handoff_run;
+            pHandoff_to = pT;
+        }
+    }
+#endif
 
     return CT_OKAY;
 }
 
+/****************************************************************
+ Enable (or disable) handoff for ct_send_event().  Return the
+ previous setting.  Under CT_WORKERS, handoff has no effect: the
+ addressee may already be running on another worker.
+ ***************************************************************/
+
+int CTScheduler::ct_set_handoff(int on) {
+    int prev = handoff;
+
+    handoff = on ? 1 : 0;
+    handoff_run = 0;
+    pHandoff_to = NULL;
+    return prev;
+}
+
 /****************************************************************
  Attach a message to a specified thread.
 
@@ -1140,14 +3234,35 @@ void CTScheduler::attach_msg(Ct_msgnode * pM, Ct_thread * pT) {
 }
 
 /****************************************************************
- Enqueue a specified thread for execution at the highest priority.
+ Enqueue a specified thread for execution at the specified
+ priority (that of the event waking it), or its own, whichever is
+ higher.
  ***************************************************************/
 
-void CTScheduler::enqueue(Ct_thread * pT) {
-    int saved_priority;
-
+void CTScheduler::enqueue(Ct_thread * pT, int priority) {
     ASSERT( pT != NULL );
     ASSERT( CT_MAGIC == pT->magic );
+    CT_TRACE_EVENT( CT_TRACE_WAKEUP, pT, 0 );
+
+#if defined CT_WORKERS
+
+    /* A thread held by a worker is on no list, whatever its   */
+    /* status says.  Marking it awakened is enough: when its   */
+    /* dispatch ends, step() puts it back on the priority queue. */
+
+    if (pT->claim_level >= 0) {
+        pT->status = CT_STATUS_AWAKENED;
+        return;
+    }
+#endif
+
+#if defined CT_TIMEOUT
+
+    /* Waking a thread early cancels its timeout */
+
+    if (CT_STATUS_TIMEOUT == pT->status)
+        --timeout_count;
+#endif
 
     /* Remove the thread from whatever list it's on -- unless   */
     /* it's already in an awakened state, meaning that it has   */
@@ -1156,8 +3271,7 @@ void CTScheduler::enqueue(Ct_thread * pT) {
     /* repeatedly moving a thread to the end of the list. */
 
     if (pT->status != CT_STATUS_AWAKENED) {
-        pT->pNext->pPrev = pT->pPrev;
-        pT->pPrev->pNext = pT->pNext;
+        unlink_thread(pT);
         pT->pPrev = pT->pNext = NULL;
     }
 
@@ -1167,27 +3281,106 @@ void CTScheduler::enqueue(Ct_thread * pT) {
         /* other recipients have been enqueued first. */
 
         self_msg = 1;
+        if (priority < self_priority)
+            self_priority = priority;
         pT->status = CT_STATUS_AWAKENED;
     }
     else
-        if (CT_STATUS_AWAKENED == pT->status)
+        if (CT_STATUS_AWAKENED == pT->status) {
 
             /* As noted above: in this case the thread is already */
-            /* queued at the highest priority, so we leave it     */
-            /* where it is. */
-
-            ;
+            /* queued, so we leave it where it is -- unless this  */
+            /* event is more urgent than whatever woke it.  (Nor  */
+            /* do we move a thread parked for its group's sake.)  */
+
+#if CT_POLICY == CT_POLICY_MULTILEVEL || CT_POLICY == CT_POLICY_EDF
+            if (priority < pT->priority && priority < queued_priority(pT)) {
+                unlink_thread(pT);
+                insert_at(pT, priority);
+                pT->status = CT_STATUS_AWAKENED;
+            }
+#endif
+        }
         else {
-            /* Enqueue the thread at the highest priority. */
-
-            saved_priority = pT->priority;
-            pT->priority = 0;
-            insert_thread(pT);
-            pT->priority = saved_priority;
+            insert_at(pT, priority);
             pT->status = CT_STATUS_AWAKENED;
         }
 }
 
+/****************************************************************
+ Insert a thread into the priority queue at the specified priority,
+ or its own, whichever is higher.  Under a proportional policy an
+ awakened thread runs ahead of the rest regardless.
+ ***************************************************************/
+
+void CTScheduler::insert_at(Ct_thread * pT, int priority) {
+    int saved_priority;
+
+#if CT_POLICY == CT_POLICY_STRIDE || CT_POLICY == CT_POLICY_LOTTERY
+    priority = 0;
+#endif
+
+    saved_priority = pT->priority;
+    if (priority < saved_priority)
+        pT->priority = priority;
+    insert_thread(pT);
+    pT->priority = saved_priority;
+}
+
+/****************************************************************
+ Return the specified priority, or that of the most urgent message
+ waiting for a thread, whichever is higher.
+
+ We scan the whole input queue, on the same assumption as
+ attach_msg(): that it is generally short or empty.  Hence a
+ thread's inherited priority needs no bookkeeping as messages
+ come and go; it lapses when the queue drains.
+ ***************************************************************/
+
+int CTScheduler::inherit_priority(Ct_thread * pT, int priority) {
+    Ct_msgnode * pM;
+
+    for (pM = pT->msg_q; pM != NULL; pM = pM->pNext) {
+        ASSERT( MSGNODE_MAGIC == pM->magic );
+        if (pM->pE->priority < priority)
+            priority = pM->pE->priority;
+    }
+
+    return priority;
+}
+
+/****************************************************************
+ Return the priority at which a thread is queued, by finding the
+ dummy thread at the head of its list.  Under EDF a real-time
+ thread counts as priority 0, and the rest rank one level below
+ their queue.  Return -1 for a thread parked on its group's list
+ (CT_GROUPS), which is on no level, and should stay where it is.
+ ***************************************************************/
+
+int CTScheduler::queued_priority(Ct_thread * pT) {
+    Ct_thread * pDummy;
+
+#if CT_POLICY == CT_POLICY_EDF
+    if (pT->rt_period > 0)
+        return 0;
+#endif
+
+    for (pDummy = pT->pNext; pDummy->status != CT_STATUS_DUMMY;
+            pDummy = pDummy->pNext)
+        ASSERT( CT_MAGIC == pDummy->magic );
+
+#if defined CT_GROUPS
+    if (pDummy == &groups[ pT->group ].parked)
+        return -1;
+#endif
+
+#if CT_POLICY == CT_POLICY_EDF
+    return (int) (pDummy - pri_q) - 1;
+#else
+    return (int) (pDummy - pri_q);
+#endif
+}
+
 /****************************************************************
  Dispatch an event to a single thread.
  ***************************************************************/
@@ -1232,6 +3425,19 @@ void CTScheduler::ct_open(void) {
 #endif
     }
 
+#if defined CT_READY_BITMAP
+    for (i = 0; i < CT_READY_WORDS; ++i)
+        ready_map[ i ] = 0;
+    ready_summary = 0;
+#endif
+
+#if CT_POLICY == CT_POLICY_STRIDE
+    base_pass = 0;
+#elif CT_POLICY == CT_POLICY_EDF
+    edf_util = 0;
+    edf_misses = 0;
+#endif
+
     sleepers.pNext = &sleepers;
     sleepers.pPrev = &sleepers;
     sleepers.status = CT_STATUS_DUMMY;
@@ -1244,6 +3450,24 @@ void CTScheduler::ct_open(void) {
 #ifndef NDEBUG
     sleepers.magic = CT_MAGIC;
 #endif
+
+#if defined CT_TIMEOUT
+    for (i = 0; i < CT_WHEEL_SLOTS; ++i) {
+        timer_wheel[ i ].pNext = timer_wheel[ i ].pPrev = timer_wheel + i;
+        timer_wheel[ i ].status = CT_STATUS_DUMMY;
+        timer_wheel[ i ].priority = 9999;
+        timer_wheel[ i ].incarnation = 0;
+        timer_wheel[ i ].pData = NULL;
+        timer_wheel[ i ].msg_q = NULL;
+        timer_wheel[ i ].step = NULL;
+        timer_wheel[ i ].destruct = NULL;
+#ifndef NDEBUG
+        timer_wheel[ i ].magic = CT_MAGIC;
+#endif
+    }
+
+    timeout_count = 0;
+#endif
 }
 
 #ifdef CT_RETURN
@@ -1,6 +1,7 @@
 #ifndef CTSCHEDULER_H_
 #define CTSCHEDULER_H_
 
+#include <limits.h>
 #include "ct.h"
 #include "ctutil.h"
 #include "ctpriv.h"
@@ -8,17 +9,160 @@
 //#include "CTDataStore.h"
 #include "CTOut.h"
 #include "CTAssert.h"
+#include "CTInbox.h"
+#include "CTPartitions.h"
+#include "CTCoroutine.h"
+#include "CTFiber.h"
+#include "CTTrace.h"
+#include "CTReplay.h"
+#include "CTAio.h"
+#include "CTDeque.h"
+
+/* Geometry of the readiness bitmap.  Each bit of a word in  */
+/* ready_map stands for one priority level, and each bit of  */
+/* ready_summary stands for one word of ready_map.  Hence    */
+/* CT_PRIORITY_MAX may range up to CT_READY_BITS squared,    */
+/* minus one, without making pick_thread() any slower. */
+
+#if defined CT_READY_BITMAP
+
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define CT_READY_BITS 64
+#else
+#define CT_READY_BITS 32
+#endif
+
+#define CT_READY_WORDS ( CT_PRIORITY_MAX / CT_READY_BITS + 1 )
+
+#if CT_READY_WORDS > CT_READY_BITS
+#error "CT_PRIORITY_MAX is too large for the readiness bitmap"
+#endif
+
+#endif
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+#define CT_LOTTERY_LEVELS 2
+#endif
+
+#if defined CT_TIMEOUT
+
+#include <time.h>
+
+#if ( CT_WHEEL_SLOTS & ( CT_WHEEL_SLOTS - 1 ) ) != 0
+#error "CT_WHEEL_SLOTS must be a power of two"
+#endif
+
+#endif
+
+#if defined CT_EPOLL && ! defined __linux__
+#error "CT_EPOLL requires Linux"
+#endif
+
+#if defined CT_AIO && ! defined __linux__
+#error "CT_AIO requires Linux"
+#endif
+
+#if defined CT_SNAPSHOT && ! defined __unix__
+#error "CT_SNAPSHOT requires a POSIX system"
+#endif
+
+#if defined CT_WATCHDOG_BACKTRACE
+#if ! defined CT_WATCHDOG
+#error "CT_WATCHDOG_BACKTRACE requires CT_WATCHDOG"
+#endif
+#if ! defined __linux__
+#error "CT_WATCHDOG_BACKTRACE requires Linux"
+#endif
+#include <signal.h>
+#include <time.h>
+#endif
+
+#if defined CT_AIO && CT_MSG_BUF_LEN < 16
+#error "CT_AIO requires CT_MSG_BUF_LEN of at least 16, for a Ct_aio_result"
+#endif
+
+#if defined CT_EPOLL && CT_MSG_BUF_LEN < 8
+#error "CT_EPOLL requires CT_MSG_BUF_LEN of at least 8, for a Ct_fd_ready"
+#endif
+
+#if defined CT_WORKERS
+#if ! defined CT_THREADSAFE
+#error "CT_WORKERS requires CT_THREADSAFE"
+#endif
+#if CT_WORKERS < 1
+#error "CT_WORKERS must be at least 1"
+#endif
+#if CT_POLICY == CT_POLICY_EDF
+#error "CT_POLICY_EDF cannot be combined with CT_WORKERS"
+#endif
+#if defined CT_GROUPS || defined CT_COROUTINES || defined CT_FIBERS
+#error "CT_WORKERS cannot be combined with CT_GROUPS, CT_COROUTINES or CT_FIBERS"
+#endif
+#if defined CT_EPOLL || defined CT_AIO || defined CT_REPLAY || defined CT_SNAPSHOT
+#error "CT_WORKERS cannot be combined with CT_EPOLL, CT_AIO, CT_REPLAY or CT_SNAPSHOT"
+#endif
+#if defined CT_WATCHDOG_BACKTRACE
+#error "CT_WORKERS cannot be combined with CT_WATCHDOG_BACKTRACE"
+#endif
+#include <pthread.h>
+#endif
+
+#if CT_POLICY == CT_POLICY_EDF
+#if ! defined CT_TIMEOUT
+#error "CT_POLICY_EDF requires CT_TIMEOUT"
+#endif
+#if CT_PRIORITY_MAX < 1
+#error "CT_POLICY_EDF requires CT_PRIORITY_MAX of at least 1"
+#endif
+#endif
+
+/* Record a trace event, or do nothing if tracing is compiled out: */
+
+#if defined CT_TRACE
+#define CT_TRACE_EVENT( kind, pThread, arg ) \
+    trace.ct_record( ( kind ), ( pThread ), ( arg ) )
+#else
+#define CT_TRACE_EVENT( kind, pThread, arg ) ( (void) 0 )
+#endif
+
+/* Under CT_WORKERS, what concerns the thread being dispatched */
+/* belongs to the worker dispatching it, i.e. to an OS thread. */
+/* Everything else shared by the workers is guarded by the     */
+/* scheduler lock, which is recursive, since the functions     */
+/* that take it also call one another.  CT_LOCK() and          */
+/* CT_UNLOCK() take and release it within the scheduler;      */
+/* CT_LOCKED() holds it for the rest of the enclosing block.   */
+
+#if defined CT_WORKERS
+#define CT_PER_WORKER static thread_local
+#define CT_LOCK() pthread_mutex_lock( &sched_lock )
+#define CT_UNLOCK() pthread_mutex_unlock( &sched_lock )
+#define CT_LOCKED( sched ) CTSchedLock ct_locked( sched )
+#else
+#define CT_PER_WORKER
+#define CT_LOCK() ( (void) 0 )
+#define CT_UNLOCK() ( (void) 0 )
+#define CT_LOCKED( sched ) ( (void) 0 )
+#endif
 
 class CTDataStore;
 
 class CTScheduler {
 
+#if defined CT_QUANTUM && defined CT_TIMEOUT
+
+        /* Clock reading when the current thread was dispatched, */
+        /* if it has a time budget: */
+
+        CT_PER_WORKER Ct_time quantum_start;
+#endif
+
 #ifdef CT_RETURN
 
         /* to be used by ct_return(): */
 
-        jmp_buf jumper;
-        int jump_rc; /* status code returned by thread */
+        CT_PER_WORKER jmp_buf jumper;
+        CT_PER_WORKER int jump_rc; /* status code returned by thread */
 
 #endif
 
@@ -32,7 +176,151 @@ class CTScheduler {
         
         Ct_handle ct_self(void);
         int ct_enqueue_event(Ct_event * pE);
+        int ct_send_event(Ct_event * pE);
+        int ct_set_handoff(int on);
+#if defined CT_WAKEUPS
+        int ct_post_wakeup(Ct_handle dest);
+        int ct_post_wakeup_subscribers(Ct_msgtype type);
+        void ct_post_wakeup_all(void);
+        Ct_wakeup_stats ct_wakeup_stats(void);
+#endif
+#if defined CT_MAILBOX
+        int ct_set_mailbox(Ct_handle handle, unsigned capacity,
+                Ct_overflow_policy policy);
+        int ct_mailbox_stats(Ct_handle handle, Ct_mailbox_stats * pStats);
+        int ct_admit_msg(Ct_event * pE);
+#endif
+        void ct_remove_msg(Ct_thread * pT);
+
+        /* Priority carried by the events that the current thread */
+        /* sends: its own, or that of the most urgent message it  */
+        /* had waiting when dispatched, whichever is higher.  0   */
+        /* (the highest) outside of a thread. */
+
+        int ct_sender_priority(void) const {
+            return sender_priority;
+        }
+
+        /* Take and release the scheduler lock, for the message */
+        /* transport and dispatcher; no-ops unless CT_WORKERS.  */
+
+        void ct_lock(void) {
+            CT_LOCK();
+        }
+        void ct_unlock(void) {
+            CT_UNLOCK();
+        }
+#if defined CT_WORKERS
+        int ct_set_workers(unsigned n);
+        int ct_worker_stats(unsigned worker, Ct_worker_stats * pStats);
+#endif
+#if defined CT_COROUTINES
+        int ct_create_coroutine(Ct_handle * pHandle, int priority,
+                CTCoroutine co);
+        CTFramePool * ct_frame_pool(void);
+#endif
+#if defined CT_FIBERS
+        int ct_create_fiber(Ct_handle * pHandle, int priority,
+                Ct_fiber_function body, void * pData, Ct_destructor destruct);
+        void ct_fiber_yield(void);
+#endif
+#if defined CT_EPOLL
+        int ct_wait_on_fd(int fd, unsigned events);
+        int ct_cancel_fd_wait(int fd);
+#endif
+#if defined CT_AIO
+        void * ct_aio_buffer(void);
+        void ct_aio_release(void * buff);
+        int ct_aio_read(int fd, void * buff, unsigned long len,
+                long long offset);
+        int ct_aio_write(int fd, void * buff, unsigned long len,
+                long long offset);
+        int ct_aio_fsync(int fd);
+#endif
         int ct_deliver_event(Ct_event * pE, Ct_thread * pT);
+#if defined CT_REPLAY
+        int ct_record_schedule(Ct_replay_writer writer);
+        int ct_replay_schedule(Ct_replay_reader reader);
+        void ct_end_replay(void);
+#endif
+#if defined CT_SNAPSHOT
+        int ct_save_snapshot(const char * path, Ct_thread_saver saver);
+        int ct_restore_snapshot(const char * path,
+                Ct_thread_restorer restorer);
+#endif
+#if defined CT_WATCHDOG
+        int ct_set_step_budget(Ct_handle handle, Ct_cycles budget);
+        Ct_overrun_handler ct_install_overrun_handler(Ct_overrun_handler f);
+        unsigned ct_set_overrun_penalty(unsigned penalty);
+        int ct_watchdog_stats(Ct_handle handle, Ct_watchdog_stats * pStats);
+#if defined CT_WATCHDOG_BACKTRACE
+        int ct_set_hard_limit(unsigned long usecs);
+#endif
+#endif
+#if defined CT_TRACE
+        unsigned long ct_trace_dump(void * buff, unsigned long len);
+        void ct_trace_clear(void);
+#endif
+#if defined CT_TIMEOUT
+        Ct_idle_function ct_install_idle_function(Ct_idle_function f);
+        Ct_idle_stats ct_idle_stats(void);
+#endif
+#if defined CT_QUANTUM
+        int ct_set_quantum(Ct_handle handle, unsigned steps);
+        int ct_quantum_stats(Ct_handle handle, Ct_quantum_stats * pStats);
+#if defined CT_TIMEOUT
+        int ct_set_quantum_ticks(Ct_handle handle, unsigned long ticks);
+#endif
+#endif
+        int ct_set_weight(Ct_handle handle, unsigned weight);
+#if CT_POLICY == CT_POLICY_EDF
+        int ct_create_rt_thread(Ct_handle * pHandle, unsigned long period,
+                unsigned long cost, void * pData, Ct_step_function step,
+                Ct_destructor destruct);
+        unsigned long ct_deadline_misses(void);
+        unsigned long ct_utilization(void);
+#endif
+#if defined CT_STATS
+        int ct_thread_stats(Ct_handle handle, Ct_thread_stats * pStats);
+#endif
+#if defined CT_GROUPS
+        int ct_create_group(unsigned * pGroup, unsigned weight, unsigned cap);
+        int ct_set_group_window(Ct_cycles window);
+        int ct_group_stats(unsigned group, Ct_group_stats * pStats);
+#endif
+#if defined CT_GROUPS
+        int ct_create_threads(Ct_handle * pHandles, unsigned count,
+                int priority, void * const * ppData, Ct_step_function step,
+                Ct_destructor destruct, unsigned group = 0);
+#else
+        int ct_create_threads(Ct_handle * pHandles, unsigned count,
+                int priority, void * const * ppData, Ct_step_function step,
+                Ct_destructor destruct);
+#endif
+#if defined CT_PERIODIC
+        int ct_create_periodic_thread(Ct_handle * pHandle,
+                unsigned long period, unsigned long phase,
+                Ct_periodic_policy policy, int priority, void * pData,
+                Ct_step_function step, Ct_destructor destruct);
+        int ct_periodic_stats(Ct_handle handle, Ct_periodic_stats * pStats);
+#endif
+
+#if defined CT_THREADSAFE
+
+        /* The only functions that OS threads other than the */
+        /* one running the scheduler may call: */
+
+        int ct_post_msg(Ct_msgtype type, const void * pData, size_t len,
+                Ct_handle dest);
+        int ct_post_enq(Ct_handle dest);
+
+        /* Membership in a group of partitions: */
+
+        void ct_set_partition(CTPartitions * pGroup, unsigned id);
+        int ct_is_remote(const Ct_handle * pH);
+        int ct_send_remote(Ct_event_type ev_type, Ct_msgtype type,
+                const void * pData, size_t len, Ct_handle dest);
+#endif
             
 
         // library-accessible "private" interface
@@ -46,29 +334,231 @@ class CTScheduler {
 
         Ct_thread pri_q[CT_PRIORITY_MAX + 1 ];
 
+#if defined CT_READY_BITMAP
+
+        /* Readiness bitmap: bit i of ready_map is set if and only */
+        /* if pri_q[ i ] is non-empty, and bit w of ready_summary  */
+        /* is set if and only if ready_map[ w ] is non-zero. */
+
+        unsigned long ready_map[ CT_READY_WORDS ];
+        unsigned long ready_summary;
+#endif
+
+#if CT_POLICY == CT_POLICY_STRIDE
+
+        /* Virtual time corresponding to pri_q[ 0 ]: */
+
+        unsigned long base_pass;
+#elif CT_POLICY == CT_POLICY_LOTTERY
+
+        /* State of the random number generator for draws: */
+
+        unsigned long lottery_state;
+
+        /* Draws are held among the threads with messages, at */
+        /* level 0, and among the rest, at level 1: */
+
+        Ct_lottery lottery[ CT_LOTTERY_LEVELS ];
+#elif CT_POLICY == CT_POLICY_EDF
+
+        /* Real-time threads occupy pri_q[ 0 ] in order of deadline. */
+        /* Total CPU share reserved by them, and the deadlines they  */
+        /* have missed: */
+
+        unsigned long edf_util;
+        unsigned long edf_misses;
+#endif
+
         /* Dummy heading a doubly-linked list of */
         /* threads waiting on an event */
 
         Ct_thread sleepers;
-        Ct_thread *pCurr_thread;
+        CT_PER_WORKER Ct_thread *pCurr_thread;
+
+#if defined CT_FIBERS
+
+        /* Our own stack pointer while a fiber runs: */
+
+        void * fiber_return_sp;
+
+        /* Stacks of finished fibers, for reuse: */
+
+        Ct_fiber * free_fibers;
+#endif
+
+#if defined CT_COROUTINES
+
+        /* Free frames for coroutines that name us (CTCoroutine.h): */
+
+        CTFramePool frame_pool;
+#endif
+
+#if defined CT_TIMEOUT
+
+        /* Hashed timing wheel for threads awaiting a timeout.  */
+        /* Each slot anchors a doubly-linked list of threads    */
+        /* whose deadlines hash to it by tick.  Every pending   */
+        /* deadline is at or after wheel_time, which is the     */
+        /* clock reading at the most recent sweep. */
+
+        Ct_thread timer_wheel[ CT_WHEEL_SLOTS ];
+        Ct_time wheel_time;
+        unsigned long timeout_count;
+
+        Ct_clock ticker;
+
+        /* Idle strategy and idle/busy accounting: */
+
+        Ct_idle_function idle_function;
+        int idling; /* boolean: no thread was runnable */
+        Ct_time idle_since;
+        Ct_time busy_since;
+        Ct_idle_stats idle_stats;
+#endif
+
+#if defined CT_GROUPS
+
+        /* Groups of threads, and the virtual time before which */
+        /* none need be held back; the current window, for caps: */
+
+        Ct_group groups[ CT_GROUPS_MAX ];
+        unsigned long group_base_pass;
+        Ct_cycles group_window;
+        Ct_cycles window_start;
+#endif
+
+#if defined CT_WATCHDOG
+
+        /* What to do about a step that overruns its budget: */
+
+        Ct_overrun_handler overrun_handler;
+        unsigned overrun_penalty;
+#if defined CT_WATCHDOG_BACKTRACE
+
+        /* Timer for catching a step in the act, once created, */
+        /* and how long a step may run before it goes off (0   */
+        /* for never): */
+
+        timer_t watchdog_timer;
+        int watchdog_created; /* boolean */
+        unsigned long hard_limit;
+#endif
+#endif
+
+#if defined CT_EPOLL
+
+        /* epoll instance for threads awaiting file descriptors, */
+        /* or -1 until the first wait; the waits, indexed by fd; */
+        /* and loops until the next check that doesn't block: */
+
+        int epoll_fd;
+        Ct_fd_wait * fd_waits;
+        int fd_waits_max;
+        unsigned long fd_wait_count;
+        unsigned epoll_countdown;
+#if defined CT_AIO
+        int aio_watch_fd; /* the AIO eventfd it watches, or -1 */
+#endif
+#endif
+
+#if defined CT_AIO
+
+        /* Asynchronous I/O requested by threads: */
+
+        CTAio aio;
+#endif
 
         /* Ptrs to head and tail of event queue */
 
         Ct_event * ev_head;
         Ct_event * ev_tail;
 
+#if defined CT_WAKEUPS
+
+        /* Pending wakeups: threads, subscribed message types, and */
+        /* everybody.  wake_event is a permanent enqueue event for */
+        /* delivering them. */
+
+        Ct_handle wake_q[ CT_WAKE_SLOTS ];
+        unsigned wake_count;
+        Ct_msgtype wake_types[ CT_WAKE_TYPES ];
+        int wake_type_priority[ CT_WAKE_TYPES ];
+        unsigned wake_type_count;
+        int wake_all; /* boolean */
+        int wake_all_priority;
+        int wakeups; /* boolean: some of the above are pending */
+        Ct_event wake_event;
+        Ct_wakeup_stats wakeup_stats;
+#endif
+
+#if defined CT_TRACE
+        CTTrace trace;
+#endif
+
+#if defined CT_REPLAY
+
+        /* Log of inputs, and scheduler loops since the last */
+        /* posted event was logged or replayed: */
+
+        CTReplay replay;
+        unsigned long replay_loops;
+#endif
+
+#if defined CT_THREADSAFE
+
+        /* Events posted by other OS threads, not yet */
+        /* transferred to the event queue: */
+
+        CTInbox inbox;
+
+        /* The group of partitions we belong to, if any, */
+        /* and our place in it: */
+
+        CTPartitions * partitions;
+        unsigned partition_id;
+        int partition_idle; /* boolean: we have told the group so */
+#endif
+
+#if defined CT_WORKERS
+
+        /* M:N execution (see CTWorkers.cpp): the lock, and the   */
+        /* condition on which idle workers nap; each worker's     */
+        /* deque and counters; how many workers to run, how many  */
+        /* are napping, and how many threads they hold between    */
+        /* them, off every list. */
+
+        pthread_mutex_t sched_lock;
+        pthread_cond_t work_cond;
+        CTDeque deques[ CT_WORKERS ];
+        Ct_worker_stats worker_stats[ CT_WORKERS ];
+        unsigned worker_count;
+        unsigned napping;
+        unsigned long claimed_count;
+        int workers_done; /* boolean: no worker will find more to do */
+        static thread_local unsigned worker_id;
+#endif
+
         /* Index into priority queue of current thread, if any: */
 
-        int curr_priority;
+        CT_PER_WORKER int curr_priority;
 
-        unsigned pri_penalty;
+        /* Effective priority of the current thread, as of its */
+        /* dispatch, for stamping the events it sends: */
+
+        CT_PER_WORKER int sender_priority;
+
+        CT_PER_WORKER unsigned pri_penalty;
         unsigned init_countdown;
         unsigned countdown;
 
         int opened; /* boolean for enforcing initialization */
         int fatal_error; /* boolean for noting fatal error */
         int halted; /* boolean for halting scheduler  */
-        int self_msg; /* boolean for message to self */
+        CT_PER_WORKER int self_msg; /* boolean for message to self */
+        CT_PER_WORKER int self_priority; /* most urgent of those messages */
+        int handoff; /* boolean for running a message's addressee next */
+        unsigned handoff_run; /* handoffs in a row */
+        Ct_thread * pHandoff_to; /* thread given the last of them */
 
         /* function pointers for user exits, to be invoked */
         /* just before and just after each thread step:    */
@@ -78,21 +568,125 @@ class CTScheduler {
 
 
         void pick_thread(void);
+        void pick_ready(void);
+        void mark_ready(int i);
+        void mark_empty(int i);
+        int next_ready(int i);
+        void unlink_thread(Ct_thread * pThread);
         int step();
+#if defined CT_QUANTUM
+        int continue_quantum(unsigned steps);
+#endif
+#if CT_POLICY == CT_POLICY_STRIDE
+        int stride_level(Ct_thread * pThread);
+        int advance_virtual_time(int level);
+#elif CT_POLICY == CT_POLICY_LOTTERY
+        Ct_thread * draw_lottery(int level);
+        int lottery_enter(Ct_thread * pThread, int level);
+        void lottery_leave(Ct_thread * pThread);
+        void lottery_reweigh(Ct_thread * pThread, unsigned weight);
+        void clear_lottery(void);
+#elif CT_POLICY == CT_POLICY_EDF
+        void edf_insert(Ct_thread * pThread);
+        void edf_release(Ct_thread * pThread);
+        void edf_complete(Ct_thread * pThread);
+#endif
         int insert_thread(Ct_thread * pThread);
-        void ct_wait_on_timeout(unsigned long interval);
-        void insert_timeout(void);
+#if defined CT_COROUTINES
+        int resume_coroutine(Ct_thread * pThread);
+        int coroutine_awaiting(Ct_thread * pThread);
+#endif
+#if defined CT_FIBERS
+        int resume_fiber(Ct_thread * pThread);
+#endif
+        int ct_wait_on_timeout(unsigned long interval);
+        Ct_time read_clock(void);
+#if defined CT_REPLAY
+        void note_creation(Ct_thread * pThread);
+#endif
+        void insert_timeout(Ct_thread * pThread);
         int check_timeouts(void);
-        Ct_time default_clock(void);
+#if defined CT_PERIODIC
+        void periodic_complete(Ct_thread * pThread);
+        void release_periodic(Ct_thread * pThread);
+#endif
+        void clear_timer_wheel(void);
+        Ct_time next_deadline(void);
+        void enter_idle(void);
+#if defined CT_EPOLL || defined CT_AIO
+        int idle_ms(const Ct_time * pNow);
+#endif
+#if defined CT_EPOLL
+        void poll_fds(int timeout_ms);
+        void drop_fd_wait(Ct_thread * pThread);
+        void close_epoll(void);
+#if defined CT_AIO
+        int watch_aio(void);
+#endif
+#endif
+#if defined CT_GROUPS
+        int valid_group(unsigned group);
+        void clear_groups(void);
+        int group_held(Ct_group * pG);
+        void park_thread(Ct_thread * pThread);
+        void unpark_groups(void);
+        int release_groups(void);
+        int groups_parked(void);
+        void wait_window(void);
+        void charge_group(Ct_thread * pThread, Ct_cycles started,
+                Ct_cycles elapsed);
+        void new_window(void);
+#endif
+#if defined CT_WATCHDOG
+        void note_overrun(Ct_cycles elapsed);
+#if defined CT_WATCHDOG_BACKTRACE
+        void set_watchdog(unsigned long usecs);
+        void close_watchdog(void);
+        static void watchdog_handler(int sig);
+#endif
+#endif
+#if defined CT_SNAPSHOT
+        unsigned long collect_threads(Ct_snap_id * ids);
+        void save_thread(Ct_snap_out * pOut, Ct_thread * pThread,
+                Ct_thread_saver saver);
+        void save_event(Ct_snap_out * pOut, const Ct_event * pE,
+                unsigned long addressee);
+        int restore_thread(Ct_snap_in * pIn, Ct_thread_restorer restorer,
+                Ct_thread ** ppThread);
+        Ct_event * restore_event(Ct_snap_in * pIn, Ct_thread ** threads,
+                unsigned long count);
+        void discard_restored(void);
+#endif
+#if defined CT_AIO
+        int queue_aio(Ct_aio_op op, int fd, void * buff, unsigned long len,
+                long long offset);
+        void poll_aio(int wait);
+#endif
+        void leave_idle(void);
+        static Ct_time default_clock(void);
         int ct_timecmp(const Ct_time * t1, const Ct_time * t2);
         void scrunch_queue(void);
         void append_queue(int from, int to);
+        void splice_queue(int from, int to);
+#if defined CT_GROUPS
+        int ct_create_thread(Ct_handle * pHandle, int priority, void * pData,
+                Ct_step_function step, Ct_destructor destruct,
+                unsigned group = 0);
+        int ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
+                void * pData, Ct_step_function step, Ct_destructor destruct,
+                unsigned group = 0);
+#else
         int ct_create_thread(Ct_handle * pHandle, int priority, void * pData,
                 Ct_step_function step, Ct_destructor destruct);
         int ct_create_sleeping_thread(Ct_handle * pHandle, int priority,
                 void * pData, Ct_step_function step, Ct_destructor destruct);
+#endif
         void clear_priority_queue(void);
         void destruct_thread_list(Ct_thread ** ppFirst);
+#if defined CT_ARENA
+        void release_threads(void);
+        void release_thread_list(Ct_thread * pAnchor);
+#endif
         void ct_clear(void);
         void clean_up_all(void);
         Ct_user_exit ct_install_pre_function(Ct_user_exit f);
@@ -104,19 +698,71 @@ class CTScheduler {
         int ct_wait(void);
         void * ct_self_data(void);
         void dispatch_event_queue(void);
+#if defined CT_WAKEUPS
+        void dispatch_wakeups(void);
+#endif
+#if defined CT_THREADSAFE
+        void drain_inbox(void);
+        void drain_partitions(void);
+        void enqueue_posted(const Ct_posted_event * pPosted);
+#endif
+#if defined CT_WORKERS
+        static void * worker_main(void * p);
+        void run_workers(void);
+        void run_worker(void);
+        void run_claimed(Ct_thread * pThread, int stolen);
+        int find_work(void);
+        void housekeep(void);
+        unsigned claim_threads(void);
+        void release_claim(Ct_thread * pThread);
+        Ct_thread * steal_thread(void);
+#endif
         void dispatch_all(Ct_event * pE);
         int broadcast_to_queue(Ct_event * pE, Ct_thread * pT);
+        int attach_event(Ct_event * pE, Ct_thread * pT);
+#if defined CT_MAILBOX
+        int admit_attached(Ct_event * pE, Ct_thread * pT);
+        void count_msg(Ct_thread * pT);
+        int has_room(const Ct_thread * pT);
+        void wake_blocked_senders(Ct_thread * pT);
+#endif
         void attach_msg(Ct_msgnode * pM, Ct_thread * pT);
-        void enqueue(Ct_thread * pT);
+        void enqueue(Ct_thread * pT, int priority);
+        void insert_at(Ct_thread * pT, int priority);
+        int inherit_priority(Ct_thread * pT, int priority);
+        int queued_priority(Ct_thread * pT);
         void dispatch_addressee(Ct_event * pE);
         void ct_open(void);
         void ct_return(int rc);
         
 #if defined CT_TIMEOUT
    
-        void Ct_clock ct_install_clock(Ct_clock clock_function);
+        Ct_clock ct_install_clock(Ct_clock clock_function);
 #endif
 
 };
 
+#if defined CT_WORKERS
+
+/* Holds a scheduler's lock for as long as it is in scope; */
+/* see CT_LOCKED() above. */
+
+class CTSchedLock {
+
+    public:
+
+        CTSchedLock( CTScheduler& ctScheduler ) : sched( ctScheduler ) {
+            sched.ct_lock();
+        }
+        ~CTSchedLock() {
+            sched.ct_unlock();
+        }
+
+    private:
+
+        CTScheduler& sched;
+};
+
+#endif
+
 #endif /*CTSCHEDULER_H_*/
@@ -0,0 +1,901 @@
+/*****************************************************************
+ CTSnapshot -- the parts of CTScheduler that save the threads to a
+ file, and restore them from it after a restart.
+
+ The image is a sequence of 32-bit words in the byte order of the
+ machine that wrote it, with byte strings padded to a whole number
+ of words, so that it can be read in place wherever mmap() puts
+ it.  Threads are named by their place in the image.
+
+     header    'C' 'T' 'S' 'N'
+               version byte-order-mark threads events length
+     thread    flags ticks priority weight quantum capacity overflow
+               period policy release releases overruns skipped
+               data-length data...
+               subscriptions type...
+               messages event...
+     event     ev_type type dispatch addressee priority
+               length data...
+
+ The threads come in the order they are queued, runnable ones
+ first, and are followed by the events pending in the event queue.
+ A thread's messages are saved as events of their own, even if one
+ event went to several threads; each gets its own copy back.
+ Pending wakeups are delivered before saving, so they are saved as
+ messages too.
+
+ A thread awaiting a timeout is saved with the ticks it has left to
+ wait, and after a restore waits that long again.  A periodic
+ thread is saved with its period, its policy, its statistics, and
+ the ticks from now to its release -- the next one if it is
+ waiting, or the one it is about to run for, which may lie in the
+ past.  After a restore its releases keep the same phase relative
+ to the clock.  Without CT_TIMEOUT, a thread awaiting a timeout
+ comes back asleep; without CT_PERIODIC, a periodic thread comes
+ back as an ordinary one.
+
+ Compiled only if CT_SNAPSHOT is defined.
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "CTScheduler.h"
+#include "CTMessageDispatcher.h"
+
+#if defined CT_SNAPSHOT
+
+#define CT_SNAP_VERSION 3
+#define CT_SNAP_ORDER   0x01020304UL
+#define CT_SNAP_HEADER  24 /* bytes */
+#define CT_SNAP_NONE    0xFFFFFFFFUL /* no thread */
+#define CT_SNAP_ASLEEP    1 /* thread flags */
+#define CT_SNAP_TIMEOUT   2
+#define CT_SNAP_RELEASED  4 /* periodic: about to run for a release */
+#define CT_SNAP_RELEASING 8 /* periodic: awaiting its next release */
+#define CT_SNAP_LATE     16 /* periodic: the release is in the past */
+
+/* Lists other than the priority queue that may hold threads: */
+
+#if defined CT_TIMEOUT && defined CT_GROUPS
+#define CT_SNAP_LISTS ( 1 + CT_GROUPS_MAX + CT_WHEEL_SLOTS )
+#elif defined CT_TIMEOUT
+#define CT_SNAP_LISTS ( 1 + CT_WHEEL_SLOTS )
+#elif defined CT_GROUPS
+#define CT_SNAP_LISTS ( 1 + CT_GROUPS_MAX )
+#else
+#define CT_SNAP_LISTS 1
+#endif
+
+static const unsigned char snap_magic[ 4 ] = { 'C', 'T', 'S', 'N' };
+
+/* ---------------- building an image: ---------------------------- */
+
+/*****************************************************************
+ Make room for n more bytes in the image, or note that we can't.
+ ****************************************************************/
+
+static int snap_room(Ct_snap_out * pOut, unsigned long n) {
+    unsigned char * pNew;
+    unsigned long max;
+
+    if (pOut->failed)
+        return CT_FALSE;
+
+    if (pOut->max - pOut->len >= n)
+        return CT_TRUE;
+
+    max = pOut->max > 0 ? pOut->max * 2 : 4096;
+    while (max - pOut->len < n)
+        max *= 2;
+
+    pNew = (unsigned char *) realloc(pOut->buff, max);
+    if (NULL == pNew) {
+        pOut->failed = 1;
+        return CT_FALSE;
+    }
+
+    pOut->buff = pNew;
+    pOut->max = max;
+    return CT_TRUE;
+}
+
+/* Clamp a count of ticks to what a word can hold: */
+
+static unsigned long clip_ticks(unsigned long ticks) {
+    return ticks > 0xFFFFFFFFUL ? 0xFFFFFFFFUL : ticks;
+}
+
+static void put_word(Ct_snap_out * pOut, unsigned long w) {
+    if (snap_room(pOut, 4)) {
+        *(uint32_t *) (pOut->buff + pOut->len) = (uint32_t) w;
+        pOut->len += 4;
+    }
+}
+
+static void set_word(Ct_snap_out * pOut, unsigned long offset,
+        unsigned long w) {
+    if ( !pOut->failed)
+        *(uint32_t *) (pOut->buff + offset) = (uint32_t) w;
+}
+
+/* Append padding up to the next whole word: */
+
+static void put_pad(Ct_snap_out * pOut) {
+    while (pOut->len % 4 != 0 && snap_room(pOut, 1))
+        pOut->buff[ pOut->len++ ] = 0;
+}
+
+static void put_bytes(Ct_snap_out * pOut, const void * p, unsigned long n) {
+    put_word(pOut, n);
+    if (n > 0 && snap_room(pOut, n)) {
+        memcpy(pOut->buff + pOut->len, p, n);
+        pOut->len += n;
+    }
+    put_pad(pOut);
+}
+
+static int compare_ids(const void * p1, const void * p2) {
+    const Ct_thread * pT1 = ((const Ct_snap_id *) p1)->pThread;
+    const Ct_thread * pT2 = ((const Ct_snap_id *) p2)->pThread;
+
+    return pT1 < pT2 ? -1 : pT1 > pT2 ? 1 : 0;
+}
+
+/* ---------------- reading an image: ----------------------------- */
+
+static unsigned long get_word(Ct_snap_in * pIn) {
+    unsigned long w;
+
+    if (pIn->bad || pIn->len - pIn->pos < 4) {
+        pIn->bad = 1;
+        return 0;
+    }
+
+    w = *(const uint32_t *) (pIn->buff + pIn->pos);
+    pIn->pos += 4;
+    return w;
+}
+
+/*****************************************************************
+ Return a pointer to a byte string in the image, setting *pLen to
+ its length, or NULL if it runs off the end.
+ ****************************************************************/
+
+static const unsigned char * get_bytes(Ct_snap_in * pIn, unsigned long * pLen) {
+    const unsigned char * p;
+    unsigned long n;
+
+    n = get_word(pIn);
+    if (pIn->bad || pIn->len - pIn->pos < n) {
+        pIn->bad = 1;
+        return NULL;
+    }
+
+    p = pIn->buff + pIn->pos;
+    pIn->pos += n;
+    pIn->pos += (4 - pIn->pos % 4) % 4;
+    if (pIn->pos > pIn->len)
+        pIn->bad = 1;
+
+    *pLen = n;
+    return p;
+}
+
+/* ---------------- saving: --------------------------------------- */
+
+/*****************************************************************
+ Write the threads and pending events to a file, describing each
+ thread through the specified saver.  Not to be called while a
+ thread is running.
+ ****************************************************************/
+
+int CTScheduler::ct_save_snapshot(const char * path, Ct_thread_saver saver) {
+    Ct_snap_out out;
+    Ct_snap_id * ids;
+    Ct_snap_id key;
+    Ct_snap_id * pId;
+    Ct_event * pE;
+    unsigned long count;
+    unsigned long events = 0;
+    unsigned long i;
+    unsigned long addressee;
+    unsigned long done;
+    ssize_t n;
+    int fd;
+    int rc = CT_OKAY;
+
+    if (NULL == path || NULL == saver || curr_priority >= 0) {
+        CTOut::ct_report_error("ct_save_snapshot: invalid request");
+        return CT_ERROR;
+    }
+
+    if ( !opened) {
+        ct_open();
+        opened = 1;
+    }
+
+#if defined CT_WAKEUPS
+
+    /* Wakeups would otherwise be lost; deliver them now */
+
+    if (wakeups)
+        dispatch_wakeups();
+#endif
+
+    out.buff = NULL;
+    out.len = out.max = 0;
+    out.failed = 0;
+
+    /* Number the threads in the order they are to be saved */
+
+    count = collect_threads(NULL);
+    ids = (Ct_snap_id *) malloc((count > 0 ? count : 1) * sizeof(Ct_snap_id));
+    if (NULL == ids) {
+        CTOut::ct_report_error("ct_save_snapshot: out of memory");
+        return CT_ERROR;
+    }
+    collect_threads(ids);
+
+    if (snap_room( &out, CT_SNAP_HEADER)) {
+        memcpy(out.buff, snap_magic, sizeof( snap_magic ));
+        out.len = sizeof( snap_magic );
+    }
+    put_word( &out, CT_SNAP_VERSION);
+    put_word( &out, CT_SNAP_ORDER);
+    put_word( &out, count);
+    put_word( &out, 0); /* events, filled in below */
+    put_word( &out, 0); /* length, likewise */
+
+    for (i = 0; i < count; ++i)
+        save_thread( &out, (Ct_thread *) ids[ i ].pThread, saver);
+
+    /* Sort the numbers by address, to look up addressees */
+
+    qsort(ids, count, sizeof(Ct_snap_id), compare_ids);
+
+    for (pE = ev_head; pE != NULL; pE = pE->pNext) {
+        ASSERT( EVENT_MAGIC == pE->magic );
+
+        addressee = CT_SNAP_NONE;
+        if (CT_DISPATCH_ADDRESSEE == pE->dispatch_type && count > 0) {
+            key.pThread = (const Ct_thread *) pE->addressee.p;
+            pId = (Ct_snap_id *) bsearch( &key, ids, count,
+                    sizeof(Ct_snap_id), compare_ids);
+            if (pId != NULL
+                    && pId->pThread->incarnation == pE->addressee.incarnation)
+                addressee = pId->id;
+        }
+
+        save_event( &out, pE, addressee);
+        ++events;
+    }
+
+    free(ids);
+
+    set_word( &out, 16, events);
+    set_word( &out, 20, out.len);
+
+    if (out.failed) {
+        CTOut::ct_report_error("ct_save_snapshot: out of memory");
+        free(out.buff);
+        return CT_ERROR;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        CTOut::ct_report_error("ct_save_snapshot: unable to open file");
+        free(out.buff);
+        return CT_ERROR;
+    }
+
+    for (done = 0; done < out.len; done += n) {
+        n = write(fd, out.buff + done, out.len - done);
+        if (n <= 0) {
+            CTOut::ct_report_error("ct_save_snapshot: unable to write file");
+            rc = CT_ERROR;
+            break;
+        }
+    }
+
+    if (close(fd) != 0 && CT_OKAY == rc) {
+        CTOut::ct_report_error("ct_save_snapshot: unable to write file");
+        rc = CT_ERROR;
+    }
+
+    free(out.buff);
+    return rc;
+}
+
+/*****************************************************************
+ Number the live threads in the order they are to be saved: those
+ in the priority queue from the highest priority down (then any
+ held back for the sake of other groups), then the sleepers, then
+ those awaiting a timeout, slot by slot.  If ids is not NULL,
+ record them there.  Return how many there are.
+ ****************************************************************/
+
+unsigned long CTScheduler::collect_threads(Ct_snap_id * ids) {
+    Ct_thread * lists[ CT_PRIORITY_MAX + 1 + CT_SNAP_LISTS ];
+    Ct_thread * pThread;
+    unsigned long count = 0;
+    int n = 0;
+    int i;
+
+    for (i = 0; i <= CT_PRIORITY_MAX; ++i)
+        lists[ n++ ] = pri_q + i;
+#if defined CT_GROUPS
+    for (i = 0; i < CT_GROUPS_MAX; ++i)
+        lists[ n++ ] = &groups[ i ].parked;
+#endif
+    lists[ n++ ] = &sleepers;
+#if defined CT_TIMEOUT
+    for (i = 0; i < CT_WHEEL_SLOTS; ++i)
+        lists[ n++ ] = timer_wheel + i;
+#endif
+
+    for (i = 0; i < n; ++i) {
+        for (pThread = lists[ i ]->pNext; pThread != lists[ i ];
+                pThread = pThread->pNext) {
+            ASSERT( CT_MAGIC == pThread->magic );
+            if (CT_STATUS_DEFUNCT == pThread->status)
+                continue;
+
+            if (ids != NULL) {
+                ids[ count ].pThread = pThread;
+                ids[ count ].id = count;
+            }
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void CTScheduler::save_thread(Ct_snap_out * pOut, Ct_thread * pThread,
+        Ct_thread_saver saver) {
+    unsigned long offset;
+    unsigned need;
+    unsigned count;
+    Ct_sub * pSub;
+    Ct_msgnode * pNode;
+    unsigned long flags = 0;
+    unsigned long ticks = 0;
+#if defined CT_PERIODIC
+    unsigned long release = 0;
+#endif
+#if defined CT_TIMEOUT
+    Ct_time now;
+#endif
+
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    if (CT_STATUS_ASLEEP == pThread->status)
+        flags = CT_SNAP_ASLEEP;
+
+#if defined CT_TIMEOUT
+    if (CT_STATUS_TIMEOUT == pThread->status
+#if defined CT_PERIODIC
+            || pThread->period > 0
+#endif
+            )
+        now = read_clock();
+
+    if (CT_STATUS_TIMEOUT == pThread->status) {
+        flags = CT_SNAP_TIMEOUT;
+        ticks = ticks_between( &now, &pThread->deadline);
+    }
+#endif
+
+#if defined CT_PERIODIC
+    if (pThread->period > 0) {
+        if (pThread->released)
+            flags |= CT_SNAP_RELEASED;
+        if (pThread->releasing)
+            flags |= CT_SNAP_RELEASING;
+        if (ct_timecmp( &pThread->release, &now) < 0) {
+            flags |= CT_SNAP_LATE;
+            release = ticks_between( &pThread->release, &now);
+        }
+        else
+            release = ticks_between( &now, &pThread->release);
+    }
+#endif
+
+    put_word(pOut, flags);
+    put_word(pOut, clip_ticks(ticks));
+    put_word(pOut, pThread->priority);
+#if CT_POLICY != CT_POLICY_MULTILEVEL
+    put_word(pOut, pThread->weight);
+#else
+    put_word(pOut, CT_DEFAULT_WEIGHT);
+#endif
+#if defined CT_QUANTUM
+    put_word(pOut, pThread->quantum);
+#else
+    put_word(pOut, 1);
+#endif
+#if defined CT_MAILBOX
+    put_word(pOut, pThread->msg_capacity);
+    put_word(pOut, pThread->overflow);
+#else
+    put_word(pOut, 0); /* no limit */
+    put_word(pOut, 0); /* CT_OVERFLOW_REJECT */
+#endif
+
+#if defined CT_PERIODIC
+    put_word(pOut, clip_ticks(pThread->period));
+    put_word(pOut, pThread->periodic_policy);
+    put_word(pOut, clip_ticks(release));
+    put_word(pOut, pThread->periodic_stats.releases);
+    put_word(pOut, pThread->periodic_stats.overruns);
+    put_word(pOut, pThread->periodic_stats.skipped);
+#else
+    for (count = 0; count < 6; ++count)
+        put_word(pOut, 0);
+#endif
+
+    /* The saver's description, written straight into the image */
+    /* if it fits, or else again once we have made room:        */
+
+    offset = pOut->len;
+    put_word(pOut, 0);
+    if ( !pOut->failed) {
+        need = saver(pThread->pData, pThread->step, pThread->destruct,
+                pOut->buff + pOut->len, pOut->max - pOut->len);
+        if (need > pOut->max - pOut->len && snap_room(pOut, need))
+            saver(pThread->pData, pThread->step, pThread->destruct,
+                    pOut->buff + pOut->len, pOut->max - pOut->len);
+        if ( !pOut->failed) {
+            set_word(pOut, offset, need);
+            pOut->len += need;
+        }
+        put_pad(pOut);
+    }
+
+    count = 0;
+    for (pSub = pThread->subscriptions; pSub != NULL; pSub = pSub->pNext)
+        ++count;
+    put_word(pOut, count);
+    for (pSub = pThread->subscriptions; pSub != NULL; pSub = pSub->pNext)
+        put_word(pOut, pSub->type);
+
+    count = 0;
+    for (pNode = pThread->msg_q; pNode != NULL; pNode = pNode->pNext)
+        ++count;
+    put_word(pOut, count);
+    for (pNode = pThread->msg_q; pNode != NULL; pNode = pNode->pNext) {
+        ASSERT( MSGNODE_MAGIC == pNode->magic );
+        save_event(pOut, pNode->pE, CT_SNAP_NONE);
+    }
+}
+
+void CTScheduler::save_event(Ct_snap_out * pOut, const Ct_event * pE,
+        unsigned long addressee) {
+    ASSERT( EVENT_MAGIC == pE->magic );
+
+    put_word(pOut, pE->ev_type);
+    put_word(pOut, pE->type);
+    put_word(pOut, pE->dispatch_type);
+    put_word(pOut, addressee);
+    put_word(pOut, pE->priority);
+    put_bytes(pOut, pE->msg_len > CT_MSG_BUF_LEN ? pE->pData : pE->buff,
+            pE->msg_len);
+}
+
+/* ---------------- restoring: ------------------------------------ */
+
+/*****************************************************************
+ Rebuild the threads and pending events saved in a file, turning
+ each thread's description back into a thread through the
+ specified restorer.  There must be no threads yet.  If anything
+ goes wrong, whatever was restored is discarded.
+ ****************************************************************/
+
+int CTScheduler::ct_restore_snapshot(const char * path,
+        Ct_thread_restorer restorer) {
+    Ct_snap_in in;
+    Ct_thread ** threads = NULL;
+    Ct_event * pE;
+    struct stat st;
+    void * image;
+    unsigned long count;
+    unsigned long events;
+    unsigned long i;
+    int fd;
+    int rc = CT_OKAY;
+
+    if (NULL == path || NULL == restorer || curr_priority >= 0) {
+        CTOut::ct_report_error("ct_restore_snapshot: invalid request");
+        return CT_ERROR;
+    }
+
+    if ( !opened) {
+        ct_open();
+        opened = 1;
+    }
+
+    if (next_ready( 0 ) >= 0 || sleepers.pNext != &sleepers || ev_head != NULL
+#if defined CT_TIMEOUT
+            || timeout_count > 0
+#endif
+#if defined CT_GROUPS
+            || groups_parked()
+#endif
+#if defined CT_WAKEUPS
+            || wakeups
+#endif
+            ) {
+        CTOut::ct_report_error("ct_restore_snapshot: threads already exist");
+        return CT_ERROR;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        CTOut::ct_report_error("ct_restore_snapshot: unable to open file");
+        return CT_ERROR;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < CT_SNAP_HEADER) {
+        CTOut::ct_report_error("ct_restore_snapshot: not a snapshot");
+        close(fd);
+        return CT_ERROR;
+    }
+
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == image) {
+        CTOut::ct_report_error("ct_restore_snapshot: unable to map file");
+        return CT_ERROR;
+    }
+
+    in.buff = (const unsigned char *) image;
+    in.len = st.st_size;
+    in.pos = sizeof( snap_magic );
+    in.bad = 0;
+
+    if (memcmp(in.buff, snap_magic, sizeof( snap_magic )) != 0
+            || get_word( &in) != CT_SNAP_VERSION
+            || get_word( &in) != CT_SNAP_ORDER) {
+        CTOut::ct_report_error("ct_restore_snapshot: not a snapshot");
+        munmap(image, st.st_size);
+        return CT_ERROR;
+    }
+
+    count = get_word( &in);
+    events = get_word( &in);
+    if (get_word( &in) != in.len || count > in.len / 4)
+        in.bad = 1;
+
+    if ( !in.bad) {
+        threads = (Ct_thread **) malloc(
+                (count > 0 ? count : 1) * sizeof(Ct_thread *));
+        if (NULL == threads
+                || ctDataStore.ct_reserve_threads(count) != CT_OKAY) {
+            CTOut::ct_report_error("ct_restore_snapshot: out of memory");
+            rc = CT_ERROR;
+        }
+    }
+
+    for (i = 0; i < count && CT_OKAY == rc && !in.bad; ++i)
+        rc = restore_thread( &in, restorer, threads + i);
+
+    for (i = 0; i < events && CT_OKAY == rc && !in.bad; ++i) {
+        pE = restore_event( &in, threads, count);
+        if (NULL == pE)
+            rc = CT_ERROR;
+        else
+            ct_enqueue_event(pE);
+    }
+
+    if (in.bad) {
+        CTOut::ct_report_error("ct_restore_snapshot: snapshot is corrupt");
+        rc = CT_ERROR;
+    }
+
+    if (rc != CT_OKAY)
+        discard_restored();
+
+    free(threads);
+    munmap(image, st.st_size);
+    return rc;
+}
+
+int CTScheduler::restore_thread(Ct_snap_in * pIn, Ct_thread_restorer restorer,
+        Ct_thread ** ppThread) {
+    Ct_thread * pThread;
+    Ct_handle handle;
+    Ct_event * pE;
+    const unsigned char * pDesc;
+    unsigned long len;
+    unsigned long flags;
+#if defined CT_TIMEOUT
+    unsigned long ticks;
+    Ct_time now;
+#endif
+#if defined CT_PERIODIC
+    unsigned long period;
+    Ct_periodic_policy policy;
+    unsigned long release;
+    Ct_periodic_stats stats;
+#endif
+    unsigned long n;
+    int priority;
+    unsigned weight;
+#if defined CT_QUANTUM
+    unsigned quantum;
+#endif
+#if defined CT_MAILBOX
+    unsigned capacity;
+    Ct_overflow_policy overflow;
+#endif
+    void * pData;
+    Ct_step_function step;
+    Ct_destructor destruct;
+
+    flags = get_word(pIn);
+#if defined CT_TIMEOUT
+    ticks = get_word(pIn);
+#else
+    get_word(pIn); /* ticks left of a timeout */
+#endif
+    priority = (int) get_word(pIn);
+    weight = get_word(pIn);
+#if defined CT_QUANTUM
+    quantum = get_word(pIn);
+#else
+    get_word(pIn); /* run quantum */
+#endif
+#if defined CT_MAILBOX
+    capacity = get_word(pIn);
+    overflow = (Ct_overflow_policy) get_word(pIn);
+#else
+    get_word(pIn); /* mailbox capacity */
+    get_word(pIn); /* overflow policy */
+#endif
+#if defined CT_PERIODIC
+    period = get_word(pIn);
+    policy = (Ct_periodic_policy) get_word(pIn);
+    release = get_word(pIn);
+    stats.releases = get_word(pIn);
+    stats.overruns = get_word(pIn);
+    stats.skipped = get_word(pIn);
+#else
+    for (n = 0; n < 6; ++n)
+        get_word(pIn); /* periodic state */
+#endif
+    pDesc = get_bytes(pIn, &len);
+    if (pIn->bad)
+        return CT_ERROR;
+
+    if (priority < 0 || priority > CT_PRIORITY_MAX) {
+        pIn->bad = 1;
+        return CT_ERROR;
+    }
+
+#if defined CT_PERIODIC
+    if (period > 0 && policy != CT_PERIODIC_SKIP
+            && policy != CT_PERIODIC_CATCH_UP) {
+        pIn->bad = 1;
+        return CT_ERROR;
+    }
+#endif
+
+    if (restorer(pDesc, len, &pData, &step, &destruct) != CT_OKAY) {
+        CTOut::ct_report_error("ct_restore_snapshot: unable to restore thread");
+        return CT_ERROR;
+    }
+
+    pThread = ctDataStore.ct_construct(priority, pData, step, destruct);
+    if (NULL == pThread)
+        return CT_ERROR;
+    ASSERT( CT_MAGIC == pThread->magic );
+#if defined CT_REPLAY
+    note_creation(pThread);
+#endif
+
+    handle.p = pThread;
+    handle.incarnation = pThread->incarnation;
+#if defined CT_THREADSAFE
+    handle.partition = partition_id;
+#endif
+
+    ct_set_weight(handle, weight);
+#if defined CT_QUANTUM
+    ct_set_quantum(handle, quantum);
+#endif
+
+    for (n = get_word(pIn); n > 0 && !pIn->bad; --n) {
+        if (ct_subscribe((Ct_msgtype) get_word(pIn), handle) != CT_OKAY) {
+            ctDataStore.ct_destruct( &pThread);
+            return CT_ERROR;
+        }
+    }
+
+    /* The messages go in before the mailbox gets its capacity, */
+    /* so that none of them is refused. */
+
+    for (n = get_word(pIn); n > 0 && !pIn->bad; --n) {
+        pE = restore_event(pIn, NULL, 0);
+        if (NULL == pE || attach_event(pE, pThread) != CT_OKAY) {
+            if (pE != NULL && 0 == pE->refcount)
+                ctDataStore.ct_destruct_event( &pE);
+            ctDataStore.ct_destruct( &pThread);
+            return CT_ERROR;
+        }
+        pE->addressee = handle;
+    }
+
+#if defined CT_MAILBOX
+    if (pIn->bad || ct_set_mailbox(handle, capacity, overflow) != CT_OKAY) {
+#else
+    if (pIn->bad) {
+#endif
+        ctDataStore.ct_destruct( &pThread);
+        return CT_ERROR;
+    }
+
+#if defined CT_TIMEOUT
+    if ((flags & CT_SNAP_TIMEOUT)
+#if defined CT_PERIODIC
+            || period > 0
+#endif
+            )
+        now = read_clock();
+#endif
+
+#if defined CT_PERIODIC
+
+    /* A periodic thread's release, ahead of or behind now: */
+
+    if (period > 0) {
+        pThread->period = period;
+        pThread->periodic_policy = policy;
+        pThread->periodic_stats = stats;
+        pThread->released = (flags & CT_SNAP_RELEASED) != 0;
+        pThread->release = now;
+        if (flags & CT_SNAP_LATE) {
+            if (pThread->release.tick < release)
+                --pThread->release.era;
+            pThread->release.tick -= release;
+        }
+        else
+            add_ticks( &pThread->release, release);
+    }
+#endif
+
+    /* Queue the thread only now, so that it gets the priority */
+    /* of its most urgent message. */
+
+#if defined CT_TIMEOUT
+    if (flags & CT_SNAP_TIMEOUT) {
+        pThread->status = CT_STATUS_TIMEOUT;
+        pThread->deadline = now;
+        add_ticks( &pThread->deadline, ticks);
+#if defined CT_PERIODIC
+        pThread->releasing = period > 0 && (flags & CT_SNAP_RELEASING);
+#endif
+        insert_timeout(pThread);
+    }
+    else
+#endif
+    if (flags & (CT_SNAP_ASLEEP | CT_SNAP_TIMEOUT)) {
+        pThread->status = CT_STATUS_ASLEEP;
+        pThread->pPrev = sleepers.pPrev;
+        pThread->pNext = &sleepers;
+        sleepers.pPrev->pNext = pThread;
+        sleepers.pPrev = pThread;
+    }
+    else
+        insert_thread(pThread);
+
+    *ppThread = pThread;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Rebuild an event, addressed to the thread with the saved number
+ if there is one.  Return NULL if the image is corrupt or we're
+ out of memory.
+ ****************************************************************/
+
+Ct_event * CTScheduler::restore_event(Ct_snap_in * pIn, Ct_thread ** threads,
+        unsigned long count) {
+    Ct_event * pE;
+    const unsigned char * pData;
+    unsigned long ev_type;
+    unsigned long type;
+    unsigned long dispatch_type;
+    unsigned long addressee;
+    unsigned long priority;
+    unsigned long len;
+
+    ev_type = get_word(pIn);
+    type = get_word(pIn);
+    dispatch_type = get_word(pIn);
+    addressee = get_word(pIn);
+    priority = get_word(pIn);
+    pData = get_bytes(pIn, &len);
+    if (pIn->bad)
+        return NULL;
+
+    if (ev_type > CT_EV_ENQ || dispatch_type > CT_DISPATCH_ALL
+            || priority > CT_PRIORITY_MAX) {
+        pIn->bad = 1;
+        return NULL;
+    }
+
+    pE = ctDataStore.ct_alloc_event();
+    if (NULL == pE)
+        return NULL; /* ct_alloc_event() has reported the error */
+
+    pE->pNext = NULL;
+    pE->type = (Ct_msgtype) type;
+    pE->ev_type = (Ct_event_type) ev_type;
+    pE->priority = (int) priority;
+#if defined CT_MAILBOX
+    pE->reserved = 0;
+#endif
+    pE->msg_len = 0;
+    pE->refcount = 0;
+    pE->pData = NULL;
+    pE->dispatch_type = (Ct_dispatch_type) dispatch_type;
+#ifndef NDEBUG
+    pE->magic = EVENT_MAGIC;
+#endif
+
+    if (len > CT_MSG_BUF_LEN) {
+        pE->pData = ctDataStore.ct_alloc_msg_data(len);
+        if (NULL == pE->pData) {
+            ctDataStore.ct_destruct_event( &pE);
+            return NULL;
+        }
+        memcpy(pE->pData, pData, len);
+    }
+    else
+        if (len > 0)
+            memcpy(pE->buff, pData, len);
+    pE->msg_len = len;
+
+    if (threads != NULL && addressee < count) {
+        pE->addressee.p = threads[ addressee ];
+        pE->addressee.incarnation = threads[ addressee ]->incarnation;
+    }
+    else {
+        pE->addressee.p = NULL;
+        pE->addressee.incarnation = 0;
+    }
+#if defined CT_THREADSAFE
+    pE->addressee.partition = partition_id;
+#endif
+
+    return pE;
+}
+
+/*****************************************************************
+ Discard whatever a failed restore has built.
+ ****************************************************************/
+
+void CTScheduler::discard_restored(void) {
+    clear_priority_queue();
+
+    if (sleepers.pNext != &sleepers) {
+        sleepers.pPrev->pNext = NULL;
+        sleepers.pPrev = &sleepers;
+        destruct_thread_list( &sleepers.pNext);
+        sleepers.pNext = &sleepers;
+    }
+
+#if defined CT_TIMEOUT
+    clear_timer_wheel();
+#endif
+
+    ctDataStore.ct_destruct_event_list( &ev_head);
+    ev_tail = NULL;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*****************************************************************
+ CTTrace -- dumping the ring of scheduler trace records.
+ ****************************************************************/
+
+#include <string.h>
+#include "CTTrace.h"
+
+#if defined CT_TRACE
+
+CTTrace::CTTrace() {
+    next = 0;
+}
+
+/*****************************************************************
+ Forget all records.
+ ****************************************************************/
+
+void CTTrace::ct_clear(void) {
+    next = 0;
+}
+
+/*****************************************************************
+ Copy a header and the records to a buffer of the specified
+ length, oldest first.  If the buffer can't hold them all, keep
+ the newest.  Return the number of bytes used, or 0 if the buffer
+ can't even hold the header.
+ ****************************************************************/
+
+unsigned long CTTrace::ct_dump(void * buff, unsigned long len) const {
+    Ct_trace_header header;
+    unsigned char * p = (unsigned char *) buff;
+    unsigned long count;
+    unsigned long first;
+    unsigned long i;
+    unsigned short one = 1;
+
+    if (NULL == buff || len < sizeof( header ))
+        return 0;
+
+    count = next < CT_TRACE_SLOTS ? next : CT_TRACE_SLOTS;
+    if (count > ( len - sizeof( header )) / sizeof(Ct_trace_record))
+        count = ( len - sizeof( header )) / sizeof(Ct_trace_record);
+
+    memcpy(header.magic, "CTTR", 4);
+    header.version = CT_TRACE_VERSION;
+    header.long_size = sizeof(unsigned long);
+    header.record_size = sizeof(Ct_trace_record);
+    header.little_endian = *(unsigned char *) &one;
+    header.count = count;
+
+    memcpy(p, &header, sizeof( header ));
+    p += sizeof( header );
+
+    first = next - count;
+    for (i = 0; i < count; ++i) {
+        memcpy(p, ring + ( ( first + i ) & ( CT_TRACE_SLOTS - 1 ) ),
+                sizeof(Ct_trace_record));
+        p += sizeof(Ct_trace_record);
+    }
+
+    return (unsigned long) ( p - (unsigned char *) buff );
+}
+
+#endif
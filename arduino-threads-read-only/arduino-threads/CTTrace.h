@@ -0,0 +1,101 @@
+/*********************************************************************
+ CTTrace -- a ring of scheduler trace records
+
+ With CT_TRACE defined, the scheduler records each step's beginning
+ and end, each wakeup, event post, subscription dispatch, timeout
+ and halt in a fixed ring of CT_TRACE_SLOTS records, overwriting
+ the oldest.  Recording costs a counter reading and a few stores;
+ nothing is allocated.  Without CT_TRACE the calls compile away.
+
+ Only the scheduler's own OS thread writes the ring, so it needs
+ no locks, but it should also be the one to dump it: between
+ steps, or after the scheduler returns.
+
+ ct_dump() writes a header and the records, oldest first, in the
+ machine's own layout; tools/ct_trace2json.py converts a dump to
+ the Chrome trace format, for chrome://tracing or Perfetto.
+ ********************************************************************/
+
+#ifndef CTTRACE_H_
+#define CTTRACE_H_
+
+#if defined CT_TRACE
+
+#include "ct.h"
+#include "ctpriv.h"
+
+/* Number of records in the ring; must be a power of two: */
+
+#ifndef CT_TRACE_SLOTS
+#if defined __AVR__
+#define CT_TRACE_SLOTS 32
+#else
+#define CT_TRACE_SLOTS 1024
+#endif
+#endif
+
+#if ( CT_TRACE_SLOTS & ( CT_TRACE_SLOTS - 1 ) ) != 0
+#error "CT_TRACE_SLOTS must be a power of two"
+#endif
+
+#define CT_TRACE_VERSION 1
+
+typedef enum
+{
+    CT_TRACE_STEP_BEGIN = 1,
+    CT_TRACE_STEP_END, /* arg: return code of the step */
+    CT_TRACE_WAKEUP,
+    CT_TRACE_POST, /* thread: the sender; arg: message type */
+    CT_TRACE_SUBSCRIPTION, /* arg: message type */
+    CT_TRACE_TIMEOUT,
+    CT_TRACE_HALT
+} Ct_trace_kind;
+
+/* The converter relies on this order of members: */
+
+typedef struct {
+        unsigned long time; /* low bits of CT_CYCLES() */
+        unsigned long arg;
+        unsigned short thread; /* trace_id, or 0 for none */
+        unsigned char kind;
+} Ct_trace_record;
+
+typedef struct {
+        char magic[ 4 ]; /* "CTTR" */
+        unsigned char version;
+        unsigned char long_size; /* sizeof( unsigned long ) */
+        unsigned char record_size; /* sizeof( Ct_trace_record ) */
+        unsigned char little_endian; /* boolean */
+        unsigned long count; /* number of records following */
+} Ct_trace_header;
+
+class CTTrace {
+
+    public:
+
+        CTTrace();
+
+        void ct_record(Ct_trace_kind kind, const Ct_thread * pThread,
+                unsigned long arg) {
+            Ct_trace_record * pR =
+                    ring + ( next & ( CT_TRACE_SLOTS - 1 ) );
+
+            ++next;
+            pR->time = (unsigned long) CT_CYCLES();
+            pR->arg = arg;
+            pR->thread = pThread != NULL ? pThread->trace_id : 0;
+            pR->kind = (unsigned char) kind;
+        }
+
+        unsigned long ct_dump(void * buff, unsigned long len) const;
+        void ct_clear(void);
+
+    private:
+
+        Ct_trace_record ring[ CT_TRACE_SLOTS ];
+        unsigned long next; /* records written since cleared */
+};
+
+#endif
+
+#endif /*CTTRACE_H_*/
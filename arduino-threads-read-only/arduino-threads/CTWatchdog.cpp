@@ -0,0 +1,228 @@
+/*****************************************************************
+ CTWatchdog -- the parts of CTScheduler that watch for steps that
+ run too long.
+
+ Scheduling is cooperative, so one slow step holds up every other
+ thread.  step() times each step against the thread's budget and
+ calls note_overrun() for any that runs over.
+
+ Under CT_WATCHDOG_BACKTRACE, step() also arms a one-shot timer
+ around each step.  If it goes off, the step is still running;
+ the signal handler writes a backtrace of wherever it is stuck.
+ The timer signals the scheduler's own OS thread, so that the
+ backtrace is of the step and not of some other thread.
+
+ Compiled only if CT_WATCHDOG is defined.
+ ****************************************************************/
+
+#include "CTScheduler.h"
+
+#if defined CT_WATCHDOG
+
+#if defined CT_WATCHDOG_BACKTRACE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+
+/* Older C libraries don't name this member of struct sigevent: */
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* Frames to show in a backtrace: */
+
+#define CT_WATCHDOG_FRAMES 32
+#endif
+
+/*****************************************************************
+ Set the step budget of a thread, in the units of CT_CYCLES(), or
+ 0 for none.
+ ****************************************************************/
+
+int CTScheduler::ct_set_step_budget(Ct_handle handle, Ct_cycles budget) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if ( !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_set_step_budget: invalid thread handle");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    pThread->step_budget = budget;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Install a function to be called, just after the step returns,
+ for each step that overruns its budget.  Return the previous one.
+ ****************************************************************/
+
+Ct_overrun_handler CTScheduler::ct_install_overrun_handler(
+        Ct_overrun_handler f) {
+    Ct_overrun_handler prev_handler = overrun_handler;
+
+    overrun_handler = f;
+    return prev_handler;
+}
+
+/*****************************************************************
+ Set the penalty, as for ct_penalize(), imposed on a thread for
+ overrunning its step budget: 0 (the default) for none.  Return
+ the previous penalty.
+ ****************************************************************/
+
+unsigned CTScheduler::ct_set_overrun_penalty(unsigned penalty) {
+    unsigned prev_penalty = overrun_penalty;
+
+    overrun_penalty = penalty;
+    return prev_penalty;
+}
+
+int CTScheduler::ct_watchdog_stats(Ct_handle handle,
+        Ct_watchdog_stats * pStats) {
+    Ct_thread * pThread;
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || !ctDataStore.ct_valid_handle( &handle)) {
+        CTOut::ct_report_error("ct_watchdog_stats: invalid argument");
+        ct_fatal_error();
+        return CT_ERROR;
+    }
+
+    pThread = (Ct_thread *) handle.p;
+    ASSERT( CT_MAGIC == pThread->magic );
+
+    *pStats = pThread->watchdog_stats;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Deal with a step of the current thread that overran its budget.
+ The penalty takes effect when step() requeues the thread.
+ ****************************************************************/
+
+void CTScheduler::note_overrun(Ct_cycles elapsed) {
+    Ct_handle self;
+
+    ++pCurr_thread->watchdog_stats.overruns;
+    if (elapsed > pCurr_thread->watchdog_stats.worst_cycles)
+        pCurr_thread->watchdog_stats.worst_cycles = elapsed;
+
+    if (overrun_handler != NULL) {
+        self.p = pCurr_thread;
+        self.incarnation = pCurr_thread->incarnation;
+#if defined CT_THREADSAFE
+        self.partition = partition_id;
+#endif
+        overrun_handler(self, elapsed);
+    }
+
+    if (overrun_penalty > 0)
+        ct_penalize(overrun_penalty);
+}
+
+#if defined CT_WATCHDOG_BACKTRACE
+
+/*****************************************************************
+ Set the hard limit, in microseconds, on how long a step may run
+ before its backtrace is written to standard error: 0 (the
+ default) for none.  Call it from the OS thread that will run the
+ scheduler, which the timer will signal.
+ ****************************************************************/
+
+int CTScheduler::ct_set_hard_limit(unsigned long usecs) {
+    struct sigaction sa;
+    struct sigevent sev;
+    void * frame;
+
+    if (usecs > 0 && !watchdog_created) {
+
+        /* backtrace() may load a library the first time it is */
+        /* called, which a signal handler mustn't do; so we    */
+        /* call it once here. */
+
+        backtrace( &frame, 1);
+
+        memset( &sa, 0, sizeof( sa ));
+        sa.sa_handler = watchdog_handler;
+        sigemptyset( &sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        if (sigaction(CT_WATCHDOG_SIGNAL, &sa, NULL) != 0) {
+            CTOut::ct_report_error("ct_set_hard_limit: unable to install signal handler");
+            return CT_ERROR;
+        }
+
+        memset( &sev, 0, sizeof( sev ));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = CT_WATCHDOG_SIGNAL;
+        sev.sigev_notify_thread_id = (pid_t) syscall(SYS_gettid);
+        if (timer_create(CLOCK_MONOTONIC, &sev, &watchdog_timer) != 0) {
+            CTOut::ct_report_error("ct_set_hard_limit: unable to create timer");
+            return CT_ERROR;
+        }
+
+        watchdog_created = 1;
+    }
+
+    hard_limit = usecs;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Arm the timer to go off after the specified number of
+ microseconds, or disarm it if 0.
+ ****************************************************************/
+
+void CTScheduler::set_watchdog(unsigned long usecs) {
+    struct itimerspec its;
+
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 0;
+    its.it_value.tv_sec = usecs / 1000000UL;
+    its.it_value.tv_nsec = (usecs % 1000000UL) * 1000L;
+
+    timer_settime(watchdog_timer, 0, &its, NULL);
+}
+
+void CTScheduler::close_watchdog(void) {
+    if (watchdog_created) {
+        timer_delete(watchdog_timer);
+        watchdog_created = 0;
+    }
+
+    hard_limit = 0;
+}
+
+/*****************************************************************
+ Signal handler: report where the current step is stuck.  Uses
+ only functions that are safe in a signal handler (once
+ backtrace() has been primed), and leaves errno as it found it.
+ ****************************************************************/
+
+void CTScheduler::watchdog_handler(int sig) {
+    static const char msg[] = "ct watchdog: step exceeded hard limit at:\n";
+    void * frames[ CT_WATCHDOG_FRAMES ];
+    int saved_errno = errno;
+    int n;
+
+    (void) sig;
+
+    if (write(STDERR_FILENO, msg, sizeof( msg ) - 1) < 0)
+        ; /* nowhere else to complain */
+
+    n = backtrace(frames, CT_WATCHDOG_FRAMES);
+    backtrace_symbols_fd(frames, n, STDERR_FILENO);
+
+    errno = saved_errno;
+}
+
+#endif
+
+#endif
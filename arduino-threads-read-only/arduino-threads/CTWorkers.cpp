@@ -0,0 +1,388 @@
+/*****************************************************************
+ CTWorkers -- the parts of CTScheduler that run its threads on
+ several OS threads at once: M cheap threads on N workers.
+
+ The OS thread that calls ct_schedule() becomes worker 0, and
+ starts the others.  Each worker owns a CTDeque.  When its deque
+ is empty, a worker takes the CT_WORKER_BATCH most urgent threads
+ from the priority queue, as pick_thread() would have picked them
+ one by one, and pushes them so that it pops the most urgent
+ first.  A worker whose deque is empty, and who finds nothing on
+ the priority queue either, steals from the other end of another
+ worker's deque -- the least urgent of that worker's batch.
+
+ A thread taken by a worker is on no list until its dispatch
+ ends; claim_level says so, and remembers the level it was taken
+ from.  Events for such a thread only mark it awakened, and step()
+ puts it back on the priority queue afterwards, as usual.
+
+ Everything but the deques and the per-worker state (see
+ CT_PER_WORKER) is guarded by the scheduler lock.  A worker holds
+ it except while popping or stealing, and while a step function
+ runs; so does every public function that a step may call.  The
+ event queue, the timing wheel and the inbox are looked after by
+ whichever worker is between dispatches.
+
+ A worker that finds nothing to do naps on work_cond, for at most
+ CT_WORKER_NAP_US, since posts from other OS threads and expiring
+ timeouts signal nobody.  When no thread is runnable, or held by
+ a worker, or waiting for a timeout, the workers stop, and worker
+ 0 returns from ct_schedule() as before.
+
+ Compiled only if CT_WORKERS is defined.
+ ****************************************************************/
+
+#include <time.h>
+#include "CTScheduler.h"
+
+#if defined CT_WORKERS
+
+/* The per-worker state of CTScheduler: */
+
+#if defined CT_QUANTUM && defined CT_TIMEOUT
+thread_local Ct_time CTScheduler::quantum_start;
+#endif
+#ifdef CT_RETURN
+thread_local jmp_buf CTScheduler::jumper;
+thread_local int CTScheduler::jump_rc;
+#endif
+thread_local Ct_thread * CTScheduler::pCurr_thread = NULL;
+thread_local int CTScheduler::curr_priority = -1;
+thread_local int CTScheduler::sender_priority = 0;
+thread_local unsigned CTScheduler::pri_penalty = 0;
+thread_local int CTScheduler::self_msg = 0;
+thread_local int CTScheduler::self_priority = CT_PRIORITY_MAX;
+thread_local unsigned CTScheduler::worker_id = 0;
+
+/* What a worker is given when started: */
+
+typedef struct {
+        CTScheduler * pScheduler;
+        unsigned id;
+} Ct_worker_start;
+
+/*****************************************************************
+ Set the number of workers to run, from 1 (just the OS thread
+ calling ct_schedule()) up to CT_WORKERS.  Call this before
+ ct_schedule().
+ ****************************************************************/
+
+int CTScheduler::ct_set_workers(unsigned n) {
+    CT_LOCKED( *this );
+
+    if (n < 1 || n > CT_WORKERS) {
+        CTOut::ct_report_error("ct_set_workers: invalid number of workers");
+        return CT_ERROR;
+    }
+
+    if (pCurr_thread != NULL) {
+        CTOut::ct_report_error("ct_set_workers: scheduler is running");
+        return CT_ERROR;
+    }
+
+    worker_count = n;
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Report what a worker has done since ct_schedule() was called.
+ ****************************************************************/
+
+int CTScheduler::ct_worker_stats(unsigned worker, Ct_worker_stats * pStats) {
+    CT_LOCKED( *this );
+
+    if (NULL == pStats || worker >= CT_WORKERS) {
+        CTOut::ct_report_error("ct_worker_stats: invalid argument");
+        return CT_ERROR;
+    }
+
+    *pStats = worker_stats[ worker ];
+    return CT_OKAY;
+}
+
+/*****************************************************************
+ Start the other workers, run worker 0 on this OS thread, and wait
+ for the others to finish.
+ ****************************************************************/
+
+void CTScheduler::run_workers(void) {
+    pthread_t ids[ CT_WORKERS ];
+    Ct_worker_start starts[ CT_WORKERS ];
+    unsigned started;
+    unsigned i;
+
+    CT_LOCK();
+    for (i = 0; i < CT_WORKERS; ++i) {
+        worker_stats[ i ].dispatches = 0;
+        worker_stats[ i ].claims = 0;
+        worker_stats[ i ].steals = 0;
+        worker_stats[ i ].naps = 0;
+    }
+    napping = 0;
+    claimed_count = 0;
+    workers_done = 0;
+    CT_UNLOCK();
+
+    for (started = 1; started < worker_count; ++started) {
+        starts[ started ].pScheduler = this;
+        starts[ started ].id = started;
+        if (pthread_create( &ids[ started ], NULL, worker_main,
+                &starts[ started ]) != 0) {
+            /* Make do with the workers we have; */
+            /* the others' deques stay empty.    */
+
+            CTOut::ct_report_error("ct_schedule: unable to start a worker");
+            break;
+        }
+    }
+
+    worker_id = 0;
+    run_worker();
+
+    for (i = 1; i < started; ++i)
+        pthread_join(ids[ i ], NULL);
+}
+
+/*****************************************************************
+ Entry point of each worker but worker 0.
+ ****************************************************************/
+
+void * CTScheduler::worker_main(void * p) {
+    Ct_worker_start * pStart = (Ct_worker_start *) p;
+
+    worker_id = pStart->id;
+    pStart->pScheduler->run_worker();
+    return NULL;
+}
+
+/*****************************************************************
+ A worker's loop: run threads from its own deque, else stolen
+ ones, else whatever it can find on the priority queue, until
+ there is nothing left to run.
+ ****************************************************************/
+
+void CTScheduler::run_worker(void) {
+    Ct_thread * pThread;
+    int more = CT_TRUE;
+
+    while (more) {
+        pThread = deques[ worker_id ].ct_pop();
+        if (pThread != NULL)
+            run_claimed(pThread, CT_FALSE);
+        else {
+            pThread = steal_thread();
+            if (pThread != NULL)
+                run_claimed(pThread, CT_TRUE);
+            else {
+                CT_LOCK();
+                more = find_work();
+                CT_UNLOCK();
+            }
+        }
+    }
+}
+
+/*****************************************************************
+ Dispatch a thread taken from a deque -- or, once the scheduler
+ has halted, just put it back on the priority queue.  Then attend
+ to the scheduler's business, and refill the deque if it is empty.
+ ****************************************************************/
+
+void CTScheduler::run_claimed(Ct_thread * pThread, int stolen) {
+    CT_LOCK();
+
+    ASSERT( CT_MAGIC == pThread->magic );
+    ASSERT( pThread->claim_level >= 0 );
+
+    if (halted) {
+        release_claim(pThread);
+        CT_UNLOCK();
+        return;
+    }
+
+    ++worker_stats[ worker_id ].dispatches;
+    if (stolen)
+        ++worker_stats[ worker_id ].steals;
+
+    pCurr_thread = pThread;
+    curr_priority = pThread->claim_level;
+    if (step() != CT_OKAY)
+        halted = 1;
+    pCurr_thread = NULL;
+
+    housekeep();
+    if ( !halted && deques[ worker_id ].ct_empty())
+        claim_threads();
+
+    /* Let a napping worker have whatever is left over */
+
+    if (napping > 0 && (next_ready( 0 ) >= 0
+            || !deques[ worker_id ].ct_empty()))
+        pthread_cond_signal( &work_cond);
+
+    CT_UNLOCK();
+}
+
+/*****************************************************************
+ Called with the lock held by a worker whose deque is empty and
+ who found nothing to steal.  Fill the deque from the priority
+ queue if possible.  Otherwise nap, unless the work is all done.
+ Return CT_FALSE if the worker is to stop, CT_TRUE otherwise.
+ ****************************************************************/
+
+int CTScheduler::find_work(void) {
+    struct timespec until;
+    int done;
+
+    if (workers_done)
+        return CT_FALSE;
+
+    if ( !halted) {
+        housekeep();
+        if (claim_threads() > 0)
+            return CT_TRUE;
+    }
+
+    /* Other workers may yet make threads runnable, */
+    /* as may timeouts. */
+
+    done = halted || (0 == claimed_count
+#if defined CT_TIMEOUT
+            && 0 == timeout_count
+#endif
+            );
+
+    if (done && !halted && partitions != NULL) {
+        /* Other partitions may yet send us something.  */
+        /* Carry on until the whole group is finished. */
+
+        if ( !partition_idle) {
+            partitions->ct_partition_idle();
+            partition_idle = 1;
+        }
+
+        done = partitions->ct_quiescent();
+    }
+
+    if (done) {
+        /* No active threads -- we're done. */
+
+        workers_done = 1;
+        pthread_cond_broadcast( &work_cond);
+        return CT_FALSE;
+    }
+
+    ++napping;
+    ++worker_stats[ worker_id ].naps;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += CT_WORKER_NAP_US * 1000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+    }
+    pthread_cond_timedwait( &work_cond, &sched_lock, &until);
+
+    --napping;
+    return CT_TRUE;
+}
+
+/*****************************************************************
+ The scheduler's business between dispatches, as at the top of the
+ single-threaded loop: take in posted events, deliver events and
+ timeouts, and now and then age the priority queue.
+ ****************************************************************/
+
+void CTScheduler::housekeep(void) {
+    if (inbox.ct_pending())
+        drain_inbox();
+
+    if (partitions != NULL)
+        drain_partitions();
+
+    if (ev_head != NULL
+#if defined CT_WAKEUPS
+            || wakeups
+#endif
+            )
+        dispatch_event_queue();
+
+#if defined CT_TIMEOUT
+    if (check_timeouts())
+        dispatch_event_queue();
+#endif
+
+#if CT_POLICY == CT_POLICY_MULTILEVEL
+    if ( 0 == --countdown) {
+        scrunch_queue();
+        countdown = init_countdown;
+    }
+#endif
+}
+
+/*****************************************************************
+ Take up to CT_WORKER_BATCH threads from the priority queue into
+ this worker's deque, which must be empty.  Return how many.
+ ****************************************************************/
+
+unsigned CTScheduler::claim_threads(void) {
+    Ct_thread * batch[ CT_WORKER_BATCH ];
+    unsigned n;
+    unsigned i;
+
+    ASSERT( deques[ worker_id ].ct_empty() );
+
+    for (n = 0; n < CT_WORKER_BATCH; ++n) {
+        pick_thread();
+        if (NULL == pCurr_thread)
+            break;
+
+        unlink_thread(pCurr_thread);
+        pCurr_thread->claim_level = curr_priority;
+        batch[ n ] = pCurr_thread;
+    }
+    pCurr_thread = NULL;
+
+    if ( 0 == n)
+        return 0;
+
+    /* Push the least urgent first, to be popped last (or stolen) */
+
+    claimed_count += n;
+    ++worker_stats[ worker_id ].claims;
+    for (i = n; i > 0; --i)
+        deques[ worker_id ].ct_push(batch[ i - 1 ]);
+
+    return n;
+}
+
+/*****************************************************************
+ Give up a worker's hold on a thread, putting it back on the
+ priority queue.
+ ****************************************************************/
+
+void CTScheduler::release_claim(Ct_thread * pThread) {
+    pThread->claim_level = -1;
+    --claimed_count;
+    insert_thread(pThread);
+}
+
+/*****************************************************************
+ Steal a thread from another worker, trying each in turn.  Return
+ NULL if none had one to spare.
+ ****************************************************************/
+
+Ct_thread * CTScheduler::steal_thread(void) {
+    Ct_thread * pThread;
+    unsigned i;
+
+    for (i = 1; i < worker_count; ++i) {
+        pThread = deques[ (worker_id + i) % worker_count ].ct_steal();
+        if (pThread != NULL)
+            return pThread;
+    }
+
+    return NULL;
+}
+
+#endif
@@ -27,6 +27,7 @@
 
 #define CT_OKAY 0
 #define CT_ERROR 1
+#define CT_MAILBOX_FULL 2 /* a message was refused for want of room */
 
 #define CT_TRUE 1
 #define CT_FALSE 0
@@ -38,6 +39,9 @@
 typedef struct {
         void * p;
         short incarnation;
+#if defined CT_THREADSAFE
+        unsigned short partition; /* scheduler that owns the thread */
+#endif
 } Ct_handle;
 
 typedef unsigned Ct_msgtype;
@@ -75,12 +79,98 @@ int ct_timecmp(const Ct_time * t1, const Ct_time * t2);
 #define CT_PRIORITY_MAX 15
 #endif
 
+/* With CT_READY_BITMAP defined, the scheduler finds the      */
+/* highest non-empty level through a bitmap, so 255 levels    */
+/* cost no more per step than 15.  Otherwise it scans the     */
+/* levels in turn, which is cheaper while they are few.  The  */
+/* bitmap is chosen for you from CT_PRIORITY_MAX of 64 up. */
+
+#if !defined CT_READY_BITMAP && CT_PRIORITY_MAX >= 64
+#define CT_READY_BITMAP
+#endif
+
+/* Scheduling policy, chosen at compile time so that the */
+/* policies not chosen cost nothing:                      */
+/*                                                        */
+/* CT_POLICY_MULTILEVEL -- static priorities, aged by     */
+/*     periodically scrunching the queue (the default)    */
+/* CT_POLICY_STRIDE -- CPU shares in proportion to each   */
+/*     thread's weight, allotted deterministically        */
+/* CT_POLICY_LOTTERY -- CPU shares in proportion to each  */
+/*     thread's weight, allotted by random draw           */
+/* CT_POLICY_EDF -- earliest deadline first for threads   */
+/*     created by ct_create_rt_thread(), ahead of all     */
+/*     others, which run by static priority (requires     */
+/*     CT_TIMEOUT)                                        */
+/*                                                        */
+/* Under either proportional policy, static priorities    */
+/* are ignored, but a thread with a message waiting still */
+/* runs ahead of the rest. */
+
+#define CT_POLICY_MULTILEVEL 0
+#define CT_POLICY_STRIDE     1
+#define CT_POLICY_LOTTERY    2
+#define CT_POLICY_EDF        3
+
+#ifndef CT_POLICY
+#define CT_POLICY CT_POLICY_MULTILEVEL
+#endif
+
+/* Weight given to a new thread: */
+
+#ifndef CT_DEFAULT_WEIGHT
+#define CT_DEFAULT_WEIGHT 16
+#endif
+
+/* For stride scheduling: the stride of a thread is CT_STRIDE1  */
+/* divided by its weight, and threads are queued in buckets of */
+/* CT_STRIDE_BUCKET units of virtual time, one per priority    */
+/* level.  Weights should therefore lie within a factor of     */
+/* about CT_PRIORITY_MAX of the default, unless CT_PRIORITY_MAX */
+/* is raised. */
+
+#ifndef CT_STRIDE1
+#define CT_STRIDE1 ( 1UL << 20 )
+#endif
+
+#ifndef CT_STRIDE_BUCKET
+#define CT_STRIDE_BUCKET ( CT_STRIDE1 / CT_DEFAULT_WEIGHT )
+#endif
+
+/* For EDF: CPU utilization is reckoned in parts of */
+/* CT_EDF_SCALE, which stands for 100%: */
+
+#ifndef CT_EDF_SCALE
+#define CT_EDF_SCALE 10000UL
+#endif
+
 /* Number of threads to run between queue-scrunches: */
 
 #ifndef CT_DEFAULT_COUNTDOWN
 #define CT_DEFAULT_COUNTDOWN 8
 #endif
 
+/* Most handoffs in a row (see ct_set_handoff()) before the */
+/* addressee of a message must wait its turn again:         */
+
+#ifndef CT_HANDOFF_MAX
+#define CT_HANDOFF_MAX 8
+#endif
+
+/* Threads to allocate from the heap at a time, unless reserved */
+/* in bulk (ct_create_threads()).  The first thread created     */
+/* costs a whole slab: 64 threads take some 11 KB on a 64-bit   */
+/* host.  A board with a few KB of SRAM allocates one at a      */
+/* time, as before slabs, unless told otherwise. */
+
+#ifndef CT_SLAB_THREADS
+#if defined ARDUINO || defined __AVR__
+#define CT_SLAB_THREADS 1
+#else
+#define CT_SLAB_THREADS 64
+#endif
+#endif
+
 /* Maximum data length carried by a message without */
 /* additional memory allocation: */
 
@@ -88,6 +178,78 @@ int ct_timecmp(const Ct_time * t1, const Ct_time * t2);
 #define CT_MSG_BUF_LEN  16
 #endif
 
+/* With CT_ARENA defined, message nodes, events and subscriptions */
+/* come from arenas of CT_ARENA_CHUNK objects at a time, and are   */
+/* recycled but never freed one by one.  Shutting down, or         */
+/* ct_clear(), then calls each thread's destructor and frees the   */
+/* arenas whole, instead of taking apart every queue and list.     */
+/* The price is that memory once used for messages stays with the  */
+/* scheduler until then. */
+
+#if defined CT_ARENA && ! defined CT_ARENA_CHUNK
+#define CT_ARENA_CHUNK 256
+#endif
+
+/* If CT_THREADSAFE is defined, other OS threads may post short */
+/* messages and wakeups to a scheduler through a lock-free      */
+/* inbox of CT_INBOX_SLOTS entries (a power of two): */
+
+#ifndef CT_INBOX_SLOTS
+#define CT_INBOX_SLOTS 64
+#endif
+
+/* Likewise, several schedulers may form a group of up to     */
+/* CT_PARTITIONS_MAX partitions, each on its own OS thread,   */
+/* passing messages through rings of CT_RING_SLOTS entries:   */
+
+#ifndef CT_PARTITIONS_MAX
+#define CT_PARTITIONS_MAX 16
+#endif
+
+#ifndef CT_RING_SLOTS
+#define CT_RING_SLOTS 256
+#endif
+
+/* A partition with nothing to do, waiting for the others, sleeps */
+/* until a message is sent or posted to it, or the group is done, */
+/* but for at most this many microseconds:                        */
+
+#ifndef CT_PARTITION_NAP_US
+#define CT_PARTITION_NAP_US 1000
+#endif
+
+/* With CT_WORKERS defined as a number N, one scheduler may run its  */
+/* threads on up to N OS threads at once, M:N (see CTWorkers.cpp).  */
+/* Each worker takes runnable threads from the priority queue      */
+/* CT_WORKER_BATCH at a time into a deque of CT_DEQUE_SLOTS entries */
+/* (a power of two), runs them from there, and steals from the     */
+/* other workers' deques when its own runs dry.  A worker with      */
+/* nothing to do naps for up to CT_WORKER_NAP_US microseconds, or   */
+/* until another makes a thread runnable.  Requires CT_THREADSAFE.  */
+
+#if defined CT_WORKERS
+
+#ifndef CT_WORKER_BATCH
+#define CT_WORKER_BATCH 4
+#endif
+
+#ifndef CT_DEQUE_SLOTS
+#define CT_DEQUE_SLOTS 16
+#endif
+
+#ifndef CT_WORKER_NAP_US
+#define CT_WORKER_NAP_US 1000
+#endif
+
+typedef struct {
+        unsigned long dispatches; /* threads run by this worker */
+        unsigned long claims; /* times it refilled its deque */
+        unsigned long steals; /* threads taken from other workers */
+        unsigned long naps; /* times it found nothing to do */
+} Ct_worker_stats;
+
+#endif
+
 #if defined CT_TIMEOUT
 
 /* Maximum value of a clock_t: */
@@ -103,10 +265,337 @@ int ct_timecmp(const Ct_time * t1, const Ct_time * t2);
 #define CT_CLOCK_MIN 0
 #endif
 
+/* Number of slots in the timing wheel that holds threads   */
+/* awaiting a timeout.  Must be a power of two.  More slots */
+/* mean fewer threads per slot to examine on each sweep, at */
+/* the cost of one dummy thread per slot. */
+
+#if ! defined CT_WHEEL_SLOTS
+#define CT_WHEEL_SLOTS 32
+#endif
+
 typedef Ct_time (* Ct_clock)( void );
 Ct_clock ct_install_clock( Ct_clock clock_function );
 int ct_wait_on_timeout( unsigned long interval );
 
+/* An idle function is called when no thread is runnable but */
+/* some are awaiting a timeout.  It should block, e.g. with  */
+/* clock_nanosleep() or an AVR sleep mode, until the clock   */
+/* reaches the time given (in the units of the installed     */
+/* clock).  Returning early is harmless. */
+
+typedef void (* Ct_idle_function)( const Ct_time * wake_time );
+Ct_idle_function ct_install_idle_function( Ct_idle_function f );
+
+/* Time spent idle and busy, in clock ticks, as of the end */
+/* of the most recent idle or busy period: */
+
+typedef struct
+{
+        unsigned long idle_ticks;
+        unsigned long busy_ticks;
+        unsigned long idle_count; /* number of idle periods */
+} Ct_idle_stats;
+
+#endif
+
+/* With CT_PERIODIC defined (which requires CT_TIMEOUT), a       */
+/* periodic thread, created by ct_create_periodic_thread(), is   */
+/* released once every period, on boundaries fixed in absolute   */
+/* time from its first release, so that neither late dispatch    */
+/* nor the length of its steps makes it drift.  After each       */
+/* dispatch it waits on the timing wheel for its next release.   */
+/* If that release has already passed, the thread has overrun,   */
+/* and its policy decides what happens:                           */
+/*                                                                */
+/* CT_PERIODIC_SKIP -- the missed releases are dropped, and the   */
+/*     thread waits for the next boundary still to come           */
+/* CT_PERIODIC_CATCH_UP -- the thread is released again at once, */
+/*     once for each missed release, until it has caught up       */
+
+#if defined CT_PERIODIC
+
+#if !defined CT_TIMEOUT
+#error "CT_PERIODIC requires CT_TIMEOUT"
+#endif
+
+typedef enum
+{
+    CT_PERIODIC_SKIP,
+    CT_PERIODIC_CATCH_UP
+} Ct_periodic_policy;
+
+typedef struct {
+        unsigned long releases; /* periods begun */
+        unsigned long overruns; /* dispatches ending after the next release */
+        unsigned long skipped; /* releases dropped under CT_PERIODIC_SKIP */
+} Ct_periodic_stats;
+
+#endif
+
+#if defined CT_EPOLL
+
+/* On Linux, a thread may sleep until a file descriptor is ready, */
+/* by calling ct_wait_on_fd().  It is then sent a message of type */
+/* CT_FD_MSGTYPE, whose data is a Ct_fd_ready. */
+
+#define CT_FD_MSGTYPE ((Ct_msgtype) -2)
+
+typedef struct {
+        int fd;
+        unsigned events; /* EPOLLIN, EPOLLOUT, EPOLLHUP, etc. */
+} Ct_fd_ready;
+
+/* While threads are runnable, the scheduler checks for ready     */
+/* descriptors, without blocking, once in every CT_EPOLL_LOOPS    */
+/* iterations of its loop: */
+
+#ifndef CT_EPOLL_LOOPS
+#define CT_EPOLL_LOOPS 64
+#endif
+
+#endif
+
+#if defined CT_AIO
+
+/* On Linux, a thread may read, write or fsync a file, pipe or tty  */
+/* without blocking the scheduler, through ct_aio_read() and so on. */
+/* When the operation completes, the thread is sent a message of    */
+/* type CT_AIO_MSGTYPE, whose data is a Ct_aio_result. */
+
+#define CT_AIO_MSGTYPE ((Ct_msgtype) -3)
+
+typedef struct {
+        void * buff; /* the buffer submitted, or NULL for an fsync */
+        long result; /* bytes transferred, or minus an errno value */
+} Ct_aio_result;
+
+/* Size of each I/O buffer handed out by ct_aio_buffer(): */
+
+#ifndef CT_AIO_BUF_LEN
+#define CT_AIO_BUF_LEN 4096
+#endif
+
+#endif
+
+/* Ticks of the installed clock per millisecond, for converting */
+/* the time to the next timeout into a timeout for epoll_wait() */
+/* or poll(): */
+
+#if ( defined CT_EPOLL || defined CT_AIO ) && defined CT_TIMEOUT \
+        && ! defined CT_TICKS_PER_MS
+#define CT_TICKS_PER_MS ( CLOCKS_PER_SEC / 1000 )
+#endif
+
+/* With CT_WAKEUPS defined, wakeups (ct_enqueue() and the    */
+/* like) need no event.  Each sets a flag in the thread and   */
+/* puts it on a list of up to CT_WAKE_SLOTS threads, which    */
+/* the scheduler wakes in one pass at the top of its loop;    */
+/* waking a thread already on the list costs nothing more.    */
+/* Wakeups for the subscribers to up to CT_WAKE_TYPES message */
+/* types coalesce likewise.  Beyond those limits, or without  */
+/* CT_WAKEUPS, a wakeup is sent as an event. */
+
+#if defined CT_WAKEUPS
+
+#ifndef CT_WAKE_SLOTS
+#define CT_WAKE_SLOTS 32
+#endif
+
+#ifndef CT_WAKE_TYPES
+#define CT_WAKE_TYPES 4
+#endif
+
+typedef struct {
+        unsigned long posted; /* wakeups requested */
+        unsigned long coalesced; /* ...of which merged with pending ones */
+        unsigned long delivered; /* wakeups delivered (to everybody: once) */
+        unsigned long overflowed; /* wakeups sent as events instead */
+} Ct_wakeup_stats;
+
+#endif
+
+/* A thread's mailbox -- its queue of messages waiting or on   */
+/* their way -- may be given a capacity by ct_set_mailbox().    */
+/* A message sent to a full mailbox is dealt with according to  */
+/* its overflow policy:                                         */
+/*                                                              */
+/* CT_OVERFLOW_REJECT -- the send fails with CT_MAILBOX_FULL    */
+/* CT_OVERFLOW_DROP_OLDEST -- the oldest waiting message makes  */
+/*     room for the new one                                     */
+/* CT_OVERFLOW_DROP_NEWEST -- the new message is discarded, but */
+/*     the send succeeds                                        */
+/* CT_OVERFLOW_BLOCK -- the send fails with CT_MAILBOX_FULL,    */
+/*     and the sending thread sleeps until there is room, when  */
+/*     it may try again.  Blocked senders wait among the other  */
+/*     sleepers, so waking them when room appears costs time    */
+/*     proportional to the number of sleeping threads           */
+/*                                                              */
+/* Messages to subscribers or to everybody have no sender to    */
+/* refuse, so under CT_OVERFLOW_REJECT or CT_OVERFLOW_BLOCK     */
+/* they are discarded instead.  Timeouts, I/O completions and   */
+/* messages from other OS threads are always accepted, though   */
+/* they count against the capacity.  A capacity of zero means   */
+/* no limit.  Without CT_MAILBOX, input queues have no limit,   */
+/* and none of this is compiled. */
+
+#if defined CT_MAILBOX
+
+#ifndef CT_DEFAULT_CAPACITY
+#define CT_DEFAULT_CAPACITY 0
+#endif
+
+typedef enum
+{
+    CT_OVERFLOW_REJECT,
+    CT_OVERFLOW_DROP_OLDEST,
+    CT_OVERFLOW_DROP_NEWEST,
+    CT_OVERFLOW_BLOCK
+} Ct_overflow_policy;
+
+typedef struct {
+        unsigned count; /* messages now in the mailbox */
+        unsigned high_water; /* the most there have ever been */
+        unsigned long dropped; /* messages discarded for want of room */
+        unsigned long refused; /* sends failed with CT_MAILBOX_FULL */
+} Ct_mailbox_stats;
+
+#endif
+
+/* With CT_QUANTUM defined, a thread may be given a run       */
+/* quantum by ct_set_quantum(), i.e. a number of consecutive  */
+/* steps it may take per dispatch, and under CT_TIMEOUT a     */
+/* time budget per dispatch by ct_set_quantum_ticks().        */
+/* Otherwise every dispatch is a single step.  How fully a    */
+/* thread has used its quantum: */
+
+#if defined CT_QUANTUM
+
+typedef struct {
+        unsigned long dispatches; /* times the thread was dispatched */
+        unsigned long steps; /* steps taken in all */
+        unsigned long exhausted; /* dispatches using the whole quantum */
+} Ct_quantum_stats;
+
+#endif
+
+#if defined CT_STATS || defined CT_TRACE || defined CT_WATCHDOG \
+        || defined CT_GROUPS
+
+/* Per-thread accounting and tracing are timed by CT_CYCLES(),  */
+/* which reads a free-running counter: the time-stamp counter   */
+/* on x86, the microsecond timer on Arduino, or clock()         */
+/* elsewhere.  Define CT_CYCLES() to use some other counter.    */
+/* Differences between readings are taken modulo the size of a  */
+/* Ct_cycles. */
+
+typedef unsigned long Ct_cycles;
+
+#ifndef CT_CYCLES
+#if defined __x86_64__ || defined __i386__
+#define CT_CYCLES() ( (Ct_cycles) __builtin_ia32_rdtsc() )
+#elif defined ARDUINO
+#include <Arduino.h>
+#define CT_CYCLES() ( (Ct_cycles) micros() )
+#else
+#include <time.h>
+#define CT_CYCLES() ( (Ct_cycles) clock() )
+#endif
+#endif
+
+#endif
+
+#if defined CT_STATS
+
+typedef struct {
+        unsigned long steps; /* steps taken */
+        Ct_cycles step_cycles; /* total time spent in steps */
+        Ct_cycles max_step_cycles; /* longest single step */
+        Ct_cycles wait_cycles; /* time spent runnable but not running */
+        unsigned long messages; /* messages dequeued or discarded */
+} Ct_thread_stats;
+
+#endif
+
+#if defined CT_GROUPS
+
+/* Threads may be gathered into groups -- one per subsystem, say   */
+/* -- created by ct_create_group() and joined by passing the group */
+/* to ct_create_thread().  Group 0, the default, always exists.    */
+/* Groups with runnable threads share the CPU in proportion to    */
+/* their weights, and a group with a cap gets no more than that   */
+/* percentage of each window of CT_GROUP_WINDOW units of          */
+/* CT_CYCLES(), even if the CPU must go idle meanwhile.  Within a */
+/* group, threads are scheduled as usual.  Real-time threads      */
+/* under EDF are accounted to their groups but never held back. */
+
+#ifndef CT_GROUPS_MAX
+#define CT_GROUPS_MAX 8
+#endif
+
+#ifndef CT_GROUP_WINDOW
+#define CT_GROUP_WINDOW 1000000UL
+#endif
+
+typedef struct {
+        unsigned long steps; /* steps taken by the group's threads */
+        Ct_cycles cycles; /* time spent in those steps */
+        unsigned long throttled; /* threads held back for the group's sake */
+} Ct_group_stats;
+
+#endif
+
+#if defined CT_WATCHDOG
+
+/* A thread may be given a step budget, in the units of          */
+/* CT_CYCLES(), by ct_set_step_budget().  A step that overruns   */
+/* its budget is counted, reported to the handler installed by   */
+/* ct_install_overrun_handler(), if any, and penalized as by     */
+/* ct_penalize(), if ct_set_overrun_penalty() says so.  Since a  */
+/* step can't be interrupted, the overrun comes to light only    */
+/* when the step returns. */
+
+typedef struct {
+        unsigned long overruns; /* steps longer than the budget */
+        Ct_cycles worst_cycles; /* longest of them */
+} Ct_watchdog_stats;
+
+/* With CT_WATCHDOG_BACKTRACE defined too (Linux only), a step   */
+/* still running after the hard limit set by ct_set_hard_limit() */
+/* is interrupted by a CT_WATCHDOG_SIGNAL, whose handler writes  */
+/* a backtrace to standard error and lets the step carry on.     */
+/* Arming a timer costs two system calls per step, so this is    */
+/* for debugging. */
+
+#if defined CT_WATCHDOG_BACKTRACE && ! defined CT_WATCHDOG_SIGNAL
+#define CT_WATCHDOG_SIGNAL ( SIGRTMIN + 3 )
+#endif
+
+#endif
+
+#if defined CT_SNAPSHOT
+
+/* ct_save_snapshot() writes the threads, their input queues and  */
+/* subscriptions, and the pending events to a file, from which    */
+/* ct_restore_snapshot() rebuilds them after a restart -- by      */
+/* mapping the file into memory and reading it in place.  The     */
+/* image holds no pointers, so it doesn't matter where it lands.  */
+/*                                                                */
+/* Nor can it hold step functions, destructors or thread data,    */
+/* which mean nothing to another process.  Instead a saver        */
+/* function describes each thread in bytes of its own choosing,   */
+/* and a restorer function turns the description back into a      */
+/* step function, destructor and data.  A thread awaiting a      */
+/* timeout comes back waiting for what was left of it, and a      */
+/* periodic thread keeps the phase of its releases; deadlines     */
+/* and groups are not saved.  Pending wakeups are delivered       */
+/* before saving.                                                 */
+/*                                                                */
+/* The saver writes a thread's description into its buffer if it  */
+/* fits, and returns its length either way.  The restorer gets    */
+/* the description, valid only during the call, and returns       */
+/* CT_OKAY or CT_ERROR. */
+
 #endif
 
 /* typedefs for callback function pointers: */
@@ -115,6 +604,22 @@ typedef void ( * Ct_error_reporter)(const char * msg);
 typedef int ( * Ct_step_function)(void *);
 typedef void ( * Ct_destructor)(void *);
 typedef int ( * Ct_user_exit)(void *);
+#if defined CT_FIBERS
+typedef int ( * Ct_fiber_function)(void *);
+#endif
+#if defined CT_WATCHDOG
+typedef void ( * Ct_overrun_handler)(Ct_handle thread, Ct_cycles elapsed);
+#endif
+#if defined CT_REPLAY
+typedef void ( * Ct_replay_writer)(const unsigned char * buff, unsigned len);
+typedef unsigned ( * Ct_replay_reader)(unsigned char * buff, unsigned len);
+#endif
+#if defined CT_SNAPSHOT
+typedef unsigned ( * Ct_thread_saver)(void * pData, Ct_step_function step,
+        Ct_destructor destruct, unsigned char * buff, unsigned len);
+typedef int ( * Ct_thread_restorer)(const unsigned char * buff, unsigned len,
+        void ** ppData, Ct_step_function * pStep, Ct_destructor * pDestruct);
+#endif
 
 #ifdef __cplusplus
 extern "C"
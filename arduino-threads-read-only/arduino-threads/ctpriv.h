@@ -51,6 +51,13 @@ typedef struct Ct_event Ct_event;
 #define MSGNODE_MAGIC 9485763L
 #endif
 
+#if defined CT_MAILBOX
+
+/* Internal status: a message was discarded for want of room */
+
+#define CT_MSG_DROPPED 3
+#endif
+
 enum Ct_event_type
 {
     CT_EV_MSG,
@@ -58,6 +65,14 @@ enum Ct_event_type
 };
 typedef enum Ct_event_type Ct_event_type;
 
+/* A message or wakeup carries the effective priority of its   */
+/* sender, and the receiver runs at that priority, if higher   */
+/* than its own, until it has no such message left.  A thread's */
+/* effective priority is its own, or that of the most urgent    */
+/* message waiting for it, so urgency passes along a chain of   */
+/* requests.  Timeouts, I/O completions and events from other   */
+/* OS threads count as most urgent. */
+
 /* The following represents a pending event */
 /* not yet dispatched to any thread:        */
 
@@ -65,6 +80,10 @@ struct Ct_event {
         Ct_event * pNext;
         Ct_msgtype type;
         Ct_event_type ev_type;
+        int priority; /* effective priority of the sender */
+#if defined CT_MAILBOX
+        int reserved; /* boolean: already counted in the addressee's mailbox */
+#endif
         size_t msg_len;
         unsigned refcount; /* reference count */
         void * pData; /* for long messages */
@@ -80,6 +99,37 @@ struct Ct_event {
 #define EVENT_MAGIC 7846735L
 #endif
 
+#if defined CT_THREADSAFE
+
+/* An event on its way from one OS thread to another.  It  */
+/* carries its data by value, so that neither side has to  */
+/* touch the other's memory pools; hence such messages are */
+/* limited to CT_MSG_BUF_LEN bytes. */
+
+typedef struct {
+        Ct_event_type ev_type;
+        Ct_msgtype type;
+        size_t msg_len;
+        Ct_dispatch_type dispatch_type;
+        Ct_handle addressee;
+        unsigned char buff [CT_MSG_BUF_LEN ];
+} Ct_posted_event;
+
+#endif
+
+#if defined CT_EPOLL
+
+/* A thread's wait on a file descriptor, which indexes a table */
+/* of these: */
+
+typedef struct {
+        Ct_handle thread;
+        int registered; /* boolean: the epoll instance knows the fd */
+        int armed; /* boolean: a thread is waiting on it */
+} Ct_fd_wait;
+
+#endif
+
 /* The following structure represents a message assigned */
 /* to a thread but not yet dequeued by that thread:      */
 
@@ -99,11 +149,82 @@ struct Ct_thread {
         unsigned short incarnation;
         void * pData;
         Ct_msgnode * msg_q;
+#if defined CT_MAILBOX
+        unsigned msg_capacity; /* most messages allowed, or 0 */
+        Ct_overflow_policy overflow;
+        int msg_blocked; /* boolean: senders are waiting for room */
+        Ct_handle blocked_on; /* mailbox this thread waits for room in */
+        Ct_mailbox_stats mailbox_stats;
+#endif
         Ct_sub * subscriptions;
         Ct_step_function step;
         Ct_destructor destruct;
+#if defined CT_COROUTINES
+        void * coroutine; /* frame address, if the thread is a coroutine */
+#endif
+#if defined CT_FIBERS
+        void * fiber; /* Ct_fiber, if the thread has its own stack */
+#endif
+#if defined CT_EPOLL
+        int wait_fd; /* descriptor it last waited on, or -1 */
+#endif
+#if CT_POLICY != CT_POLICY_MULTILEVEL
+        unsigned weight; /* CPU share under a proportional policy */
+#endif
+#if defined CT_GROUPS
+        unsigned group; /* index into the scheduler's groups */
+#endif
+#if defined CT_WORKERS
+        int claim_level; /* level a worker took it from, or -1 */
+#endif
+#if CT_POLICY == CT_POLICY_STRIDE
+        unsigned long stride; /* CT_STRIDE1 / weight */
+        unsigned long pass; /* virtual time of the next step */
+#elif CT_POLICY == CT_POLICY_LOTTERY
+        unsigned lottery_slot; /* its slot in its level's draw, or 0 */
+        int lottery_level; /* level of that draw */
+#endif
+#if defined CT_WAKEUPS
+        int wake_pending; /* boolean: on the scheduler's wakeup list */
+        int wake_priority; /* priority of the pending wakeup, if any */
+#endif
+#if defined CT_QUANTUM
+        unsigned quantum; /* maximum steps per dispatch */
+        Ct_quantum_stats quantum_stats;
+#endif
+#if defined CT_WATCHDOG
+        Ct_cycles step_budget; /* longest step allowed, or 0 */
+        Ct_watchdog_stats watchdog_stats;
+#endif
+#if defined CT_STATS
+        Ct_thread_stats stats;
+        Ct_cycles ready_since; /* when last queued as runnable */
+#endif
+#if defined CT_TRACE
+        unsigned short trace_id; /* names the thread in a trace */
+#endif
+#if defined CT_REPLAY
+        unsigned long replay_id; /* order of creation, from 1 */
+#endif
 #if defined CT_TIMEOUT
         Ct_time deadline;
+#if defined CT_QUANTUM
+        unsigned long quantum_ticks; /* time budget per dispatch, or 0 */
+#endif
+#if defined CT_PERIODIC
+        unsigned long period; /* ticks between releases, or 0 */
+        Ct_time release; /* the next release, or the current one if released */
+        Ct_periodic_policy periodic_policy;
+        int released; /* boolean: the current dispatch begins a period */
+        int releasing; /* boolean: on the timing wheel awaiting release */
+        Ct_periodic_stats periodic_stats;
+#endif
+#if CT_POLICY == CT_POLICY_EDF
+        Ct_time rt_deadline; /* deadline of the current job */
+        unsigned long rt_period; /* ticks between deadlines, or 0 */
+        unsigned long rt_util; /* reserved share, in CT_EDF_SCALE parts */
+        unsigned long rt_misses; /* jobs finished after their deadline */
+#endif
 #endif
 #ifndef NDEBUG
         long magic;
@@ -114,4 +235,114 @@ struct Ct_thread {
 #define CT_MAGIC 3984756L
 #endif
 
+/* Threads are allocated in slabs, each a header followed by an */
+/* array of threads.  A slab is freed only when all are:        */
+
+typedef struct Ct_slab Ct_slab;
+
+struct Ct_slab {
+        Ct_slab * pNext;
+        Ct_thread threads[ 1 ]; /* actually as many as allocated */
+};
+
+#if defined CT_SNAPSHOT
+
+/* A snapshot image being built in memory: */
+
+typedef struct {
+        unsigned char * buff;
+        unsigned long len; /* bytes used */
+        unsigned long max; /* bytes allocated */
+        int failed; /* boolean: out of memory */
+} Ct_snap_out;
+
+/* A snapshot image being read in place: */
+
+typedef struct {
+        const unsigned char * buff;
+        unsigned long len;
+        unsigned long pos; /* next byte to read */
+        int bad; /* boolean: the image is corrupt */
+} Ct_snap_in;
+
+/* A saved thread's place in the image, for looking up by address */
+/* the addressees of pending events: */
+
+typedef struct {
+        const Ct_thread * pThread;
+        unsigned long id;
+} Ct_snap_id;
+
+#endif
+
+#if defined CT_GROUPS
+
+/* A group's virtual time advances by CT_GROUP_SCALE / weight per */
+/* cycle it runs, so weights beyond CT_GROUP_SCALE make no finer  */
+/* distinctions: */
+
+#define CT_GROUP_SCALE 1024UL
+
+/* A group of threads sharing the CPU.  Threads held back while */
+/* other groups catch up wait on a list anchored by a dummy:    */
+
+typedef struct {
+        int in_use; /* boolean */
+        unsigned weight;
+        unsigned cap; /* percent of each window, or 0 for no cap */
+        unsigned long stride; /* CT_GROUP_SCALE / weight */
+        unsigned long pass; /* virtual time used */
+        Ct_cycles window_used; /* time used in the current window */
+        Ct_thread parked; /* dummy anchoring the held-back threads */
+        Ct_group_stats stats;
+} Ct_group;
+
+#endif
+
+#if CT_POLICY == CT_POLICY_LOTTERY
+
+/* The threads queued at one level under the lottery policy, by */
+/* slot, with a Fenwick tree of their weights so that a draw    */
+/* takes time logarithmic in their number.  Slots run from 1:   */
+
+typedef struct {
+        unsigned long * sums; /* Fenwick tree, indexed 1 to max */
+        Ct_thread ** slots; /* thread in each slot, indexed 1 to count */
+        unsigned count; /* slots in use */
+        unsigned max; /* slots allocated, 0 or a power of two */
+        unsigned long total; /* sum of the weights in use */
+} Ct_lottery;
+
+#endif
+
+#if defined CT_TIMEOUT
+
+#include <limits.h>
+
+/* Add a number of ticks to a time: */
+
+static inline void add_ticks(Ct_time * pTime, unsigned long ticks) {
+    if (ULONG_MAX - pTime->tick < ticks)
+        ++pTime->era;
+    pTime->tick += ticks;
+}
+
+/* Return the number of ticks from one time to a later one, or zero */
+/* if the second time is not later.  If the span is too long for an */
+/* unsigned long, return ULONG_MAX. */
+
+static inline unsigned long ticks_between(const Ct_time * pFrom,
+        const Ct_time * pTo) {
+    if (pTo->era == pFrom->era)
+        return pTo->tick > pFrom->tick ? pTo->tick - pFrom->tick : 0;
+    else if (pTo->era == pFrom->era + 1 && pTo->tick < pFrom->tick)
+        return pTo->tick - pFrom->tick; /* rolls over as intended */
+    else if (pTo->era > pFrom->era)
+        return ULONG_MAX;
+    else
+        return 0;
+}
+
+#endif
+
 #endif
@@ -0,0 +1,90 @@
+"""Convert a cheap-threads trace dump to Chrome trace JSON.
+
+A dump is what CTScheduler::ct_trace_dump() writes: a Ct_trace_header
+followed by Ct_trace_record's, in the layout of the machine that wrote
+them.  The output loads into chrome://tracing or ui.perfetto.dev, with
+one track per thread.
+
+usage: python3 ct_trace2json.py [--ticks-per-us N] dump [out.json]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+KINDS = {
+    1: "step_begin",
+    2: "step_end",
+    3: "wakeup",
+    4: "post",
+    5: "subscription",
+    6: "timeout",
+    7: "halt",
+}
+
+
+def read_dump(data):
+    if data[0:4] != b"CTTR":
+        raise ValueError("not a cheap-threads trace dump")
+    version, long_size, record_size, little = struct.unpack_from("4B", data, 4)
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+
+    end = "<" if little else ">"
+    ulong = {4: "I", 8: "Q"}[long_size]
+    (count,) = struct.unpack_from(end + ulong, data, 8)
+
+    # The members of a record come in this order: time, arg, thread, kind
+    layout = end + ulong + ulong + "HB"
+    offset = 8 + long_size
+    mask = (1 << (8 * long_size)) - 1
+    records = []
+    for i in range(count):
+        records.append(struct.unpack_from(layout, data, offset + i * record_size))
+    return records, mask
+
+
+def convert(records, mask, ticks_per_us):
+    events = []
+    base = records[0][0] if records else 0
+    elapsed = 0
+    prev = base
+    for time, arg, thread, kind in records:
+        # The counter wraps; accumulate differences instead
+        elapsed += (time - prev) & mask
+        prev = time
+        ts = elapsed / ticks_per_us
+        name = KINDS.get(kind, "kind_%d" % kind)
+        ev = {"pid": 0, "tid": thread, "ts": ts}
+        if kind == 1:
+            ev.update(name="step", ph="B")
+        elif kind == 2:
+            ev.update(name="step", ph="E", args={"rc": arg})
+        else:
+            ev.update(name=name, ph="i", s="t", args={"arg": arg})
+        events.append(ev)
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump")
+    parser.add_argument("out", nargs="?")
+    parser.add_argument("--ticks-per-us", type=float, default=1.0,
+                        help="counter ticks per microsecond (default 1)")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        records, mask = read_dump(f.read())
+    trace = convert(records, mask, args.ticks_per_us)
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()